@@ -0,0 +1,19 @@
+#!/usr/bin/env bash
+
+# Usage: ./RunBenchmarks.sh [path/to/nyx ...]
+# Runs every benchmark in this directory with each of the given binaries (or the first nyx binary found above this
+# directory), printing the wall-clock time taken. Build once with -DNYX_THREADED_DISPATCH=ON and once with OFF to
+# compare the two dispatch loops, or with -DNYX_NAN_BOXING=ON and OFF to compare the two representations of values.
+
+if [ $# -eq 0 ]; then
+  set -- "$(find ../ -name nyx-bin -type f | head -n 1)"
+fi
+
+TIMEFORMAT="%R s"
+
+for i in $(find ./ -type f -name "*.nyx" | sort); do
+  for NYX in "$@"; do
+    echo "Running ${i} with ${NYX}"
+    time ${NYX} --main ${i} > /dev/null
+  done
+done
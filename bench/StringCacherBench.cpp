@@ -0,0 +1,74 @@
+/* Copyright (C) 2020-2022  Dhruv Chawla */
+/* See LICENSE at project root for license details */
+
+// Measures the cost of creating, hashing, interning and releasing strings of various lengths through StringCacher.
+// Built when configured with -DNYX_BUILD_BENCHMARKS=ON, run as ./nyx-string-bench
+
+#include "nyx/Backend/VirtualMachine/StringCacher.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr std::size_t string_count = 4096;
+constexpr std::size_t total_bytes = 64 * 1024 * 1024;
+
+std::vector<std::string> make_strings(std::size_t length) {
+    std::mt19937 generator{length};
+    std::uniform_int_distribution<int> character{'a', 'z'};
+    std::vector<std::string> strings(string_count);
+    for (std::string &string : strings) {
+        string.resize(length);
+        for (char &ch : string) {
+            ch = static_cast<char>(character(generator));
+        }
+    }
+    return strings;
+}
+
+// Runs `body` over every string until about total_bytes have been processed, returning the time per string in ns
+template <typename Body>
+double time_per_string(const std::vector<std::string> &strings, Body body) {
+    std::size_t rounds = std::max<std::size_t>(1, total_bytes / (strings.size() * strings[0].size()));
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < rounds; i++) {
+        for (const std::string &string : strings) {
+            body(string);
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / static_cast<double>(rounds * strings.size());
+}
+} // namespace
+
+int main() {
+    std::size_t sink = 0;
+    std::printf("%8s %14s %14s %14s %14s\n", "length", "std::hash", "hash_string", "make+release", "intern+release");
+    for (std::size_t length : {1, 4, 16, 64, 256, 1024, 16384}) {
+        std::vector<std::string> strings = make_strings(length);
+        StringCacher cache{};
+
+        double std_hash = time_per_string(strings, [&](const std::string &string) {
+            sink += std::hash<std::string>{}(string);
+        });
+        double nyx_hash = time_per_string(strings, [&](const std::string &string) { sink += hash_string(string); });
+        double make = time_per_string(strings, [&](const std::string &string) {
+            const HashedString &made = cache.make(string);
+            sink += made.size();
+            StringCacher::release(made);
+        });
+        double intern = time_per_string(strings, [&](const std::string &string) {
+            const HashedString &interned = cache.intern(string);
+            sink += interned.size();
+            StringCacher::release(interned);
+        });
+
+        std::printf("%8zu %11.1f ns %11.1f ns %11.1f ns %11.1f ns\n", length, std_hash, nyx_hash, make, intern);
+    }
+    return sink == 0;
+}
@@ -59,6 +59,7 @@ struct BreakStmt;
 struct ClassStmt;
 struct ContinueStmt;
 struct ExpressionStmt;
+struct ForRangeStmt;
 struct ForStmt;
 struct FunctionStmt;
 struct IfStmt;
@@ -108,6 +109,7 @@ struct Visitor {
     virtual StmtVisitorType visit(ClassStmt &stmt) = 0;
     virtual StmtVisitorType visit(ContinueStmt &stmt) = 0;
     virtual StmtVisitorType visit(ExpressionStmt &stmt) = 0;
+    virtual StmtVisitorType visit(ForRangeStmt &stmt) = 0;
     virtual StmtVisitorType visit(ForStmt &stmt) = 0;
     virtual StmtVisitorType visit(FunctionStmt &stmt) = 0;
     virtual StmtVisitorType visit(IfStmt &stmt) = 0;
@@ -156,6 +158,7 @@ enum class NodeType {
     ClassStmt,
     ContinueStmt,
     ExpressionStmt,
+    ForRangeStmt,
     ForStmt,
     FunctionStmt,
     IfStmt,
@@ -664,6 +667,32 @@ struct IdentifierTuple {
     TupleType tuple;
 };
 
+struct ForRangeStmt final : public Stmt {
+    Token keyword{};
+    Token name{};
+    ExprNode begin{};
+    ExprNode end{};
+    bool inclusive{};
+    StmtNode body{};
+    TypeNode type{};
+    std::size_t stack_slot{};
+
+    std::string_view string_tag() override final { return "ForRangeStmt"; }
+
+    NodeType type_tag() override final { return NodeType::ForRangeStmt; }
+
+    ForRangeStmt() = default;
+    ForRangeStmt(Token keyword, Token name, ExprNode begin, ExprNode end, bool inclusive, StmtNode body)
+        : keyword{std::move(keyword)},
+          name{std::move(name)},
+          begin{std::move(begin)},
+          end{std::move(end)},
+          inclusive{inclusive},
+          body{std::move(body)} {}
+
+    StmtVisitorType accept(Visitor &visitor) override final { return visitor.visit(*this); }
+};
+
 struct ForStmt final : public Stmt {
     StmtNode initializer{};
     ExprNode condition{};
@@ -791,6 +820,7 @@ struct VarStmt final : public Stmt {
     NumericConversionType conversion_type{};
     RequiresCopy requires_copy{};
     bool originally_typeless{};
+    std::size_t stack_slot{};
 
     std::string_view string_tag() override final { return "VarStmt"; }
 
@@ -52,6 +52,7 @@ class ASTPrinter final : Visitor {
     StmtVisitorType visit(ClassStmt &stmt) override final;
     StmtVisitorType visit(ContinueStmt &stmt) override final;
     StmtVisitorType visit(ExpressionStmt &stmt) override final;
+    StmtVisitorType visit(ForRangeStmt &stmt) override final;
     StmtVisitorType visit(ForStmt &stmt) override final;
     StmtVisitorType visit(FunctionStmt &stmt) override final;
     StmtVisitorType visit(IfStmt &stmt) override final;
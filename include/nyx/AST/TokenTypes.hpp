@@ -91,6 +91,7 @@ enum class TokenType {
     FOR,
     IF,
     IMPORT,
+    IN,
     INT,
     MOVE,
     NULL_,
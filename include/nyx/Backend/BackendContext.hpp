@@ -10,6 +10,7 @@
 #include "nyx/ErrorLogger/ErrorLogger.hpp"
 
 #include <filesystem>
+#include <map>
 #include <string_view>
 #include <unordered_map>
 #include <vector>
@@ -20,8 +21,15 @@ struct BackendContext {
     RuntimeModule *main{};
 
     std::vector<RuntimeModule> compiled_modules{};
+    // Shared by the chunks of every module, which refer to it with compact indices
+    ConstantPool constants{};
     std::unordered_map<std::string, std::size_t> module_path_map{};
 
+    // Every function that is called or defined gets a dense index, keyed by module index and (mangled) function name,
+    // which is resolved into a pointer to the function by link_functions once all modules have been compiled
+    std::vector<RuntimeFunction *> functions{};
+    std::map<std::pair<std::size_t, std::string>, std::size_t> function_indices{};
+
     const CLIConfig *config{};
     ErrorLogger logger{};
 
@@ -30,6 +38,9 @@ struct BackendContext {
     std::size_t get_module_index_string(const std::string &module) noexcept;
     std::size_t get_module_index_path(const std::filesystem::path &path) noexcept;
 
+    std::size_t get_function_index(std::size_t module_index, const std::string &name);
+    void link_functions();
+
     void set_config(const CLIConfig *config);
 };
 
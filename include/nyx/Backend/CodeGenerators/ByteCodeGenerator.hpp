@@ -16,9 +16,12 @@
 
 #include <stack>
 #include <string_view>
+#include <unordered_set>
 
 class ByteCodeGenerator final : Visitor {
     static constexpr const char *aggregate_destructor_prefix = "__destruct_";
+    // Switches with fewer cases than this are fast enough with a chain of comparisons
+    static constexpr std::size_t switch_table_min_cases = 3;
 
     FrontendContext *compile_ctx{};
     BackendContext *runtime_ctx{};
@@ -26,6 +29,7 @@ class ByteCodeGenerator final : Visitor {
     Chunk *current_chunk{nullptr};
     Module *current_module{nullptr};
     RuntimeModule *current_compiled{nullptr};
+    std::size_t current_module_index{};
 
     std::size_t current_scope_depth{};
     std::vector<std::pair<const BaseType *, std::size_t>> scopes{};
@@ -36,10 +40,14 @@ class ByteCodeGenerator final : Visitor {
     // Similar thing as for break statements
     std::stack<std::vector<std::size_t>> break_stmts{};
 
-    std::unordered_map<std::string_view, Native> natives{};
-
     bool variable_tracking_suppressed{};
 
+    // Indexing, division and modulo expressions which have been proven to never fail their runtime checks, so that the
+    // checks can be left out
+    std::unordered_set<const Expr *> unchecked_exprs{};
+    // Locals which are not read again after these uses of them, so that they can be moved out of instead of copied
+    std::unordered_set<const Expr *> last_uses{};
+
     [[nodiscard]] bool contains_destructible_type(const BaseType *type) const noexcept;
     [[nodiscard]] bool aggregate_destructor_already_exists(const BaseType *type) const noexcept;
     void generate_list_destructor_loop(const ListType *list);
@@ -50,12 +58,30 @@ class ByteCodeGenerator final : Visitor {
     void remove_topmost_scope();
     void end_scope();
     void destroy_locals(std::size_t until_scope);
+    [[nodiscard]] bool locals_need_destruction(std::size_t until_scope) const noexcept;
     void add_to_scope(const BaseType *type);
     void patch_jump(std::size_t jump_idx, std::size_t jump_amount);
     void emit_conversion(NumericConversionType conversion_type, std::size_t line_number);
     void emit_operand(std::size_t value);
     void emit_stack_slot(std::size_t value);
+    // Variables of these types are neither refcounted nor references, so the *_SCALAR instructions can be used for them
+    [[nodiscard]] bool is_scalar_variable(const BaseType *type) const noexcept;
+    void emit_variable_access(IdentifierType variable, const BaseType *type, std::size_t line);
+    void emit_variable_assign(IdentifierType variable, const BaseType *type, std::size_t line);
     void emit_destructor_call(ClassStmt *class_, std::size_t line);
+    void emit_function_load(std::size_t module_index, const std::string &name, std::size_t line);
+    void emit_function_call(std::size_t module_index, const std::string &name, std::size_t line);
+    void emit_native_call(std::string_view name, std::size_t line);
+    void emit_make_list(const ListType *type, std::size_t size, std::size_t line);
+    void emit_call_arguments(CallExpr &expr);
+    // Moves a local out at its last use, leaving null behind for destroy_locals() to skip
+    void emit_last_use(Expr *expr);
+
+    // Switches on ints or strings whose cases are all literals are dispatched through a jump table. Any other switch
+    // compares the condition against its cases one at a time with POP_JUMP_IF_EQUAL, which is returned for it
+    [[nodiscard]] Instruction switch_instruction(SwitchStmt &stmt) const;
+    void fill_switch_table(SwitchStmt &stmt, Instruction instruction, Chunk::SwitchTable &table,
+        const std::vector<std::size_t> &case_offsets, std::size_t default_offset);
 
     void make_ref_to(ExprNode &value);
 
@@ -64,6 +90,9 @@ class ByteCodeGenerator final : Visitor {
     void add_vartuple_to_scope(IdentifierTuple::TupleType &tuple);
     std::size_t compile_vartuple(IdentifierTuple::TupleType &tuple, TupleType &type);
 
+    std::size_t get_arity(FunctionStmt &stmt);
+    [[nodiscard]] bool contains_ref_type(const BaseType *type) const noexcept;
+    bool is_tail_call(ReturnStmt &stmt);
     bool is_ctor_call(ExprNode &node);
     ClassStmt *get_class(ExprNode &node);
 
@@ -116,6 +145,7 @@ class ByteCodeGenerator final : Visitor {
     StmtVisitorType visit(ClassStmt &stmt) override final;
     StmtVisitorType visit(ContinueStmt &stmt) override final;
     StmtVisitorType visit(ExpressionStmt &stmt) override final;
+    StmtVisitorType visit(ForRangeStmt &stmt) override final;
     StmtVisitorType visit(ForStmt &stmt) override final;
     StmtVisitorType visit(FunctionStmt &stmt) override final;
     StmtVisitorType visit(IfStmt &stmt) override final;
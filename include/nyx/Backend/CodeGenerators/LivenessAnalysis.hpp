@@ -0,0 +1,23 @@
+#pragma once
+
+/* Copyright (C) 2020-2022  Dhruv Chawla */
+/* See LICENSE at project root for license details */
+
+#ifndef LIVENESS_ANALYSIS_HPP
+#define LIVENESS_ANALYSIS_HPP
+
+#include "nyx/AST/AST.hpp"
+
+#include <unordered_set>
+
+// Find the uses of list, tuple and instance locals in the body of a function which would copy the local but are the
+// last time it is read, and add them to `last_uses`. These are the arguments passed by value, the values returned, the
+// initializers of variables and the values assigned to variables which name a local and nothing else, such as `xs` in
+// `f(xs)` or `return xs`. The local can be moved out of instead of being copied there, as no path through the function
+// reads it again before it is assigned to.
+//
+// Locals which a reference is taken to are left out, as they can still be read through the reference. If the body
+// contains anything that is not understood, nothing is added.
+void find_last_uses(FunctionStmt &function, std::unordered_set<const Expr *> &last_uses);
+
+#endif
@@ -0,0 +1,17 @@
+#pragma once
+
+/* Copyright (C) 2020-2022  Dhruv Chawla */
+/* See LICENSE at project root for license details */
+
+#ifndef PEEPHOLE_OPTIMIZER_HPP
+#define PEEPHOLE_OPTIMIZER_HPP
+
+#include "nyx/Backend/RuntimeModule.hpp"
+#include "nyx/Backend/VirtualMachine/Chunk.hpp"
+
+// Replace common sequences of instructions emitted by the ByteCodeGenerator with single (super)instructions, updating
+// jump offsets and line numbers to match
+void peephole_optimize_chunk(Chunk &chunk);
+void peephole_optimize_module(RuntimeModule &module);
+
+#endif
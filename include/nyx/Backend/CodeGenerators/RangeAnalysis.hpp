@@ -0,0 +1,30 @@
+#pragma once
+
+/* Copyright (C) 2020-2022  Dhruv Chawla */
+/* See LICENSE at project root for license details */
+
+#ifndef RANGE_ANALYSIS_HPP
+#define RANGE_ANALYSIS_HPP
+
+#include "nyx/AST/AST.hpp"
+
+#include <unordered_set>
+
+// Find the expressions in the body of a loop desugared from a for-loop which cannot fail their runtime checks, and add
+// them to `unchecked`. The loop must have the form
+//
+//     var i = <non-negative int>
+//     while (i < size(xs)) { ... } (with i = i + <positive int>, i += <positive int> or ++i as its increment)
+//
+// and nothing in its body may change `i` or the size of `xs`. Then every `xs[i]` in the body is within bounds, and
+// every division or modulo by `size(xs)` is by a non-zero value.
+void find_unchecked_in_loop(VarStmt &initializer, WhileStmt &loop, std::unordered_set<const Expr *> &unchecked);
+// The same, for a range loop of the form `for i in <non-negative int>..size(xs) { ... }`
+void find_unchecked_in_loop(ForRangeStmt &loop, std::unordered_set<const Expr *> &unchecked);
+
+// Whether a division or modulo by this expression can skip the check for zero
+[[nodiscard]] bool is_nonzero_constant(Expr *expr) noexcept;
+// Whether a shift by this expression can skip the check for negative values
+[[nodiscard]] bool is_nonnegative_constant(Expr *expr) noexcept;
+
+#endif
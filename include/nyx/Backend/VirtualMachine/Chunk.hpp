@@ -9,29 +9,69 @@
 #include "Instructions.hpp"
 #include "StringCacher.hpp"
 
+#include <cstdint>
 #include <deque>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 struct Value;
 
+// The constants of every chunk of a program. Each int, float and string is stored once however many chunks use it, and
+// chunks refer to them by their index in values
+struct ConstantPool {
+    std::vector<Value> values{};
+    std::deque<HashedString> strings{};
+
+    // The index in values of every int, float (by its bits) and string added so far
+    std::unordered_map<std::int32_t, std::size_t> int_constants{};
+    std::unordered_map<std::uint64_t, std::size_t> float_constants{};
+    std::unordered_map<std::string, std::size_t> string_constants{};
+
+    std::size_t add_constant(Value value);
+    std::size_t add_string(std::string value);
+};
+
 struct Chunk {
     static constexpr std::size_t const_short_max = (1 << 8) - 1;
     static constexpr std::size_t const_long_max = (std::size_t{1} << 24) - 1;
 
     using InstructionSizeType = std::uint32_t;
 
+    // The range of ints that PUSH_INT_IMM can hold in its operand, as a 24-bit two's complement number
+    static constexpr std::int32_t int_immediate_min = -(1 << 23);
+    static constexpr std::int32_t int_immediate_max = (1 << 23) - 1;
+
+    // An instruction split into its opcode and operand, along with the address of the VirtualMachine's handler for it
+    // when threaded dispatch is in use
+    struct DecodedInstruction {
+        const void *handler{};
+        InstructionSizeType instruction{};
+        InstructionSizeType operand{};
+    };
+
+    // The jump table of a TABLE_SWITCH, LOOKUP_SWITCH or STRING_SWITCH, which has the index of the table as its
+    // operand. Like those of JUMP_FORWARD, the offsets are counted from the end of the instruction
+    struct SwitchTable {
+        std::int32_t low{};                                         // TABLE_SWITCH: the value of the first case
+        std::vector<std::int32_t> keys{};                           // LOOKUP_SWITCH: the sorted case values
+        std::vector<std::pair<std::size_t, std::string>> strings{}; // STRING_SWITCH: the case strings, sorted by hash
+        std::vector<InstructionSizeType> offsets{};                 // One for every entry of the table, key or string
+        InstructionSizeType default_offset{};                       // Taken when no case matches
+    };
+
     std::vector<InstructionSizeType> bytes{};
-    std::vector<Value> constants{};
-    std::deque<HashedString> strings{};
+    // Filled in from bytes by the VirtualMachine before execution, one entry per instruction. The bytes are still used
+    // by the disassembler and for looking up line numbers
+    std::vector<DecodedInstruction> decoded{};
+    ConstantPool *constants{}; // Set by the ByteCodeGenerator, shared with every other chunk of the program
+    std::vector<SwitchTable> switch_tables{};
     std::vector<std::pair<std::size_t, std::size_t>> line_numbers{};
     // Store line numbers of instructions using Run Length Encoding, first line number then instruction count for that
     // line
 
     explicit Chunk() = default;
-    std::size_t add_constant(Value value);
-    std::size_t add_string(std::string value);
     std::size_t emit_byte(Chunk::InstructionSizeType value);
     std::size_t emit_bytes(Chunk::InstructionSizeType value_1, Chunk::InstructionSizeType value_2);
     std::size_t emit_constant(Value value, std::size_t line_number);
@@ -39,6 +79,15 @@ struct Chunk {
     std::size_t emit_instruction(Instruction instruction, std::size_t line_number);
 
     std::size_t get_line_number(std::size_t insn_ptr);
+
+    [[nodiscard]] static constexpr InstructionSizeType encode_int_immediate(std::int32_t value) noexcept {
+        return static_cast<InstructionSizeType>(value) & 0x00ff'ffff;
+    }
+    [[nodiscard]] static constexpr std::int32_t decode_int_immediate(InstructionSizeType operand) noexcept {
+        return operand > static_cast<InstructionSizeType>(int_immediate_max)
+                   ? static_cast<std::int32_t>(operand) - (1 << 24)
+                   : static_cast<std::int32_t>(operand);
+    }
 };
 
 #endif
\ No newline at end of file
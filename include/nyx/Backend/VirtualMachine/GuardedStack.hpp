@@ -0,0 +1,57 @@
+#pragma once
+
+/* Copyright (C) 2020-2022  Dhruv Chawla */
+/* See LICENSE at project root for license details */
+
+#ifndef GUARDED_STACK_HPP
+#define GUARDED_STACK_HPP
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// Reserves address space for `bytes` bytes followed by an inaccessible guard page. The memory is zeroed and is only
+// backed by physical pages once it is touched. Touching the guard page reports `overflow_message` and exits. Throws
+// std::bad_alloc when the memory cannot be reserved, and std::runtime_error when too many guarded regions exist at once
+[[nodiscard]] void *reserve_guarded_region(std::size_t bytes, const char *overflow_message);
+void release_guarded_region(void *region, std::size_t bytes);
+
+// A fixed capacity stack whose storage never moves, so pointers into it stay valid for its whole lifetime. Objects are
+// not constructed individually, they start out as zeroed memory, hence the restriction on T
+template <typename T>
+class GuardedStack {
+    static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>,
+        "GuardedStack can only hold types which can live in zeroed memory");
+
+    T *memory{};
+    std::size_t capacity{};
+
+  public:
+    GuardedStack() noexcept = default;
+    GuardedStack(std::size_t capacity_, const char *overflow_message)
+        : memory{static_cast<T *>(reserve_guarded_region(capacity_ * sizeof(T), overflow_message))},
+          capacity{capacity_} {}
+    ~GuardedStack() {
+        if (memory != nullptr) {
+            release_guarded_region(memory, capacity * sizeof(T));
+        }
+    }
+
+    GuardedStack(const GuardedStack &) = delete;
+    GuardedStack &operator=(const GuardedStack &) = delete;
+
+    GuardedStack(GuardedStack &&other) noexcept
+        : memory{std::exchange(other.memory, nullptr)}, capacity{std::exchange(other.capacity, 0)} {}
+    GuardedStack &operator=(GuardedStack &&other) noexcept {
+        std::swap(memory, other.memory);
+        std::swap(capacity, other.capacity);
+        return *this;
+    }
+
+    [[nodiscard]] T &operator[](std::size_t index) noexcept { return memory[index]; }
+    [[nodiscard]] const T &operator[](std::size_t index) const noexcept { return memory[index]; }
+    [[nodiscard]] T *get() const noexcept { return memory; }
+    [[nodiscard]] std::size_t get_capacity() const noexcept { return capacity; }
+};
+
+#endif
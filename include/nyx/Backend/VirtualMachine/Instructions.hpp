@@ -6,11 +6,14 @@
 #ifndef INSTRUCTIONS_HPP
 #define INSTRUCTIONS_HPP
 
+#include <cstddef>
+
 enum class Instruction {
     HALT,
     POP,
     /* Push constants on stack */
     CONSTANT,
+    PUSH_INT_IMM, // Pushes an int which fits in the operand, stored there as a 24-bit two's complement number
     /* Integer operations */
     IADD,
     ISUB,
@@ -18,6 +21,8 @@ enum class Instruction {
     IDIV,
     IMOD,
     INEG, // (unary -)
+    IDIV_UNCHECKED, // IDIV and IMOD for divisors known to be non-zero
+    IMOD_UNCHECKED,
     /* Floating point operations */
     FADD,
     FSUB,
@@ -31,6 +36,8 @@ enum class Instruction {
     /* Bitwise operations */
     SHIFT_LEFT,
     SHIFT_RIGHT,
+    SHIFT_LEFT_UNCHECKED, // SHIFT_LEFT and SHIFT_RIGHT for amounts known to be non-negative
+    SHIFT_RIGHT_UNCHECKED,
     BIT_AND,
     BIT_OR,
     BIT_NOT,
@@ -40,6 +47,12 @@ enum class Instruction {
     EQUAL,
     GREATER,
     LESSER,
+    IEQUAL, // EQUAL, GREATER and LESSER for operands statically known to be ints
+    IGREATER,
+    ILESSER,
+    FEQUAL, // EQUAL, GREATER and LESSER for operands statically known to be floats
+    FGREATER,
+    FLESSER,
     /* Constant operations */
     PUSH_TRUE,
     PUSH_FALSE,
@@ -52,23 +65,34 @@ enum class Instruction {
     POP_JUMP_IF_EQUAL,
     POP_JUMP_IF_FALSE,
     POP_JUMP_BACK_IF_TRUE,
+    FOR_RANGE, // Increments an int local and jumps back while it is below another, followed by that local and the offset
+    FOR_RANGE_INCLUSIVE, // FOR_RANGE for a..=b, which only increments the local if it is below the end of the range
+    TABLE_SWITCH,  // Pops an int and jumps to the offset at its index in a dense table of cases
+    LOOKUP_SWITCH, // Pops an int and binary searches sorted sparse cases for it
+    STRING_SWITCH, // Pops a string and looks it up among the cases by its hash
     /* Local variable operations */
     ASSIGN_LOCAL,
     ACCESS_LOCAL,
+    ASSIGN_LOCAL_SCALAR, // ASSIGN_LOCAL for locals statically known to be non-ref ints, floats or bools
+    ACCESS_LOCAL_SCALAR, // ACCESS_LOCAL for the same
     MAKE_REF_TO_LOCAL,
     DEREF,
     /* Global variable operations */
     ASSIGN_GLOBAL,
     ACCESS_GLOBAL,
+    ASSIGN_GLOBAL_SCALAR,
+    ACCESS_GLOBAL_SCALAR,
     MAKE_REF_TO_GLOBAL,
     /* Function calls */
-    LOAD_FUNCTION_SAME_MODULE,
-    LOAD_FUNCTION_MODULE_INDEX,
-    LOAD_FUNCTION_MODULE_PATH,
+    LOAD_FUNCTION, // Pushes the function with the given index in BackendContext::functions
     CALL_FUNCTION,
+    CALL_DIRECT, // LOAD_FUNCTION followed by CALL_FUNCTION
     CALL_NATIVE,
     RETURN,
     TRAP_RETURN,
+    TAIL_CALL,         // Calls a function by reusing the current frame, replacing its locals with the arguments
+    STASH_ARGUMENTS,   // Moves the topmost operand values off the stack while the locals under them are destroyed
+    RESTORE_ARGUMENTS, // Moves the values set aside by STASH_ARGUMENTS back on to the stack
     /* String instructions */
     CONSTANT_STRING,
     INDEX_STRING,
@@ -77,6 +101,9 @@ enum class Instruction {
     CONCATENATE,
     /* List instructions */
     MAKE_LIST,
+    MAKE_INT_LIST, // MAKE_LIST for lists of ints, floats and bools, which keep their elements unboxed
+    MAKE_FLOAT_LIST,
+    MAKE_BOOL_LIST,
     COPY_LIST,
     APPEND_LIST,
     POP_FROM_LIST,
@@ -84,6 +111,8 @@ enum class Instruction {
     INDEX_LIST,
     MAKE_REF_TO_INDEX,
     CHECK_LIST_INDEX,
+    GET_FIELD, // INDEX_LIST for members of class instances and tuples, with the index as the operand
+    SET_FIELD, // ASSIGN_LIST for the same
     ACCESS_LOCAL_LIST,
     ACCESS_GLOBAL_LIST,
     ASSIGN_LOCAL_LIST,
@@ -92,13 +121,29 @@ enum class Instruction {
     /* Miscellaneous */
     ACCESS_FROM_TOP,
     ASSIGN_FROM_TOP,
-    EQUAL_SL, // Equality operation for lists and strings
+    ASSIGN_FROM_TOP_SCALAR,
+    EQUAL_SL,     // Equality operation for lists and strings
+    EQUAL_STRING, // EQUAL_SL for operands statically known to be strings
     /* Move instructions */
     MOVE_LOCAL,
     MOVE_GLOBAL,
     MOVE_INDEX,
     /* Swap instructions */
     SWAP, // Swaps the top two values on the stack
+    /* Superinstructions, emitted only by the peephole optimizer */
+    INC_LOCAL,                // Increments a non-ref integer local by one
+    POP_N,                    // Pops operand values off the stack
+    LOCAL_LT_CONST_JUMP_BACK, // Jumps back if an int local is less than a constant, followed by the constant and offset
 };
 
+// The number of words an instruction takes up in a chunk, including any extra operand words following it
+constexpr std::size_t instruction_length(Instruction instruction) noexcept {
+    switch (instruction) {
+        case Instruction::FOR_RANGE:
+        case Instruction::FOR_RANGE_INCLUSIVE:
+        case Instruction::LOCAL_LT_CONST_JUMP_BACK: return 3;
+        default: return 1;
+    }
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+
+/* Copyright (C) 2020-2022  Dhruv Chawla */
+/* See LICENSE at project root for license details */
+
+#ifndef LIST_POOL_HPP
+#define LIST_POOL_HPP
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Storage for lists (and so for tuples and class instances), both for the list objects themselves and for their
+// elements. Blocks of up to max_pooled_size bytes are rounded up to a multiple of granularity bytes and carved out of
+// large chunks, and freed blocks are kept on a free list per size so that they can be handed out again without going
+// through the global allocator. Larger blocks are passed on to operator new. Chunks are only released when the pool
+// itself is destroyed.
+class ListPool {
+  public:
+    constexpr static std::size_t granularity = 16;
+    constexpr static std::size_t max_pooled_size = 512;
+    constexpr static std::size_t chunk_size = 64 * 1024;
+
+    struct Statistics {
+        std::size_t reused{};  // Allocations served from a free list
+        std::size_t carved{};  // Allocations which took fresh memory from a chunk
+        std::size_t large{};   // Allocations too large for the pool
+        std::size_t chunks{};  // Chunks taken from the global allocator
+    };
+
+  private:
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    std::array<FreeBlock *, max_pooled_size / granularity> free_lists{};
+    std::vector<std::unique_ptr<char[]>> chunks{};
+    char *chunk_top{};
+    char *chunk_end{};
+    Statistics statistics{};
+
+    [[nodiscard]] static std::size_t size_class(std::size_t bytes) noexcept {
+        return (bytes + granularity - 1) / granularity - 1;
+    }
+
+    void *carve(std::size_t bytes);
+
+  public:
+    ListPool() = default;
+    ListPool(const ListPool &) = delete;
+    ListPool &operator=(const ListPool &) = delete;
+
+    [[nodiscard]] void *allocate(std::size_t bytes) {
+        if (bytes > max_pooled_size || bytes == 0) {
+            statistics.large++;
+            return ::operator new(bytes);
+        }
+        FreeBlock *&free_list = free_lists[size_class(bytes)];
+        if (free_list != nullptr) {
+            statistics.reused++;
+            return std::exchange(free_list, free_list->next);
+        }
+        return carve(bytes);
+    }
+
+    void deallocate(void *block, std::size_t bytes) noexcept {
+        if (bytes > max_pooled_size || bytes == 0) {
+            ::operator delete(block);
+            return;
+        }
+        FreeBlock *&free_list = free_lists[size_class(bytes)];
+        free_list = new (block) FreeBlock{free_list};
+    }
+
+    [[nodiscard]] const Statistics &get_statistics() const noexcept { return statistics; }
+};
+
+#endif
@@ -37,6 +37,9 @@ class NativeWrapper {
     TypeNode return_type{};
     std::size_t arity{};
     ArgumentVerifierType argument_verifier{};
+    std::size_t id{};
+
+    friend class NativeWrappers;
 
   public:
     NativeWrapper(NativeFunctionType native, std::string name, TypeNode return_type, std::size_t arity,
@@ -45,6 +48,7 @@ class NativeWrapper {
     [[nodiscard]] Native get_native() const noexcept;
     [[nodiscard]] const std::string &get_name() const noexcept;
     [[nodiscard]] std::size_t get_arity() const noexcept;
+    [[nodiscard]] std::size_t get_id() const noexcept;
     [[nodiscard]] bool check_arity(std::size_t num_args) const noexcept;
     [[nodiscard]] std::pair<bool, std::string_view> check_arguments(
         std::vector<CallExpr::ArgumentType> &arguments) const noexcept;
@@ -57,12 +61,16 @@ class NativeWrappers {
 
   private:
     NativeCollectionType native_functions{};
+    // Natives in the order they were added, which is the order of their definitions in Natives.cpp. A native's id is
+    // its index in this list
+    std::vector<NativeWrapper *> natives_by_id{};
 
   public:
     void add_native(NativeWrapper &native);
     [[nodiscard]] bool is_native(std::string_view function) const noexcept;
     [[nodiscard]] const NativeWrapper *get_native(std::string_view function) const noexcept;
     [[nodiscard]] const NativeCollectionType &get_all_natives() const noexcept;
+    [[nodiscard]] const std::vector<NativeWrapper *> &get_all_natives_by_id() const noexcept;
 };
 
 extern NativeWrappers native_wrappers;
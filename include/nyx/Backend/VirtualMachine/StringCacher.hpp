@@ -6,45 +6,124 @@
 #ifndef STRING_CACHER_HPP
 #define STRING_CACHER_HPP
 
+#include <array>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <unordered_set>
 #include <utility>
+#include <vector>
 
-struct HashedString {
-    std::string str{};
-    std::size_t hash{};
+// A wyhash style hash: it consumes 16 to 48 bytes per step using 64 by 64 bit multiplication, so it is much faster than
+// std::hash for long strings, and it is cheap for short ones
+[[nodiscard]] std::size_t hash_string(std::string_view string) noexcept;
+
+// A string is either flat, or a lazy concatenation (a rope) of two other strings. A rope holds references to both of
+// its halves, and is only flattened into a single buffer once its contents or its hash are needed, which makes repeated
+// concatenation linear instead of quadratic
+class HashedString {
+    mutable std::string str{};
+    mutable std::size_t hash{};
+    mutable bool hashed{}; // Hashes are only computed once they are needed, as most strings are never hashed
+    mutable const HashedString *left{};
+    mutable const HashedString *right{};
+    mutable std::size_t length{};
+
+    void flatten() const;
+
+    friend class StringCacher;
+
+  public:
+    // Starts out at one, the reference held by whoever created the string. Strings owned by a Chunk's constant table
+    // keep that reference for as long as the chunk lives, so the VM never frees them
+    mutable std::size_t refcount{1};
 
     HashedString() noexcept = default;
-    explicit HashedString(std::string str) : str{std::move(str)}, hash{std::hash<std::string>{}(this->str)} {}
+    explicit HashedString(std::string str) : str{std::move(str)}, length{this->str.size()} {}
+    // Takes over the references to both halves
+    HashedString(const HashedString *left, const HashedString *right) noexcept
+        : left{left}, right{right}, length{left->length + right->length} {}
+
+    [[nodiscard]] const std::string &get_str() const {
+        if (left != nullptr) {
+            flatten();
+        }
+        return str;
+    }
+    [[nodiscard]] std::size_t get_hash() const {
+        if (not hashed) {
+            hash = hash_string(get_str());
+            hashed = true;
+        }
+        return hash;
+    }
+    [[nodiscard]] std::size_t size() const noexcept { return length; }
 
-    [[nodiscard]] bool operator==(const HashedString &other) const noexcept {
-        return hash == other.hash && str == other.str;
+    // Hashes are only compared when both are already known, computing them just for this would be slower than
+    // comparing the strings directly
+    [[nodiscard]] bool operator==(const HashedString &other) const {
+        if (length != other.length || (hashed && other.hashed && hash != other.hash)) {
+            return false;
+        }
+        return get_str() == other.get_str();
     }
-    [[nodiscard]] bool operator>(const HashedString &other) const noexcept { return str > other.str; }
-    [[nodiscard]] bool operator<(const HashedString &other) const noexcept { return str < other.str; }
-    [[nodiscard]] bool operator==(const std::string &other) const noexcept { return str == other; }
+    [[nodiscard]] bool operator>(const HashedString &other) const { return get_str() > other.get_str(); }
+    [[nodiscard]] bool operator<(const HashedString &other) const { return get_str() < other.get_str(); }
+    [[nodiscard]] bool operator==(const std::string &other) const { return get_str() == other; }
 };
 
 namespace std {
 template <>
 struct hash<HashedString> {
-    std::size_t operator()(const HashedString &string) const noexcept { return string.hash; }
+    std::size_t operator()(const HashedString &string) const { return string.get_hash(); }
 };
 } // namespace std
 
+// Creates the strings used by the VM. Strings carry their own reference count, so copying one is a single increment.
+// Strings which are likely to be created over and over again can be interned, in which case every request for the same
+// contents returns the same string
 class StringCacher {
-    std::unordered_map<HashedString, std::size_t> strings{};
+    // Concatenations shorter than this are copied right away, as a rope would be larger than the string it stands for
+    constexpr static std::size_t min_rope_length = 256;
+
+    struct StringViewHash {
+        std::size_t operator()(std::string_view string) const noexcept { return hash_string(string); }
+    };
+
+    std::unordered_map<std::string_view, const HashedString *, StringViewHash> interned{};
+    // Every single byte string, and the string forms of the integers from 0 up to some limit. The tables hold a
+    // reference to each of these, so they are never freed while the StringCacher is alive
+    std::array<HashedString, 256> characters{};
+    std::vector<HashedString> small_ints{};
+
+    static void destroy(const HashedString &value) noexcept;
 
   public:
-    StringCacher() noexcept = default;
+    StringCacher();
+    ~StringCacher();
+
+    StringCacher(const StringCacher &) = delete;
+    StringCacher &operator=(const StringCacher &) = delete;
 
     [[nodiscard]] const HashedString &concat(const HashedString &first, const HashedString &second);
-    [[nodiscard]] const HashedString &insert(std::string &&value);
-    [[nodiscard]] const HashedString &insert(const std::string &value);
-    [[nodiscard]] const HashedString &insert(HashedString &&value);
-    [[nodiscard]] const HashedString &insert(const HashedString &value);
-    void remove(const HashedString &value);
+    [[nodiscard]] const HashedString &make(std::string value);
+    [[nodiscard]] const HashedString &intern(std::string_view value);
+    [[nodiscard]] const HashedString &character(char value) noexcept {
+        return retain(characters[static_cast<unsigned char>(value)]);
+    }
+    [[nodiscard]] const HashedString &from_int(std::int32_t value);
+    // Must be called before any strings are taken from the table, as it is not resized afterwards
+    void make_small_int_strings(std::size_t count);
+
+    static const HashedString &retain(const HashedString &value) noexcept {
+        value.refcount++;
+        return value;
+    }
+    static void release(const HashedString &value) noexcept {
+        if (--value.refcount == 0) {
+            destroy(value);
+        }
+    }
 };
 
 #endif
\ No newline at end of file
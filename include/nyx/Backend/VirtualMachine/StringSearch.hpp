@@ -0,0 +1,22 @@
+#pragma once
+
+/* Copyright (C) 2020-2022  Dhruv Chawla */
+/* See LICENSE at project root for license details */
+
+#ifndef STRING_SEARCH_HPP
+#define STRING_SEARCH_HPP
+
+#include <cstddef>
+#include <string_view>
+
+// Substring search for the string natives. On x86 the kernel is picked once, at startup: AVX2 when the CPU supports
+// it, SSE2 otherwise. Every other target uses a scalar loop. The vector kernels compare the first and last bytes of
+// the needle against a whole block of the haystack at once, and only check the rest of the needle where both match
+
+// Index of the first occurrence of needle in haystack starting at or after `from`, or std::string_view::npos
+[[nodiscard]] std::size_t find_substring(
+    std::string_view haystack, std::string_view needle, std::size_t from = 0) noexcept;
+// Index of the last occurrence of needle in haystack, or std::string_view::npos
+[[nodiscard]] std::size_t rfind_substring(std::string_view haystack, std::string_view needle) noexcept;
+
+#endif
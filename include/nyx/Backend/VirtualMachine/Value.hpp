@@ -6,12 +6,17 @@
 #ifndef VALUE_HPP
 #define VALUE_HPP
 
+#include "ListPool.hpp"
 #include "StringCacher.hpp"
 #include "nyx/Backend/RuntimeModule.hpp"
+#include "nyx/Common.hpp"
 
 #include <cstdint>
+#include <cstring>
 #include <string>
 
+class List;
+
 struct Value {
     struct PlaceHolder {};
 
@@ -22,8 +27,32 @@ struct Value {
     using NullType = std::nullptr_t;
     using ReferenceType = Value *;
     using FunctionType = RuntimeFunction *;
-    using ListType = std::vector<Value>;
+    using ListType = List;
+
+    enum class Tag { INVALID, INT, FLOAT, STRING, BOOL, NULL_, REF, FUNCTION, LIST, LIST_REF };
+
+  private:
+#if NAN_BOXING
+    // Floats are stored as they are. Every other value is stored in the low 48 bits of a NaN, with its tag in the top 16
+    // bits, which is why NaN floats are canonicalized on construction: otherwise they could look like a boxed value.
+    std::uint64_t bits;
 
+    static constexpr unsigned payload_bits = 48;
+    static constexpr std::uint64_t payload_mask = (std::uint64_t{1} << payload_bits) - 1;
+    static constexpr std::uint64_t boxed_tag_base = 0xfff1;
+    // Keeps the sign of a NaN, so that it is printed the same as without NaN boxing
+    static constexpr std::uint64_t negative_nan_bits = 0xfff0'0000'0000'0001;
+    static_assert(
+        (negative_nan_bits >> payload_bits) < boxed_tag_base, "A negative NaN must not look like a boxed value");
+
+    [[nodiscard]] static std::uint64_t box(Tag tag, std::uint64_t payload) noexcept {
+        return ((boxed_tag_base + static_cast<std::uint64_t>(tag)) << payload_bits) | payload;
+    }
+    template <typename T>
+    [[nodiscard]] T unbox_pointer() const noexcept {
+        return reinterpret_cast<T>(bits & payload_mask);
+    }
+#else
     union {
         PlaceHolder w_invalid;
 
@@ -37,8 +66,10 @@ struct Value {
         ListType *w_list;
     };
 
-    enum class Tag { INVALID, INT, FLOAT, STRING, BOOL, NULL_, REF, FUNCTION, LIST, LIST_REF } tag;
+    Tag tag;
+#endif
 
+  public:
     Value() noexcept;
     explicit Value(IntType value) noexcept;
     explicit Value(FloatType value) noexcept;
@@ -49,6 +80,37 @@ struct Value {
     explicit Value(FunctionType value) noexcept;
     explicit Value(ListType *value) noexcept;
 
+    // A LIST_REF shares its list with the value it was made from, so destroying it does not destroy the list
+    [[nodiscard]] static Value make_list_ref(ListType *value) noexcept;
+
+    // The getters reinterpret the payload without checking the tag, just like reading the wrong member of a union
+#if NAN_BOXING
+    [[nodiscard]] Tag get_tag() const noexcept {
+        std::uint64_t top = bits >> payload_bits;
+        return top >= boxed_tag_base ? static_cast<Tag>(top - boxed_tag_base) : Tag::FLOAT;
+    }
+    [[nodiscard]] IntType get_int() const noexcept { return static_cast<IntType>(static_cast<std::uint32_t>(bits)); }
+    [[nodiscard]] FloatType get_float() const noexcept {
+        FloatType value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    [[nodiscard]] StringType get_string() const noexcept { return unbox_pointer<StringType>(); }
+    [[nodiscard]] BoolType get_bool() const noexcept { return (bits & 1) != 0; }
+    [[nodiscard]] ReferenceType get_ref() const noexcept { return unbox_pointer<ReferenceType>(); }
+    [[nodiscard]] FunctionType get_function() const noexcept { return unbox_pointer<FunctionType>(); }
+    [[nodiscard]] ListType *get_list() const noexcept { return unbox_pointer<ListType *>(); }
+#else
+    [[nodiscard]] Tag get_tag() const noexcept { return tag; }
+    [[nodiscard]] IntType get_int() const noexcept { return w_int; }
+    [[nodiscard]] FloatType get_float() const noexcept { return w_float; }
+    [[nodiscard]] StringType get_string() const noexcept { return w_str; }
+    [[nodiscard]] BoolType get_bool() const noexcept { return w_bool; }
+    [[nodiscard]] ReferenceType get_ref() const noexcept { return w_ref; }
+    [[nodiscard]] FunctionType get_function() const noexcept { return w_fun; }
+    [[nodiscard]] ListType *get_list() const noexcept { return w_list; }
+#endif
+
     [[nodiscard]] std::string repr() const noexcept;
     [[nodiscard]] explicit operator bool() const noexcept;
     [[nodiscard]] bool operator==(const Value &other) const noexcept;
@@ -56,4 +118,104 @@ struct Value {
     [[nodiscard]] bool operator>(const Value &other) const noexcept;
 };
 
-#endif
\ No newline at end of file
+// The storage of a list, tuple or class instance. Lists of ints, floats and bools are created packed when their type
+// is known, keeping their elements unboxed, with no tag per element. Every other list holds Values. A packed list is
+// converted to holding Values the first time a reference to one of its elements is made, as a reference has to point
+// to a Value.
+//
+// Copies of a list share its elements, which are reference counted, until one of them is modified and has to be given
+// elements of its own. A list whose elements have had pointers made into them is pinned, and is never shared after
+// that, as a write through such a pointer would otherwise be seen by every copy.
+class List {
+  public:
+    enum class Kind : std::uint8_t { VALUE, INT, FLOAT, BOOL };
+
+  private:
+    // The elements are preceded by their reference count, padded so that the elements stay aligned
+    constexpr static std::size_t header_size = ListPool::granularity;
+
+    void *elements{};
+    std::size_t length{};
+    std::size_t capacity{};
+    ListPool *pool{};
+    Kind kind{};
+    bool pinned{};
+
+    [[nodiscard]] static std::size_t element_size(Kind kind) noexcept;
+    [[nodiscard]] std::size_t &refcount() const noexcept {
+        return *reinterpret_cast<std::size_t *>(static_cast<char *>(elements) - header_size);
+    }
+    void reallocate(std::size_t new_capacity);
+    void release(void *released, std::size_t released_capacity, Kind released_kind) noexcept;
+
+    template <typename T>
+    [[nodiscard]] T *data() const noexcept {
+        return static_cast<T *>(elements);
+    }
+
+  public:
+    List(ListPool *pool_, Kind kind_) noexcept : pool{pool_}, kind{kind_} {}
+    ~List();
+
+    List(const List &) = delete;
+    List &operator=(const List &) = delete;
+
+    [[nodiscard]] Kind get_kind() const noexcept { return kind; }
+    [[nodiscard]] bool is_packed() const noexcept { return kind != Kind::VALUE; }
+    [[nodiscard]] bool is_shared() const noexcept { return elements != nullptr && refcount() > 1; }
+    [[nodiscard]] bool is_pinned() const noexcept { return pinned; }
+    [[nodiscard]] std::size_t size() const noexcept { return length; }
+    [[nodiscard]] bool empty() const noexcept { return length == 0; }
+
+    // Direct access to the elements, only for lists which are not packed
+    [[nodiscard]] Value *begin() const noexcept { return data<Value>(); }
+    [[nodiscard]] Value *end() const noexcept { return data<Value>() + length; }
+    [[nodiscard]] Value &operator[](std::size_t index) const noexcept { return data<Value>()[index]; }
+    [[nodiscard]] Value &back() const noexcept { return data<Value>()[length - 1]; }
+
+    // Element access for lists of any kind. Values stored into a packed list have to be of its element type
+    [[nodiscard]] Value get(std::size_t index) const noexcept {
+        switch (kind) {
+            case Kind::VALUE: return data<Value>()[index];
+            case Kind::INT: return Value{data<Value::IntType>()[index]};
+            case Kind::FLOAT: return Value{data<Value::FloatType>()[index]};
+            case Kind::BOOL: return Value{data<std::uint8_t>()[index] != 0};
+        }
+        return Value{};
+    }
+    void set(std::size_t index, Value value) noexcept {
+        switch (kind) {
+            case Kind::VALUE: data<Value>()[index] = value; break;
+            case Kind::INT: data<Value::IntType>()[index] = value.get_int(); break;
+            case Kind::FLOAT: data<Value::FloatType>()[index] = value.get_float(); break;
+            case Kind::BOOL: data<std::uint8_t>()[index] = value.get_bool(); break;
+        }
+    }
+
+    void push_back(Value value) {
+        if (length == capacity) {
+            reallocate(capacity == 0 ? 4 : capacity * 2);
+        }
+        set(length++, value);
+    }
+    void pop_back() noexcept { length--; }
+    // New elements are zeroed when packed, and invalid Values otherwise
+    void resize(std::size_t new_length);
+    void reserve(std::size_t new_capacity);
+    // Sets every element to value, which is not retained
+    void fill(Value value) noexcept;
+    // Makes an empty list share the elements of other, which is of the same kind and not pinned
+    void share(const List &other) noexcept;
+    // Gives a shared list elements of its own. Strings and lists held by the elements are not copied or retained
+    void detach();
+    void pin() noexcept { pinned = true; }
+    // Converts a packed list into a list holding Values
+    void unpack();
+};
+
+#if NAN_BOXING
+static_assert(sizeof(void *) == 8, "NaN boxing stores pointers in the 48 bit payload of a 64 bit NaN");
+static_assert(sizeof(Value) == 8, "A NaN boxed Value has to fit in 8 bytes");
+#endif
+
+#endif
@@ -6,22 +6,27 @@
 #ifndef VIRTUAL_MACHINE_HPP
 #define VIRTUAL_MACHINE_HPP
 
+#include "GuardedStack.hpp"
 #include "Natives.hpp"
 #include "Value.hpp"
 #include "nyx/Backend/BackendContext.hpp"
 #include "nyx/Backend/RuntimeModule.hpp"
 #include "nyx/ColoredPrintHelper.hpp"
+#include "nyx/Common.hpp"
 
-#include <memory>
 #include <unordered_map>
+#include <vector>
 
 struct CallFrame {
     Value *stack{};
     Chunk *return_chunk{};
-    Chunk::InstructionSizeType *return_ip{};
+    const Chunk::DecodedInstruction *return_ip{};
     RuntimeModule *module{};
     std::size_t module_index{};
-    std::string name{};
+    const RuntimeFunction *function{}; // nullptr for the top level code of a module
+
+    // Only meant for tracing and error messages, as it may allocate
+    [[nodiscard]] std::string get_name() const;
 };
 
 struct ModuleFrame {
@@ -32,26 +37,42 @@ struct ModuleFrame {
 enum class ExecutionState { RUNNING = 0, FINISHED = 1 };
 
 class VirtualMachine {
-    constexpr static std::size_t stack_size = 32768;
-    constexpr static std::size_t frame_size = 1024;
-    constexpr static std::size_t module_size = 1024;
-
-    Chunk::InstructionSizeType *ip{};
-
-    std::unique_ptr<Value[]> stack{};
+  public:
+    constexpr static std::size_t default_max_stack_size = 1048576;
+    constexpr static std::size_t default_max_call_depth = 65536;
+    constexpr static std::size_t default_small_int_strings = 1024;
+    // Every one of them is allocated up front, and past this the table costs more than it could ever save
+    constexpr static std::size_t max_small_int_strings = 1048576;
+
+  private:
+    // The value and frame stacks are only reserved up front, so the limits only cost address space until they are used
+    std::size_t max_stack_size{default_max_stack_size};
+    std::size_t max_call_depth{default_max_call_depth};
+    std::size_t small_int_strings{default_small_int_strings};
+    bool print_list_pool_stats{};
+
+    const Chunk::DecodedInstruction *ip{};
+
+    GuardedStack<Value> stack{};
     std::size_t stack_top{};
 
-    std::unique_ptr<CallFrame[]> frames{};
+    GuardedStack<CallFrame> frames{};
     std::size_t frame_top{};
 
-    std::unique_ptr<ModuleFrame[]> modules{};
+    std::vector<ModuleFrame> modules{}; // Sized to the number of modules before execution begins
     std::size_t module_top{};
 
+    // Arguments of tail calls which are set aside while the locals of the calling function are destroyed. Destructors
+    // can make tail calls of their own, so this is used as a stack
+    std::vector<Value> stashed_arguments{};
+
     StringCacher cache{};
-    std::unordered_map<std::string_view, Native> natives{};
+    ListPool list_pool{}; // Holds every list, so any list still alive when the VM is destroyed is freed with it
+    std::vector<Native> natives{}; // Indexed by native id
 
     Chunk *current_chunk{};
     RuntimeModule *current_module{};
+    const Value *constants{}; // The values of the constant pool, which no longer changes once execution begins
 
     BackendContext *ctx{};
 
@@ -65,18 +86,32 @@ class VirtualMachine {
 
     // print_color_if_enabled
     ColoredPrintHelper pcife(ColoredPrintHelper::StreamColorModifier colorizer);
+    void trace_state();
+#endif
+
+#if THREADED_DISPATCH
+    // The addresses of the instruction handlers, which can only be taken inside execute() itself
+    [[nodiscard]] const void *const *get_handlers();
+    const void *const *handlers{};
 #endif
 
-    Chunk::InstructionSizeType read_next();
+    // Whether the value stack has room to run chunk with its stack top at `from`
+    [[nodiscard]] bool has_stack_space(std::size_t from, const Chunk &chunk) const noexcept;
+    void predecode(Chunk &chunk);
+    void predecode(RuntimeModule &module);
 
     void push(Value value) noexcept;
     void pop() noexcept;
 
     std::size_t get_current_line() const noexcept;
-    Value::ListType *make_new_list();
+    Value::ListType *make_new_list(List::Kind kind = List::Kind::VALUE);
     void destroy_list(Value::ListType *list);
     Value copy(Value &value);
     void copy_into(Value::ListType *list, Value::ListType *what);
+    // Element access shared by INDEX_LIST and GET_FIELD, and assignment shared by ASSIGN_LIST and SET_FIELD. Both
+    // return the value the instruction leaves on the stack
+    Value access_element(Value::ListType *list, std::size_t index);
+    Value assign_element(Value::ListType *list, std::size_t index, Value assigned);
 
     void initialize_modules();
     void teardown_modules();
@@ -86,7 +121,7 @@ class VirtualMachine {
   public:
     // TODO: add proper config for this
     VirtualMachine();
-    ~VirtualMachine() = default;
+    ~VirtualMachine();
 
     VirtualMachine(const VirtualMachine &) = delete;
     VirtualMachine &operator=(const VirtualMachine &) = delete;
@@ -96,9 +131,16 @@ class VirtualMachine {
 
     void run_function(RuntimeFunction &function);
     void run(RuntimeModule &module);
-    ExecutionState step();
+    // Runs until a HALT is hit, or until a RETURN brings the frame count down to return_frame
+    // Given a handler_table, stores the table of handler addresses in it instead of executing anything
+    ExecutionState execute(std::size_t return_frame = 0, const void *const **handler_table = nullptr);
     [[nodiscard]] const HashedString &store_string(std::string str);
+    [[nodiscard]] const HashedString &intern_string(std::string_view str);
+    [[nodiscard]] const HashedString &int_to_string(Value::IntType value);
     void remove_string(const HashedString *str);
+    // Gives a list elements of its own if it shares them with copies of it, which has to be done before modifying it
+    void unshare_list(Value::ListType *list);
+    [[nodiscard]] Value::ListType *store_list();
 };
 
 #endif
\ No newline at end of file
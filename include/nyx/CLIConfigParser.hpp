@@ -43,7 +43,8 @@ class ParseResult;
             OptionType::QuantityTag::SINGLE_VALUE, OptionType::ValueTypeTag::STRING_VALUE, SYNTAX_OPTION               \
     }
 
-#define CONSTANT_FOLDING "fold-constants"
+#define CONSTANT_FOLDING  "fold-constants"
+#define FUSE_INSTRUCTIONS "fuse-instructions"
 
 #define OPTIMIZATION_FLAG(name, description, default_)                                                                 \
     {                                                                                                                  \
@@ -53,8 +54,12 @@ class ParseResult;
 
 #define NO_COLORIZE_OUTPUT "no-colorize-output"
 
-#define DISASSEMBLE_CODE "disassemble-code"
-#define TRACE_EXEC       "trace-exec"
+#define DISASSEMBLE_CODE  "disassemble-code"
+#define TRACE_EXEC        "trace-exec"
+#define MAX_STACK_SIZE    "max-stack-size"
+#define MAX_CALL_DEPTH    "max-call-depth"
+#define SMALL_INT_STRINGS "small-int-strings"
+#define LIST_POOL_STATS   "list-pool-stats"
 
 class CLIConfig {
   public:
@@ -41,4 +41,18 @@
 #define NO_TRACE_VM 1
 #endif
 
+// Use computed gotos for instruction dispatch in the VirtualMachine, when the compiler supports them
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(NO_THREADED_DISPATCH)
+#define THREADED_DISPATCH 1
+#else
+#define THREADED_DISPATCH 0
+#endif
+
+// Pack every Value into 8 bytes by storing everything except floats inside the payload of a NaN
+#ifndef NAN_BOXING
+#define NAN_BOXING 0
+#else
+#define NAN_BOXING 1
+#endif
+
 #endif
\ No newline at end of file
@@ -152,6 +152,7 @@ class Parser {
     StmtNode break_statement();
     StmtNode continue_statement();
     StmtNode expression_statement();
+    StmtNode for_range_statement();
     StmtNode for_statement();
     StmtNode if_statement();
     StmtNode return_statement();
@@ -46,6 +46,7 @@ class Scanner {
         KeywordTypePair{"for", TokenType::FOR},
         KeywordTypePair{"if", TokenType::IF},
         KeywordTypePair{"import", TokenType::IMPORT},
+        KeywordTypePair{"in", TokenType::IN},
         KeywordTypePair{"int", TokenType::INT},
         KeywordTypePair{"move", TokenType::MOVE},
         KeywordTypePair{"null", TokenType::NULL_},
@@ -478,6 +478,20 @@ StmtVisitorType ASTPrinter::visit(ExpressionStmt &stmt) {
     current_depth--;
 }
 
+StmtVisitorType ASTPrinter::visit(ForRangeStmt &stmt) {
+    print_tabs(current_depth);
+    print_token(stmt.keyword) << '\n';
+    current_depth++;
+    print_tabs(current_depth);
+    print_token(stmt.name) << (stmt.inclusive ? " in (inclusive range):\n" : " in (range):\n");
+    print(stmt.begin.get());
+    print(stmt.end.get());
+    print_tabs(current_depth);
+    std::cout << "Body:\n";
+    print(stmt.body.get());
+    current_depth--;
+}
+
 StmtVisitorType ASTPrinter::visit(ForStmt &stmt) {
     print_tabs(current_depth);
     print_token(stmt.keyword) << '\n';
@@ -8,6 +8,8 @@
 // Basically, `Chunk` in `RuntimeModule` only forward declares `Value`, but does not include `Value` header file, so
 // trying to access the `std::vector<RuntimeModule>` in any manner fails because it is made up of an incomplete type
 
+#include <cassert>
+
 RuntimeModule *BackendContext::get_module_string(const std::string &module) noexcept {
     auto it = module_path_map.find(module);
     if (it != module_path_map.end()) {
@@ -34,6 +36,33 @@ std::size_t BackendContext::get_module_index_path(const std::filesystem::path &p
     return get_module_index_string(path.c_str());
 }
 
+std::size_t BackendContext::get_function_index(std::size_t module_index, const std::string &name) {
+    auto [it, inserted] = function_indices.try_emplace({module_index, name}, function_indices.size());
+    return it->second;
+}
+
+void BackendContext::link_functions() {
+    for (std::size_t i = 0; i < compiled_modules.size(); i++) {
+        for (auto &[name, function] : compiled_modules[i].functions) {
+            (void)get_function_index(i, name);
+        }
+    }
+    if (main != nullptr) {
+        for (auto &[name, function] : main->functions) {
+            (void)get_function_index(compiled_modules.size(), name);
+        }
+    }
+
+    functions.assign(function_indices.size(), nullptr);
+    for (auto &[key, index] : function_indices) {
+        RuntimeModule *module = key.first == compiled_modules.size() ? main : &compiled_modules[key.first];
+        assert(module != nullptr && "Function index refers to a module that does not exist");
+        auto function = module->functions.find(key.second);
+        assert(function != module->functions.end() && "Function index refers to a function that does not exist");
+        functions[index] = &function->second;
+    }
+}
+
 void BackendContext::set_config(const CLIConfig *config) {
     this->config = config;
 
@@ -2,15 +2,49 @@
 /* See LICENSE at project root for license details */
 #include "nyx/Backend/BackendManager.hpp"
 
+#include "nyx/Backend/CodeGenerators/PeepholeOptimizer.hpp"
 #include "nyx/Backend/VirtualMachine/Disassembler.hpp"
 #include "nyx/CLIConfigParser.hpp"
 #include "nyx/Common.hpp"
 
 #include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace {
+std::size_t parse_size(const CLIConfig *config, const char *option, std::size_t default_, bool allow_zero,
+    std::size_t maximum = std::numeric_limits<std::size_t>::max()) {
+    if (not config->contains(option)) {
+        return default_;
+    }
+
+    const auto &value = config->get<std::string>(option);
+    try {
+        std::size_t position{};
+        unsigned long long size = std::stoull(value, &position);
+        if (position == value.size() && (size > 0 || allow_zero) && size <= maximum && value[0] != '-') {
+            return static_cast<std::size_t>(size);
+        }
+    } catch (const std::logic_error &) {}
+
+    std::string expected = allow_zero ? "non-negative integer" : "positive integer";
+    if (maximum != std::numeric_limits<std::size_t>::max()) {
+        expected += " no greater than " + std::to_string(maximum);
+    }
+    throw std::invalid_argument{
+        "Error: incorrect argument '" + value + "' to option '" + option + "', expected a " + expected};
+}
+} // namespace
 
 BackendManager::BackendManager(BackendContext *ctx) : ctx{ctx} {
     generator.set_runtime_ctx(ctx);
     vm.set_runtime_ctx(ctx);
+    vm.max_stack_size = parse_size(ctx->config, MAX_STACK_SIZE, VirtualMachine::default_max_stack_size, false);
+    vm.max_call_depth = parse_size(ctx->config, MAX_CALL_DEPTH, VirtualMachine::default_max_call_depth, false);
+    vm.small_int_strings = parse_size(ctx->config, SMALL_INT_STRINGS, VirtualMachine::default_small_int_strings, true,
+        VirtualMachine::max_small_int_strings);
+    vm.print_list_pool_stats = ctx->config->contains(LIST_POOL_STATS);
 
 #if !NO_TRACE_VM
 #define HAS_OPT(value) std::find(opts.begin(), opts.end(), value) != opts.end()
@@ -36,18 +70,29 @@ void BackendManager::compile(FrontendContext *compile_ctx) {
 
     generator.set_compile_ctx(compile_ctx);
 
+    bool fuse_instructions = not compile_ctx->config->contains(FUSE_INSTRUCTIONS) ||
+                             compile_ctx->config->get<std::string>(FUSE_INSTRUCTIONS) == "on";
+
     for (auto &[module, depth] : compile_ctx->parsed_modules) {
         ctx->compiled_modules.emplace_back(generator.compile(module));
         ctx->compiled_modules.back().top_level_code.emit_instruction(Instruction::HALT, 0);
         ctx->compiled_modules.back().teardown_code.emit_instruction(Instruction::HALT, 0);
+        if (fuse_instructions) {
+            peephole_optimize_module(ctx->compiled_modules.back());
+        }
     }
 
     if (compile_ctx->main != nullptr) {
         main = generator.compile(*compile_ctx->main);
         main.top_level_code.emit_instruction(Instruction::HALT, 0);
         main.teardown_code.emit_instruction(Instruction::HALT, 0);
+        if (fuse_instructions) {
+            peephole_optimize_module(main);
+        }
         ctx->main = &main;
     }
+
+    ctx->link_functions();
 }
 
 void BackendManager::disassemble() {
@@ -2,17 +2,16 @@
 /* See LICENSE at project root for license details */
 #include "nyx/Backend/CodeGenerators/ByteCodeGenerator.hpp"
 
+#include "nyx/Backend/CodeGenerators/LivenessAnalysis.hpp"
+#include "nyx/Backend/CodeGenerators/RangeAnalysis.hpp"
 #include "nyx/Backend/VirtualMachine/Value.hpp"
 #include "nyx/Common.hpp"
 #include "nyx/ErrorLogger/ErrorLogger.hpp"
 
 #include <algorithm>
+#include <limits>
 
-ByteCodeGenerator::ByteCodeGenerator() {
-    for (auto &[name, wrapper] : native_wrappers.get_all_natives()) {
-        natives[name] = wrapper->get_native();
-    }
-}
+ByteCodeGenerator::ByteCodeGenerator() = default;
 
 void ByteCodeGenerator::set_compile_ctx(FrontendContext *compile_ctx_) {
     compile_ctx = compile_ctx_;
@@ -84,8 +83,7 @@ void ByteCodeGenerator::generate_list_destructor_loop(const ListType *list) {
     current_chunk->emit_instruction(Instruction::PUSH_NULL, ++line);
     current_chunk->emit_instruction(Instruction::ACCESS_LOCAL_LIST, line);
     emit_operand(0);
-    current_chunk->emit_string("size", ++line);
-    current_chunk->emit_instruction(Instruction::CALL_NATIVE, line);
+    emit_native_call("size", ++line);
     current_chunk->emit_instruction(Instruction::POP, line);
 
     std::size_t jump_begin = current_chunk->emit_instruction(Instruction::JUMP_FORWARD, line);
@@ -93,7 +91,7 @@ void ByteCodeGenerator::generate_list_destructor_loop(const ListType *list) {
 
     std::size_t loop_begin = current_chunk->emit_instruction(Instruction::ACCESS_LOCAL_LIST, ++line);
     emit_operand(0);
-    current_chunk->emit_instruction(Instruction::ACCESS_LOCAL, line);
+    current_chunk->emit_instruction(Instruction::ACCESS_LOCAL_SCALAR, line);
     emit_operand(1);
     current_chunk->emit_instruction(Instruction::MOVE_INDEX, line);
 
@@ -113,19 +111,19 @@ void ByteCodeGenerator::generate_list_destructor_loop(const ListType *list) {
     }
     std::size_t after = current_chunk->emit_instruction(Instruction::POP_LIST, line);
 
-    current_chunk->emit_instruction(Instruction::ACCESS_LOCAL, ++line);
+    current_chunk->emit_instruction(Instruction::ACCESS_LOCAL_SCALAR, ++line);
     emit_operand(1);
     current_chunk->emit_constant(Value{1}, line);
     current_chunk->emit_instruction(Instruction::IADD, line);
-    current_chunk->emit_instruction(Instruction::ASSIGN_LOCAL, line);
+    current_chunk->emit_instruction(Instruction::ASSIGN_LOCAL_SCALAR, line);
     emit_operand(1);
     current_chunk->emit_instruction(Instruction::POP, line);
 
-    std::size_t condition = current_chunk->emit_instruction(Instruction::ACCESS_LOCAL, ++line);
+    std::size_t condition = current_chunk->emit_instruction(Instruction::ACCESS_LOCAL_SCALAR, ++line);
     emit_operand(1);
-    current_chunk->emit_instruction(Instruction::ACCESS_LOCAL, line);
+    current_chunk->emit_instruction(Instruction::ACCESS_LOCAL_SCALAR, line);
     emit_operand(2);
-    current_chunk->emit_instruction(Instruction::LESSER, line);
+    current_chunk->emit_instruction(Instruction::ILESSER, line);
     std::size_t jump_back = current_chunk->emit_instruction(Instruction::POP_JUMP_BACK_IF_TRUE, line);
     emit_operand(0);
 
@@ -146,6 +144,7 @@ void ByteCodeGenerator::generate_aggregate_destructor(const BaseType *type) {
     std::string destructor_name = aggregate_destructor_prefix + stringify_short(type, false, true);
     destructor.name = destructor_name;
 
+    destructor.code.constants = &runtime_ctx->constants;
     Chunk *previous = std::exchange(current_chunk, &destructor.code);
     if (type->primitive == Type::LIST) {
         auto *list = dynamic_cast<const ListType *>(type);
@@ -199,9 +198,7 @@ void ByteCodeGenerator::emit_aggregate_destructor_call(const BaseType *type) {
            "Only lists or tuples allowed as aggregate types");
 
     std::size_t line = current_chunk->line_numbers.back().first;
-    current_chunk->emit_string(aggregate_destructor_prefix + stringify_short(type, false, true), line);
-    current_chunk->emit_instruction(Instruction::LOAD_FUNCTION_SAME_MODULE, line);
-    current_chunk->emit_instruction(Instruction::CALL_FUNCTION, line);
+    emit_function_call(current_module_index, aggregate_destructor_prefix + stringify_short(type, false, true), line);
 }
 
 void ByteCodeGenerator::begin_scope() {
@@ -222,7 +219,8 @@ void ByteCodeGenerator::end_scope() {
 
 void ByteCodeGenerator::destroy_locals(std::size_t until_scope) {
     for (auto begin = scopes.crbegin(); begin != scopes.crend() && begin->second >= until_scope; begin++) {
-        if (begin->first->primitive == Type::STRING) {
+        // A reference to a string does not own it, so it is popped like any other reference
+        if (begin->first->primitive == Type::STRING && not begin->first->is_ref) {
             current_chunk->emit_instruction(Instruction::POP_STRING, 0);
         } else if (is_nontrivial_type(begin->first->primitive) && not begin->first->is_ref) {
             // Emit the call to the destructor
@@ -231,23 +229,37 @@ void ByteCodeGenerator::destroy_locals(std::size_t until_scope) {
                 std::size_t line = class_->dtor->name.line;
                 std::size_t i = class_->members.size() - 1;
 
+                // An instance which has been moved out of is null, and has nothing left to destroy. Instances without
+                // members are never moved implicitly, and cannot be told apart from null
+                std::size_t skip_idx{};
+                if (not class_->members.empty()) {
+                    skip_idx = current_chunk->emit_instruction(Instruction::JUMP_IF_FALSE, line);
+                    emit_operand(0);
+                }
                 emit_destructor_call(class_, line);
                 for (auto member = class_->members.crbegin(); member != class_->members.crend(); member++) {
                     if (member->first->type->primitive == Type::CLASS) {
                         current_chunk->emit_instruction(Instruction::ACCESS_FROM_TOP, line);
                         emit_operand(1);
-                        current_chunk->emit_constant(Value{static_cast<Value::IntType>(i)}, line);
-                        current_chunk->emit_instruction(Instruction::INDEX_LIST, line);
+                        current_chunk->emit_instruction(Instruction::GET_FIELD, line);
+                        emit_operand(i);
                         emit_destructor_call(dynamic_cast<UserDefinedType *>(member->first->type.get())->class_, line);
                         current_chunk->emit_instruction(Instruction::POP, line);
                     }
                 }
+                if (not class_->members.empty()) {
+                    patch_jump(skip_idx, current_chunk->bytes.size() - skip_idx - 1);
+                }
             } else if (begin->first->primitive == Type::LIST || begin->first->primitive == Type::TUPLE) {
                 if (contains_destructible_type(begin->first)) {
                     if (not aggregate_destructor_already_exists(begin->first)) {
                         generate_aggregate_destructor(begin->first);
                     }
+                    // The same goes for lists and tuples, where an empty one has nothing to destroy either
+                    std::size_t skip_idx = current_chunk->emit_instruction(Instruction::JUMP_IF_FALSE, 0);
+                    emit_operand(0);
                     emit_aggregate_destructor_call(begin->first);
+                    patch_jump(skip_idx, current_chunk->bytes.size() - skip_idx - 1);
                 }
             }
             current_chunk->emit_instruction(Instruction::POP_LIST, 0);
@@ -257,6 +269,17 @@ void ByteCodeGenerator::destroy_locals(std::size_t until_scope) {
     }
 }
 
+bool ByteCodeGenerator::locals_need_destruction(std::size_t until_scope) const noexcept {
+    // Mirrors destroy_locals(), for which a plain POP is enough for everything but strings and owned aggregates
+    for (auto begin = scopes.crbegin(); begin != scopes.crend() && begin->second >= until_scope; begin++) {
+        if ((begin->first->primitive == Type::STRING || is_nontrivial_type(begin->first->primitive)) &&
+            not begin->first->is_ref) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void ByteCodeGenerator::add_to_scope(const BaseType *type) {
     scopes.emplace_back(type, current_scope_depth);
 }
@@ -275,9 +298,13 @@ RuntimeModule ByteCodeGenerator::compile(Module &module) {
     RuntimeModule compiled{};
     compiled.name = module.name;
     compiled.path = module.full_path;
+    compiled.top_level_code.constants = &runtime_ctx->constants;
+    compiled.teardown_code.constants = &runtime_ctx->constants;
     current_chunk = &compiled.top_level_code;
     current_module = &module;
     current_compiled = &compiled;
+    // Modules are compiled in the same order as they are stored in, with the main module compiled last
+    current_module_index = runtime_ctx->compiled_modules.size();
 
     current_chunk->emit_instruction(Instruction::PUSH_NULL, 0);
     for (auto &stmt : module.statements) {
@@ -313,19 +340,154 @@ void ByteCodeGenerator::emit_stack_slot(std::size_t value) {
     emit_operand(value + 1);
 }
 
-void ByteCodeGenerator::emit_destructor_call(ClassStmt *class_, std::size_t line) {
-    current_chunk->emit_string(mangle_function(*class_->dtor), line);
+bool ByteCodeGenerator::is_scalar_variable(const BaseType *type) const noexcept {
+    return not type->is_ref &&
+           (type->primitive == Type::INT || type->primitive == Type::FLOAT || type->primitive == Type::BOOL);
+}
 
+void ByteCodeGenerator::emit_variable_access(IdentifierType variable, const BaseType *type, std::size_t line) {
+    if (is_scalar_variable(type)) {
+        current_chunk->emit_instruction(
+            variable == IdentifierType::LOCAL ? Instruction::ACCESS_LOCAL_SCALAR : Instruction::ACCESS_GLOBAL_SCALAR,
+            line);
+    } else {
+        current_chunk->emit_instruction(
+            variable == IdentifierType::LOCAL ? Instruction::ACCESS_LOCAL : Instruction::ACCESS_GLOBAL, line);
+    }
+}
+
+void ByteCodeGenerator::emit_variable_assign(IdentifierType variable, const BaseType *type, std::size_t line) {
+    if (is_scalar_variable(type)) {
+        current_chunk->emit_instruction(
+            variable == IdentifierType::LOCAL ? Instruction::ASSIGN_LOCAL_SCALAR : Instruction::ASSIGN_GLOBAL_SCALAR,
+            line);
+    } else {
+        current_chunk->emit_instruction(
+            variable == IdentifierType::LOCAL ? Instruction::ASSIGN_LOCAL : Instruction::ASSIGN_GLOBAL, line);
+    }
+}
+
+void ByteCodeGenerator::emit_destructor_call(ClassStmt *class_, std::size_t line) {
     // A class can either be compiled in an imported module or within the main module
     // These checks have to be distinct because the main module is tracked separately from imported modules
     if (current_module->full_path == class_->module_path || compile_ctx->main->full_path == class_->module_path) {
-        current_chunk->emit_instruction(Instruction::LOAD_FUNCTION_SAME_MODULE, line);
+        emit_function_call(current_module_index, mangle_function(*class_->dtor), line);
     } else {
-        current_chunk->emit_instruction(Instruction::LOAD_FUNCTION_MODULE_INDEX, line);
         assert(runtime_ctx->get_module_path(class_->module_path) != nullptr);
-        emit_operand(runtime_ctx->get_module_index_path(class_->module_path));
+        emit_function_call(
+            runtime_ctx->get_module_index_path(class_->module_path), mangle_function(*class_->dtor), line);
+    }
+}
+
+void ByteCodeGenerator::emit_function_load(std::size_t module_index, const std::string &name, std::size_t line) {
+    current_chunk->emit_instruction(Instruction::LOAD_FUNCTION, line);
+    emit_operand(runtime_ctx->get_function_index(module_index, name));
+}
+
+void ByteCodeGenerator::emit_native_call(std::string_view name, std::size_t line) {
+    const NativeWrapper *native = native_wrappers.get_native(name);
+    assert(native != nullptr && "Call to a native function that does not exist");
+    current_chunk->emit_instruction(Instruction::CALL_NATIVE, line);
+    emit_operand(native->get_id());
+}
+
+void ByteCodeGenerator::emit_make_list(const ListType *type, std::size_t size, std::size_t line) {
+    // Lists of ints, floats and bools are packed, unless they hold references
+    Instruction instruction = Instruction::MAKE_LIST;
+    if (not type->contained->is_ref) {
+        switch (type->contained->primitive) {
+            case Type::INT: instruction = Instruction::MAKE_INT_LIST; break;
+            case Type::FLOAT: instruction = Instruction::MAKE_FLOAT_LIST; break;
+            case Type::BOOL: instruction = Instruction::MAKE_BOOL_LIST; break;
+            default: break;
+        }
+    }
+    current_chunk->emit_instruction(instruction, line);
+    emit_operand(size);
+}
+
+void ByteCodeGenerator::emit_function_call(std::size_t module_index, const std::string &name, std::size_t line) {
+    current_chunk->emit_instruction(Instruction::CALL_DIRECT, line);
+    emit_operand(runtime_ctx->get_function_index(module_index, name));
+}
+
+Instruction ByteCodeGenerator::switch_instruction(SwitchStmt &stmt) const {
+    Type condition = stmt.condition->synthesized_attrs.info->primitive;
+    if (stmt.cases.size() < switch_table_min_cases || (condition != Type::INT && condition != Type::STRING)) {
+        return Instruction::POP_JUMP_IF_EQUAL;
+    }
+
+    LiteralValue::IntType low = std::numeric_limits<LiteralValue::IntType>::max();
+    LiteralValue::IntType high = std::numeric_limits<LiteralValue::IntType>::min();
+    for (auto &case_ : stmt.cases) {
+        if (case_.first->type_tag() != NodeType::LiteralExpr) {
+            return Instruction::POP_JUMP_IF_EQUAL;
+        }
+        LiteralValue &value = dynamic_cast<LiteralExpr &>(*case_.first).value;
+        if (condition == Type::STRING) {
+            if (not value.is_string()) {
+                return Instruction::POP_JUMP_IF_EQUAL;
+            }
+        } else if (not value.is_int()) {
+            return Instruction::POP_JUMP_IF_EQUAL;
+        } else {
+            low = std::min(low, value.to_int());
+            high = std::max(high, value.to_int());
+        }
+    }
+
+    if (condition == Type::STRING) {
+        return Instruction::STRING_SWITCH;
+    }
+    // A table is used when at least half of its entries are cases, otherwise the cases are binary searched
+    return std::int64_t{high} - low < 2 * static_cast<std::int64_t>(stmt.cases.size()) ? Instruction::TABLE_SWITCH
+                                                                                          : Instruction::LOOKUP_SWITCH;
+}
+
+void ByteCodeGenerator::fill_switch_table(SwitchStmt &stmt, Instruction instruction, Chunk::SwitchTable &table,
+    const std::vector<std::size_t> &case_offsets, std::size_t default_offset) {
+    // When a value appears in more than one case, the first of them is jumped to, as with a chain of comparisons
+    table.default_offset = default_offset;
+    if (instruction == Instruction::TABLE_SWITCH) {
+        table.low = std::numeric_limits<std::int32_t>::max();
+        std::int32_t high = std::numeric_limits<std::int32_t>::min();
+        for (auto &case_ : stmt.cases) {
+            table.low = std::min(table.low, dynamic_cast<LiteralExpr &>(*case_.first).value.to_int());
+            high = std::max(high, dynamic_cast<LiteralExpr &>(*case_.first).value.to_int());
+        }
+        table.offsets.assign(static_cast<std::size_t>(std::int64_t{high} - table.low + 1), default_offset);
+        for (std::size_t i = stmt.cases.size(); i-- > 0;) {
+            std::int32_t value = dynamic_cast<LiteralExpr &>(*stmt.cases[i].first).value.to_int();
+            table.offsets[static_cast<std::size_t>(std::int64_t{value} - table.low)] = case_offsets[i];
+        }
+    } else if (instruction == Instruction::LOOKUP_SWITCH) {
+        std::vector<std::pair<std::int32_t, std::size_t>> entries{};
+        for (std::size_t i = 0; i < stmt.cases.size(); i++) {
+            entries.emplace_back(dynamic_cast<LiteralExpr &>(*stmt.cases[i].first).value.to_int(), case_offsets[i]);
+        }
+        std::stable_sort(entries.begin(), entries.end(),
+            [](const auto &first, const auto &second) { return first.first < second.first; });
+        for (auto &[key, offset] : entries) {
+            if (table.keys.empty() || table.keys.back() != key) {
+                table.keys.push_back(key);
+                table.offsets.push_back(offset);
+            }
+        }
+    } else {
+        std::vector<std::pair<std::pair<std::size_t, std::string>, std::size_t>> entries{};
+        for (std::size_t i = 0; i < stmt.cases.size(); i++) {
+            std::string &string = dynamic_cast<LiteralExpr &>(*stmt.cases[i].first).value.to_string();
+            entries.push_back({{hash_string(string), string}, case_offsets[i]});
+        }
+        std::stable_sort(entries.begin(), entries.end(),
+            [](const auto &first, const auto &second) { return first.first < second.first; });
+        for (auto &[key, offset] : entries) {
+            if (table.strings.empty() || table.strings.back() != key) {
+                table.strings.push_back(key);
+                table.offsets.push_back(offset);
+            }
+        }
     }
-    current_chunk->emit_instruction(Instruction::CALL_FUNCTION, line);
 }
 
 void ByteCodeGenerator::make_ref_to(ExprNode &value) {
@@ -402,6 +564,71 @@ std::size_t ByteCodeGenerator::compile_vartuple(IdentifierTuple::TupleType &tupl
     return count;
 }
 
+std::size_t ByteCodeGenerator::get_arity(FunctionStmt &stmt) {
+    std::size_t arity = 0;
+    for (FunctionStmt::ParameterType &param : stmt.params) {
+        if (param.first.index() == FunctionStmt::IDENT_TUPLE) {
+            arity += vartuple_size(std::get<IdentifierTuple>(param.first).tuple);
+        } else {
+            arity += 1;
+        }
+    }
+    return arity;
+}
+
+bool ByteCodeGenerator::contains_ref_type(const BaseType *type) const noexcept {
+    if (type->is_ref) {
+        return true;
+    } else if (type->primitive == Type::LIST) {
+        return contains_ref_type(dynamic_cast<const ListType *>(type)->contained.get());
+    } else if (type->primitive == Type::TUPLE) {
+        auto *tuple = dynamic_cast<const TupleType *>(type);
+        return std::any_of(tuple->types.begin(), tuple->types.end(),
+            [this](const TypeNode &type_) { return contains_ref_type(type_.get()); });
+    }
+    return false;
+}
+
+bool ByteCodeGenerator::is_tail_call(ReturnStmt &stmt) {
+    if (stmt.value == nullptr || stmt.value->type_tag() != NodeType::CallExpr || is_constructor(stmt.function) ||
+        is_destructor(stmt.function)) {
+        return false;
+    }
+
+    // The value returned by the called function is handed back as-is, so it can neither require a copy nor have to be
+    // dereferenced
+    if (auto &return_type = stmt.function->return_type;
+        not return_type->is_ref && (stmt.value->synthesized_attrs.info->is_ref ||
+                                       (is_nontrivial_type(return_type->primitive) &&
+                                           stmt.value->synthesized_attrs.is_lvalue))) {
+        return false;
+    }
+
+    auto *call = dynamic_cast<CallExpr *>(stmt.value.get());
+    if (call->is_native_call || is_ctor_call(call->function)) {
+        return false;
+    }
+
+    // TAIL_CALL destroys the locals of the current frame and moves the arguments over them, so a reference passed to
+    // the callee could point into the frame being torn down
+    FunctionStmt *called = call->function->synthesized_attrs.func;
+    if (called == nullptr || std::any_of(called->params.begin(), called->params.end(),
+                                 [this](const FunctionStmt::ParameterType &param) {
+                                     return contains_ref_type(param.second.get());
+                                 })) {
+        return false;
+    }
+
+    // Only calls which compile down to a LOAD_FUNCTION can be made through TAIL_CALL
+    if (call->function->type_tag() == NodeType::VariableExpr) {
+        return dynamic_cast<VariableExpr *>(call->function.get())->type == IdentifierType::FUNCTION;
+    } else if (call->function->type_tag() == NodeType::ScopeAccessExpr) {
+        auto *access = dynamic_cast<ScopeAccessExpr *>(call->function.get());
+        return access->scope->synthesized_attrs.scope_type == ExprSynthesizedAttrs::ScopeAccessType::MODULE;
+    }
+    return false;
+}
+
 bool ByteCodeGenerator::is_ctor_call(ExprNode &node) {
     if (node->synthesized_attrs.class_ != nullptr) {
         if (node->type_tag() == NodeType::ScopeAccessExpr) {
@@ -433,9 +660,9 @@ void ByteCodeGenerator::make_instance(ClassStmt *class_) {
     for (ClassStmt::MemberType &member : class_->members) {
         current_chunk->emit_instruction(Instruction::ACCESS_FROM_TOP, member.first->name.line);
         emit_operand(1);
-        current_chunk->emit_constant(Value{static_cast<Value::IntType>(i)}, member.first->name.line);
         compile(member.first);
-        current_chunk->emit_instruction(Instruction::ASSIGN_LIST, member.first->name.line);
+        current_chunk->emit_instruction(Instruction::SET_FIELD, member.first->name.line);
+        emit_operand(i);
         current_chunk->emit_instruction(Instruction::POP, member.first->name.line);
 
         i++;
@@ -484,6 +711,10 @@ BaseTypeVisitorType ByteCodeGenerator::compile(BaseType *type) {
 
 ExprVisitorType ByteCodeGenerator::visit(AssignExpr &expr) {
     auto compile_right = [&expr, this] {
+        if (last_uses.count(expr.value.get()) != 0) {
+            emit_last_use(expr.value.get());
+            return;
+        }
         compile(expr.value.get());
         if (expr.value->synthesized_attrs.info->is_ref && expr.value->synthesized_attrs.info->primitive != Type::LIST &&
             expr.value->synthesized_attrs.info->primitive != Type::TUPLE &&
@@ -512,15 +743,11 @@ ExprVisitorType ByteCodeGenerator::visit(AssignExpr &expr) {
                                                     : Instruction::ASSIGN_GLOBAL_LIST,
                     expr.synthesized_attrs.token.line);
             } else {
-                current_chunk->emit_instruction(
-                    expr.target_type == IdentifierType::LOCAL ? Instruction::ASSIGN_LOCAL : Instruction::ASSIGN_GLOBAL,
-                    expr.synthesized_attrs.token.line);
+                emit_variable_assign(expr.target_type, expr.synthesized_attrs.info, expr.synthesized_attrs.token.line);
             }
             break;
         default: {
-            current_chunk->emit_instruction(
-                expr.target_type == IdentifierType::LOCAL ? Instruction::ACCESS_LOCAL : Instruction::ACCESS_GLOBAL,
-                expr.synthesized_attrs.token.line);
+            emit_variable_access(expr.target_type, expr.synthesized_attrs.info, expr.synthesized_attrs.token.line);
             emit_stack_slot(expr.synthesized_attrs.stack_slot);
             if (expr.synthesized_attrs.info->is_ref) {
                 current_chunk->emit_instruction(Instruction::DEREF, expr.synthesized_attrs.token.line);
@@ -543,15 +770,18 @@ ExprVisitorType ByteCodeGenerator::visit(AssignExpr &expr) {
                         expr.synthesized_attrs.token.line);
                     break;
                 case TokenType::SLASH_EQUAL:
-                    current_chunk->emit_instruction(
-                        expr.synthesized_attrs.info->primitive == Type::FLOAT ? Instruction::FDIV : Instruction::IDIV,
-                        expr.synthesized_attrs.token.line);
+                    if (expr.synthesized_attrs.info->primitive == Type::FLOAT) {
+                        current_chunk->emit_instruction(Instruction::FDIV, expr.synthesized_attrs.token.line);
+                    } else {
+                        current_chunk->emit_instruction(is_nonzero_constant(expr.value.get())
+                                                            ? Instruction::IDIV_UNCHECKED
+                                                            : Instruction::IDIV,
+                            expr.synthesized_attrs.token.line);
+                    }
                     break;
                 default: break;
             }
-            current_chunk->emit_instruction(
-                expr.target_type == IdentifierType::LOCAL ? Instruction::ASSIGN_LOCAL : Instruction::ASSIGN_GLOBAL,
-                expr.synthesized_attrs.token.line);
+            emit_variable_assign(expr.target_type, expr.synthesized_attrs.info, expr.synthesized_attrs.token.line);
             break;
         }
     }
@@ -593,19 +823,51 @@ ExprVisitorType ByteCodeGenerator::visit(BinaryExpr &expr) {
         compile_right();
     }
 
+    // Divisors and shift amounts which are known to be valid do not need to be checked at runtime
+    bool nonzero_divisor = is_nonzero_constant(expr.right.get()) || unchecked_exprs.count(&expr) != 0;
+    bool nonnegative_shift = is_nonnegative_constant(expr.right.get());
+
+    // Both operands are dereferenced and converted to a common type above, so comparisons between numbers can use the
+    // typed instructions which do not need to look at the tags of their operands
+    auto emit_comparison = [&expr, requires_floating, this](
+                               Instruction generic, Instruction int_comparison, Instruction float_comparison) {
+        Type left = expr.left->synthesized_attrs.info->primitive;
+        Type right = expr.right->synthesized_attrs.info->primitive;
+        if (left == Type::INT && right == Type::INT) {
+            current_chunk->emit_instruction(int_comparison, expr.synthesized_attrs.token.line);
+        } else if (requires_floating && (left == Type::INT || left == Type::FLOAT) &&
+                   (right == Type::INT || right == Type::FLOAT)) {
+            current_chunk->emit_instruction(float_comparison, expr.synthesized_attrs.token.line);
+        } else {
+            current_chunk->emit_instruction(generic, expr.synthesized_attrs.token.line);
+        }
+    };
+
     switch (expr.synthesized_attrs.token.type) {
         case TokenType::LEFT_SHIFT:
             if (expr.left->synthesized_attrs.info->primitive == Type::LIST) {
+                // Appending to a packed list needs the value to already be of the list's element type
+                Type contained = dynamic_cast<ListType *>(expr.left->synthesized_attrs.info)->contained->primitive;
+                Type appended = expr.right->synthesized_attrs.info->primitive;
+                if (contained == Type::FLOAT && appended == Type::INT) {
+                    current_chunk->emit_instruction(Instruction::INT_TO_FLOAT, expr.synthesized_attrs.token.line);
+                } else if (contained == Type::INT && appended == Type::FLOAT) {
+                    current_chunk->emit_instruction(Instruction::FLOAT_TO_INT, expr.synthesized_attrs.token.line);
+                }
                 current_chunk->emit_instruction(Instruction::APPEND_LIST, expr.synthesized_attrs.token.line);
             } else {
-                current_chunk->emit_instruction(Instruction::SHIFT_LEFT, expr.synthesized_attrs.token.line);
+                current_chunk->emit_instruction(
+                    nonnegative_shift ? Instruction::SHIFT_LEFT_UNCHECKED : Instruction::SHIFT_LEFT,
+                    expr.synthesized_attrs.token.line);
             }
             break;
         case TokenType::RIGHT_SHIFT:
             if (expr.left->synthesized_attrs.info->primitive == Type::LIST) {
                 current_chunk->emit_instruction(Instruction::POP_FROM_LIST, expr.synthesized_attrs.token.line);
             } else {
-                current_chunk->emit_instruction(Instruction::SHIFT_RIGHT, expr.synthesized_attrs.token.line);
+                current_chunk->emit_instruction(
+                    nonnegative_shift ? Instruction::SHIFT_RIGHT_UNCHECKED : Instruction::SHIFT_RIGHT,
+                    expr.synthesized_attrs.token.line);
             }
             break;
         case TokenType::BIT_AND:
@@ -618,42 +880,38 @@ ExprVisitorType ByteCodeGenerator::visit(BinaryExpr &expr) {
             current_chunk->emit_instruction(Instruction::BIT_XOR, expr.synthesized_attrs.token.line);
             break;
         case TokenType::MODULO:
-            current_chunk->emit_instruction(
-                requires_floating ? Instruction::FMOD : Instruction::IMOD, expr.synthesized_attrs.token.line);
-            break;
-
-        case TokenType::EQUAL_EQUAL:
-            if (expr.left->synthesized_attrs.info->primitive == Type::LIST ||
-                expr.left->synthesized_attrs.info->primitive == Type::TUPLE ||
-                expr.left->synthesized_attrs.info->primitive == Type::STRING) {
-                current_chunk->emit_instruction(Instruction::EQUAL_SL, expr.synthesized_attrs.token.line);
+            if (requires_floating) {
+                current_chunk->emit_instruction(Instruction::FMOD, expr.synthesized_attrs.token.line);
             } else {
-                current_chunk->emit_instruction(Instruction::EQUAL, expr.synthesized_attrs.token.line);
+                current_chunk->emit_instruction(
+                    nonzero_divisor ? Instruction::IMOD_UNCHECKED : Instruction::IMOD, expr.synthesized_attrs.token.line);
             }
             break;
-        case TokenType::GREATER:
-            current_chunk->emit_instruction(Instruction::GREATER, expr.synthesized_attrs.token.line);
-            break;
-        case TokenType::LESS:
-            current_chunk->emit_instruction(Instruction::LESSER, expr.synthesized_attrs.token.line);
-            break;
 
+        case TokenType::EQUAL_EQUAL:
         case TokenType::NOT_EQUAL:
             if (expr.left->synthesized_attrs.info->primitive == Type::LIST ||
-                expr.left->synthesized_attrs.info->primitive == Type::TUPLE ||
-                expr.left->synthesized_attrs.info->primitive == Type::STRING) {
+                expr.left->synthesized_attrs.info->primitive == Type::TUPLE) {
                 current_chunk->emit_instruction(Instruction::EQUAL_SL, expr.synthesized_attrs.token.line);
+            } else if (expr.left->synthesized_attrs.info->primitive == Type::STRING) {
+                current_chunk->emit_instruction(Instruction::EQUAL_STRING, expr.synthesized_attrs.token.line);
             } else {
-                current_chunk->emit_instruction(Instruction::EQUAL, expr.synthesized_attrs.token.line);
+                emit_comparison(Instruction::EQUAL, Instruction::IEQUAL, Instruction::FEQUAL);
             }
-            current_chunk->emit_instruction(Instruction::NOT, expr.synthesized_attrs.token.line);
+            if (expr.synthesized_attrs.token.type == TokenType::NOT_EQUAL) {
+                current_chunk->emit_instruction(Instruction::NOT, expr.synthesized_attrs.token.line);
+            }
+            break;
+        case TokenType::GREATER:
+            emit_comparison(Instruction::GREATER, Instruction::IGREATER, Instruction::FGREATER);
             break;
+        case TokenType::LESS: emit_comparison(Instruction::LESSER, Instruction::ILESSER, Instruction::FLESSER); break;
         case TokenType::GREATER_EQUAL:
-            current_chunk->emit_instruction(Instruction::LESSER, expr.synthesized_attrs.token.line);
+            emit_comparison(Instruction::LESSER, Instruction::ILESSER, Instruction::FLESSER);
             current_chunk->emit_instruction(Instruction::NOT, expr.synthesized_attrs.token.line);
             break;
         case TokenType::LESS_EQUAL:
-            current_chunk->emit_instruction(Instruction::GREATER, expr.synthesized_attrs.token.line);
+            emit_comparison(Instruction::GREATER, Instruction::IGREATER, Instruction::FGREATER);
             current_chunk->emit_instruction(Instruction::NOT, expr.synthesized_attrs.token.line);
             break;
 
@@ -677,8 +935,12 @@ ExprVisitorType ByteCodeGenerator::visit(BinaryExpr &expr) {
                 requires_floating ? Instruction::FSUB : Instruction::ISUB, expr.synthesized_attrs.token.line);
             break;
         case TokenType::SLASH:
-            current_chunk->emit_instruction(
-                requires_floating ? Instruction::FDIV : Instruction::IDIV, expr.synthesized_attrs.token.line);
+            if (requires_floating) {
+                current_chunk->emit_instruction(Instruction::FDIV, expr.synthesized_attrs.token.line);
+            } else {
+                current_chunk->emit_instruction(
+                    nonzero_divisor ? Instruction::IDIV_UNCHECKED : Instruction::IDIV, expr.synthesized_attrs.token.line);
+            }
             break;
         case TokenType::STAR:
             current_chunk->emit_instruction(
@@ -687,8 +949,8 @@ ExprVisitorType ByteCodeGenerator::visit(BinaryExpr &expr) {
 
         case TokenType::DOT_DOT:
         case TokenType::DOT_DOT_EQUAL: {
-            current_chunk->emit_instruction(Instruction::MAKE_LIST, expr.synthesized_attrs.token.line);
-            emit_operand(0);
+            emit_make_list(
+                dynamic_cast<const ListType *>(expr.synthesized_attrs.info), 0, expr.synthesized_attrs.token.line);
             compile_left();
             compile_right();
             /* This is effectively an unrolled while loop of the kind:
@@ -722,7 +984,7 @@ ExprVisitorType ByteCodeGenerator::visit(BinaryExpr &expr) {
             emit_operand(2);
             current_chunk->emit_constant(Value{1}, expr.synthesized_attrs.token.line);
             current_chunk->emit_instruction(Instruction::IADD, expr.synthesized_attrs.token.line);
-            current_chunk->emit_instruction(Instruction::ASSIGN_FROM_TOP, expr.synthesized_attrs.token.line);
+            current_chunk->emit_instruction(Instruction::ASSIGN_FROM_TOP_SCALAR, expr.synthesized_attrs.token.line);
             emit_operand(3);
             current_chunk->emit_instruction(Instruction::POP, expr.synthesized_attrs.token.line);
 
@@ -733,9 +995,9 @@ ExprVisitorType ByteCodeGenerator::visit(BinaryExpr &expr) {
             current_chunk->emit_instruction(Instruction::ACCESS_FROM_TOP, expr.synthesized_attrs.token.line);
             emit_operand(2);
             if (expr.synthesized_attrs.token.type == TokenType::DOT_DOT) {
-                current_chunk->emit_instruction(Instruction::LESSER, expr.synthesized_attrs.token.line);
+                current_chunk->emit_instruction(Instruction::ILESSER, expr.synthesized_attrs.token.line);
             } else {
-                current_chunk->emit_instruction(Instruction::GREATER, expr.synthesized_attrs.token.line);
+                current_chunk->emit_instruction(Instruction::IGREATER, expr.synthesized_attrs.token.line);
                 current_chunk->emit_instruction(Instruction::NOT, expr.synthesized_attrs.token.line);
             }
 
@@ -760,19 +1022,16 @@ ExprVisitorType ByteCodeGenerator::visit(BinaryExpr &expr) {
     return {};
 }
 
-ExprVisitorType ByteCodeGenerator::visit(CallExpr &expr) {
-    if (is_ctor_call(expr.function)) {
-        ClassStmt *class_ = get_class(expr.function);
-        make_instance(class_);
-    } else {
-        // Emit a null value on the stack just before the parameters of the function which is being called. This will
-        // serve as the stack slot in which to save the return value of the function before destroying any arguments or
-        // locals.
-        current_chunk->emit_instruction(Instruction::PUSH_NULL, expr.synthesized_attrs.token.line);
-    }
+void ByteCodeGenerator::emit_call_arguments(CallExpr &expr) {
     std::size_t i = 0;
     for (auto &arg : expr.args) {
         auto &value = std::get<ExprNode>(arg);
+        if (last_uses.count(value.get()) != 0) {
+            // The argument is handed over to the called function, which destroys it
+            emit_last_use(value.get());
+            i++;
+            continue;
+        }
         if (not expr.is_native_call) {
             auto &param = expr.function->synthesized_attrs.func->params[i];
             if (param.first.index() == FunctionStmt::IDENT_TUPLE) {
@@ -802,10 +1061,27 @@ ExprVisitorType ByteCodeGenerator::visit(CallExpr &expr) {
         }
         i++;
     }
+}
+
+void ByteCodeGenerator::emit_last_use(Expr *expr) {
+    current_chunk->emit_instruction(Instruction::MOVE_LOCAL, expr->synthesized_attrs.token.line);
+    emit_stack_slot(expr->synthesized_attrs.stack_slot);
+}
+
+ExprVisitorType ByteCodeGenerator::visit(CallExpr &expr) {
+    if (is_ctor_call(expr.function)) {
+        ClassStmt *class_ = get_class(expr.function);
+        make_instance(class_);
+    } else {
+        // Emit a null value on the stack just before the parameters of the function which is being called. This will
+        // serve as the stack slot in which to save the return value of the function before destroying any arguments or
+        // locals.
+        current_chunk->emit_instruction(Instruction::PUSH_NULL, expr.synthesized_attrs.token.line);
+    }
+    emit_call_arguments(expr);
     if (expr.is_native_call) {
         auto *called = dynamic_cast<VariableExpr *>(expr.function.get());
-        current_chunk->emit_string(called->name.lexeme, called->name.line);
-        current_chunk->emit_instruction(Instruction::CALL_NATIVE, expr.synthesized_attrs.token.line);
+        emit_native_call(called->name.lexeme, expr.synthesized_attrs.token.line);
         auto begin = expr.args.crbegin();
         for (; begin != expr.args.crend(); begin++) {
             auto &arg = std::get<ExprNode>(*begin);
@@ -826,7 +1102,13 @@ ExprVisitorType ByteCodeGenerator::visit(CallExpr &expr) {
         }
     } else {
         compile(expr.function.get());
-        current_chunk->emit_instruction(Instruction::CALL_FUNCTION, expr.synthesized_attrs.token.line);
+        // Functions are resolved at compile time, so a load immediately followed by a call can be done in one go
+        if (static_cast<Instruction>(current_chunk->bytes.back() >> 24) == Instruction::LOAD_FUNCTION) {
+            current_chunk->bytes.back() &= 0x00ff'ffff;
+            current_chunk->bytes.back() |= static_cast<Chunk::InstructionSizeType>(Instruction::CALL_DIRECT) << 24;
+        } else {
+            current_chunk->emit_instruction(Instruction::CALL_FUNCTION, expr.synthesized_attrs.token.line);
+        }
     }
     return {};
 }
@@ -859,8 +1141,8 @@ ExprVisitorType ByteCodeGenerator::visit(GetExpr &expr) {
             emit_operand(1);
         }
 
-        current_chunk->emit_constant(Value{std::stoi(expr.name.lexeme)}, expr.name.line);
-        current_chunk->emit_instruction(Instruction::INDEX_LIST, expr.synthesized_attrs.token.line);
+        current_chunk->emit_instruction(Instruction::GET_FIELD, expr.synthesized_attrs.token.line);
+        emit_operand(std::stoi(expr.name.lexeme));
 
         if (not expr.object->synthesized_attrs.is_lvalue) {
             current_chunk->emit_instruction(Instruction::SWAP, expr.name.line);
@@ -876,9 +1158,8 @@ ExprVisitorType ByteCodeGenerator::visit(GetExpr &expr) {
             emit_operand(1);
         }
 
-        current_chunk->emit_constant(
-            Value{get_member_index(expr.object->synthesized_attrs.class_, expr.name.lexeme)}, expr.name.line);
-        current_chunk->emit_instruction(Instruction::INDEX_LIST, expr.synthesized_attrs.token.line);
+        current_chunk->emit_instruction(Instruction::GET_FIELD, expr.synthesized_attrs.token.line);
+        emit_operand(get_member_index(expr.object->synthesized_attrs.class_, expr.name.lexeme));
 
         if (not expr.object->synthesized_attrs.is_lvalue) {
             current_chunk->emit_instruction(Instruction::SWAP, expr.name.line);
@@ -910,11 +1191,16 @@ ExprVisitorType ByteCodeGenerator::visit(IndexExpr &expr) {
     if (expr.index->synthesized_attrs.info->is_ref) {
         current_chunk->emit_instruction(Instruction::DEREF, expr.index->synthesized_attrs.token.line);
     }
+    bool checked = unchecked_exprs.count(&expr) == 0;
     if (expr.object->synthesized_attrs.info->primitive == Type::LIST) {
-        current_chunk->emit_instruction(Instruction::CHECK_LIST_INDEX, expr.synthesized_attrs.token.line);
+        if (checked) {
+            current_chunk->emit_instruction(Instruction::CHECK_LIST_INDEX, expr.synthesized_attrs.token.line);
+        }
         current_chunk->emit_instruction(Instruction::INDEX_LIST, expr.synthesized_attrs.token.line);
     } else if (expr.object->synthesized_attrs.info->primitive == Type::STRING) {
-        current_chunk->emit_instruction(Instruction::CHECK_STRING_INDEX, expr.synthesized_attrs.token.line);
+        if (checked) {
+            current_chunk->emit_instruction(Instruction::CHECK_STRING_INDEX, expr.synthesized_attrs.token.line);
+        }
         current_chunk->emit_instruction(Instruction::INDEX_STRING, expr.synthesized_attrs.token.line);
     }
 
@@ -927,8 +1213,7 @@ ExprVisitorType ByteCodeGenerator::visit(IndexExpr &expr) {
 }
 
 ExprVisitorType ByteCodeGenerator::visit(ListExpr &expr) {
-    current_chunk->emit_instruction(Instruction::MAKE_LIST, expr.bracket.line);
-    emit_operand(expr.elements.size());
+    emit_make_list(expr.type.get(), expr.elements.size(), expr.bracket.line);
 
     std::size_t i = 0;
     for (ListExpr::ElementType &element : expr.elements) {
@@ -940,7 +1225,6 @@ ExprVisitorType ByteCodeGenerator::visit(ListExpr &expr) {
         if (not expr.type->contained->is_ref) {
             // References have to be conditionally compiled when not binding to a name
             compile(element_expr.get());
-            emit_conversion(std::get<NumericConversionType>(element), element_expr->synthesized_attrs.token.line);
         }
 
         if (not expr.type->contained->is_ref) {
@@ -948,6 +1232,7 @@ ExprVisitorType ByteCodeGenerator::visit(ListExpr &expr) {
             if (element_expr->synthesized_attrs.info->is_ref) {
                 current_chunk->emit_instruction(Instruction::DEREF, element_expr->synthesized_attrs.token.line);
             }
+            emit_conversion(std::get<NumericConversionType>(element), element_expr->synthesized_attrs.token.line);
         } else if (element_expr->synthesized_attrs.is_lvalue) {
             // Type is a reference type
             make_ref_to(element_expr);
@@ -973,7 +1258,9 @@ ExprVisitorType ByteCodeGenerator::visit(ListAssignExpr &expr) {
     if (expr.list.index->synthesized_attrs.info->is_ref) {
         current_chunk->emit_instruction(Instruction::DEREF, expr.list.index->synthesized_attrs.token.line);
     }
-    current_chunk->emit_instruction(Instruction::CHECK_LIST_INDEX, expr.synthesized_attrs.token.line);
+    if (unchecked_exprs.count(&expr.list) == 0) {
+        current_chunk->emit_instruction(Instruction::CHECK_LIST_INDEX, expr.synthesized_attrs.token.line);
+    }
 
     switch (expr.synthesized_attrs.token.type) {
         case TokenType::EQUAL: {
@@ -981,6 +1268,10 @@ ExprVisitorType ByteCodeGenerator::visit(ListAssignExpr &expr) {
             if (expr.value->synthesized_attrs.info->is_ref) {
                 current_chunk->emit_instruction(Instruction::DEREF, expr.value->synthesized_attrs.token.line);
             }
+            // Packed lists of floats cannot hold ints, so the conversion has to be done before storing the value
+            if (expr.conversion_type != NumericConversionType::NONE) {
+                emit_conversion(expr.conversion_type, expr.synthesized_attrs.token.line);
+            }
             if (expr.requires_copy) {
                 current_chunk->emit_instruction(Instruction::COPY_LIST, expr.synthesized_attrs.token.line);
             }
@@ -1022,9 +1313,14 @@ ExprVisitorType ByteCodeGenerator::visit(ListAssignExpr &expr) {
                         expr.synthesized_attrs.token.line);
                     break;
                 case TokenType::SLASH_EQUAL:
-                    current_chunk->emit_instruction(
-                        contained_type == Type::FLOAT ? Instruction::FDIV : Instruction::IDIV,
-                        expr.synthesized_attrs.token.line);
+                    if (contained_type == Type::FLOAT) {
+                        current_chunk->emit_instruction(Instruction::FDIV, expr.synthesized_attrs.token.line);
+                    } else {
+                        current_chunk->emit_instruction(is_nonzero_constant(expr.value.get())
+                                                            ? Instruction::IDIV_UNCHECKED
+                                                            : Instruction::IDIV,
+                            expr.synthesized_attrs.token.line);
+                    }
                     break;
                 default: break;
             }
@@ -1064,7 +1360,7 @@ ExprVisitorType ByteCodeGenerator::visit(ListRepeatExpr &expr) {
         emit_operand(1);
         current_chunk->emit_constant(Value{1}, line);
         current_chunk->emit_instruction(Instruction::IADD, line);
-        current_chunk->emit_instruction(Instruction::ASSIGN_FROM_TOP, line);
+        current_chunk->emit_instruction(Instruction::ASSIGN_FROM_TOP_SCALAR, line);
         emit_operand(2);
         current_chunk->emit_instruction(Instruction::POP, line);
 
@@ -1072,7 +1368,7 @@ ExprVisitorType ByteCodeGenerator::visit(ListRepeatExpr &expr) {
         emit_operand(1);
         current_chunk->emit_instruction(Instruction::ACCESS_FROM_TOP, line2);
         emit_operand(3);
-        current_chunk->emit_instruction(Instruction::LESSER, line);
+        current_chunk->emit_instruction(Instruction::ILESSER, line);
         std::size_t jump_back = current_chunk->emit_instruction(Instruction::POP_JUMP_BACK_IF_TRUE, line2);
         emit_operand(0);
 
@@ -1082,16 +1378,14 @@ ExprVisitorType ByteCodeGenerator::visit(ListRepeatExpr &expr) {
         patch_jump(jump_back, jump_back - loop_begin + 1);
         patch_jump(jump_begin, condition - jump_begin - 1);
     } else {
-        current_chunk->emit_instruction(Instruction::MAKE_LIST, expr.bracket.line);
-        emit_operand(0);
+        emit_make_list(expr.type.get(), 0, expr.bracket.line);
         current_chunk->emit_instruction(Instruction::PUSH_NULL, line);
         current_chunk->emit_instruction(Instruction::PUSH_NULL, line);
         current_chunk->emit_instruction(Instruction::ACCESS_FROM_TOP, line);
         emit_operand(3);
         compile(quantity.get());
         emit_conversion(std::get<NumericConversionType>(expr.quantity), line);
-        current_chunk->emit_string("%resize_list_trivial", line);
-        current_chunk->emit_instruction(Instruction::CALL_NATIVE, line);
+        emit_native_call("%resize_list_trivial", line);
         current_chunk->emit_instruction(Instruction::POP, line);
         current_chunk->emit_instruction(Instruction::POP, line);
         current_chunk->emit_instruction(Instruction::POP, line);
@@ -1104,8 +1398,7 @@ ExprVisitorType ByteCodeGenerator::visit(ListRepeatExpr &expr) {
             compile(element.get());
             emit_conversion(std::get<NumericConversionType>(expr.expr), line2);
         }
-        current_chunk->emit_string("fill_trivial", line2);
-        current_chunk->emit_instruction(Instruction::CALL_NATIVE, line2);
+        emit_native_call("fill_trivial", line2);
         current_chunk->emit_instruction(Instruction::POP, line);
         current_chunk->emit_instruction(Instruction::POP, line);
         current_chunk->emit_instruction(Instruction::POP, line);
@@ -1178,32 +1471,25 @@ ExprVisitorType ByteCodeGenerator::visit(ScopeAccessExpr &expr) {
         auto *module = dynamic_cast<ScopeNameExpr *>(access->scope.get());
         ClassStmt *class_ = access->synthesized_attrs.class_;
 
-        current_chunk->emit_string(mangle_member_access(class_, expr.name.lexeme), expr.synthesized_attrs.token.line);
-        current_chunk->emit_instruction(
-            Instruction::LOAD_FUNCTION_MODULE_INDEX, expr.scope->synthesized_attrs.token.line);
-
         assert(runtime_ctx->get_module_path(module->module_path) != nullptr);
 
-        emit_operand(runtime_ctx->get_module_index_path(module->module_path));
+        emit_function_load(runtime_ctx->get_module_index_path(module->module_path),
+            mangle_member_access(class_, expr.name.lexeme), expr.scope->synthesized_attrs.token.line);
     } else if (expr.scope->synthesized_attrs.scope_type == ExprSynthesizedAttrs::ScopeAccessType::MODULE) {
-        current_chunk->emit_string(expr.name.lexeme, expr.name.line);
-        current_chunk->emit_instruction(
-            Instruction::LOAD_FUNCTION_MODULE_INDEX, expr.scope->synthesized_attrs.token.line);
-
         assert(expr.scope->type_tag() == NodeType::ScopeNameExpr);
         auto *module = dynamic_cast<ScopeNameExpr *>(expr.scope.get());
 
         assert(runtime_ctx->get_module_path(module->module_path) != nullptr);
 
-        emit_operand(runtime_ctx->get_module_index_path(module->module_path));
+        emit_function_load(runtime_ctx->get_module_index_path(module->module_path), expr.name.lexeme,
+            expr.scope->synthesized_attrs.token.line);
     } else if (expr.scope->synthesized_attrs.scope_type == ExprSynthesizedAttrs::ScopeAccessType::CLASS) {
         assert(expr.scope->type_tag() == NodeType::ScopeNameExpr);
-        current_chunk->emit_string(mangle_scope_access(expr), expr.synthesized_attrs.token.line);
         if (expr.synthesized_attrs.class_->module_path == current_module->full_path) {
-            current_chunk->emit_instruction(Instruction::LOAD_FUNCTION_SAME_MODULE, expr.synthesized_attrs.token.line);
+            emit_function_load(current_module_index, mangle_scope_access(expr), expr.synthesized_attrs.token.line);
         } else {
-            current_chunk->emit_instruction(Instruction::LOAD_FUNCTION_MODULE_INDEX, expr.synthesized_attrs.token.line);
-            emit_operand(runtime_ctx->get_module_index_path(expr.synthesized_attrs.class_->module_path));
+            emit_function_load(runtime_ctx->get_module_index_path(expr.synthesized_attrs.class_->module_path),
+                mangle_scope_access(expr), expr.synthesized_attrs.token.line);
         }
     } else {
         unreachable();
@@ -1218,16 +1504,15 @@ ExprVisitorType ByteCodeGenerator::visit(ScopeNameExpr &expr) {
 ExprVisitorType ByteCodeGenerator::visit(SetExpr &expr) {
     if (expr.object->synthesized_attrs.info->primitive == Type::TUPLE && expr.name.type == TokenType::INT_VALUE) {
         compile(expr.object.get());
-        current_chunk->emit_constant(Value{std::stoi(expr.name.lexeme)}, expr.name.line);
         compile(expr.value.get());
-        current_chunk->emit_instruction(Instruction::ASSIGN_LIST, expr.name.line);
+        current_chunk->emit_instruction(Instruction::SET_FIELD, expr.name.line);
+        emit_operand(std::stoi(expr.name.lexeme));
     } else if (expr.object->synthesized_attrs.info->primitive == Type::CLASS &&
                expr.name.type == TokenType::IDENTIFIER) {
         compile(expr.object.get());
-        current_chunk->emit_constant(
-            Value{get_member_index(expr.object->synthesized_attrs.class_, expr.name.lexeme)}, expr.name.line);
         compile(expr.value.get());
-        current_chunk->emit_instruction(Instruction::ASSIGN_LIST, expr.synthesized_attrs.token.line);
+        current_chunk->emit_instruction(Instruction::SET_FIELD, expr.synthesized_attrs.token.line);
+        emit_operand(get_member_index(expr.object->synthesized_attrs.class_, expr.name.lexeme));
     }
     return {};
 }
@@ -1291,7 +1576,6 @@ ExprVisitorType ByteCodeGenerator::visit(TupleExpr &expr) {
 
         current_chunk->emit_instruction(Instruction::ACCESS_FROM_TOP, expr.synthesized_attrs.token.line);
         emit_operand(1);
-        current_chunk->emit_constant(Value{static_cast<Value::IntType>(i)}, elem_expr->synthesized_attrs.token.line);
 
         if (expr.type->types[i]->is_ref && elem_expr->synthesized_attrs.is_lvalue) {
             if (elem_expr->type_tag() == NodeType::VariableExpr) {
@@ -1327,7 +1611,8 @@ ExprVisitorType ByteCodeGenerator::visit(TupleExpr &expr) {
         if (std::get<NumericConversionType>(element) != NumericConversionType::NONE) {
             emit_conversion(std::get<NumericConversionType>(element), elem_expr->synthesized_attrs.token.line);
         }
-        current_chunk->emit_instruction(Instruction::ASSIGN_LIST, expr.synthesized_attrs.token.line);
+        current_chunk->emit_instruction(Instruction::SET_FIELD, expr.synthesized_attrs.token.line);
+        emit_operand(i);
         current_chunk->emit_instruction(Instruction::POP, expr.synthesized_attrs.token.line);
         i++;
     }
@@ -1350,10 +1635,12 @@ ExprVisitorType ByteCodeGenerator::visit(UnaryExpr &expr) {
             if (expr.right->type_tag() == NodeType::VariableExpr) {
                 auto *variable = dynamic_cast<VariableExpr *>(expr.right.get());
 
-                current_chunk->emit_instruction(
-                    variable->type == IdentifierType::LOCAL ? Instruction::ACCESS_LOCAL : Instruction::ACCESS_GLOBAL,
-                    variable->synthesized_attrs.token.line);
+                emit_variable_access(
+                    variable->type, variable->synthesized_attrs.info, variable->synthesized_attrs.token.line);
                 emit_stack_slot(variable->synthesized_attrs.stack_slot);
+                if (variable->synthesized_attrs.info->is_ref) {
+                    current_chunk->emit_instruction(Instruction::DEREF, expr.oper.line);
+                }
 
                 if (variable->synthesized_attrs.info->primitive == Type::FLOAT) {
                     current_chunk->emit_constant(Value{1.0}, expr.oper.line);
@@ -1364,9 +1651,7 @@ ExprVisitorType ByteCodeGenerator::visit(UnaryExpr &expr) {
                     current_chunk->emit_instruction(
                         expr.oper.type == TokenType::PLUS_PLUS ? Instruction::IADD : Instruction::ISUB, expr.oper.line);
                 }
-                current_chunk->emit_instruction(
-                    variable->type == IdentifierType::LOCAL ? Instruction::ASSIGN_LOCAL : Instruction::ASSIGN_GLOBAL,
-                    expr.oper.line);
+                emit_variable_assign(variable->type, variable->synthesized_attrs.info, expr.oper.line);
                 emit_stack_slot(variable->synthesized_attrs.stack_slot);
             }
             break;
@@ -1384,18 +1669,13 @@ ExprVisitorType ByteCodeGenerator::visit(VariableExpr &expr) {
         case IdentifierType::LOCAL:
         case IdentifierType::GLOBAL:
             if (expr.synthesized_attrs.stack_slot < Chunk::const_long_max) {
-                if (expr.type == IdentifierType::LOCAL) {
-                    if (is_nontrivial_type(expr.synthesized_attrs.info->primitive)) {
-                        current_chunk->emit_instruction(Instruction::ACCESS_LOCAL_LIST, expr.name.line);
-                    } else {
-                        current_chunk->emit_instruction(Instruction::ACCESS_LOCAL, expr.name.line);
-                    }
+                if (is_nontrivial_type(expr.synthesized_attrs.info->primitive)) {
+                    current_chunk->emit_instruction(expr.type == IdentifierType::LOCAL
+                                                        ? Instruction::ACCESS_LOCAL_LIST
+                                                        : Instruction::ACCESS_GLOBAL_LIST,
+                        expr.name.line);
                 } else {
-                    if (is_nontrivial_type(expr.synthesized_attrs.info->primitive)) {
-                        current_chunk->emit_instruction(Instruction::ACCESS_GLOBAL_LIST, expr.name.line);
-                    } else {
-                        current_chunk->emit_instruction(Instruction::ACCESS_GLOBAL, expr.name.line);
-                    }
+                    emit_variable_access(expr.type, expr.synthesized_attrs.info, expr.name.line);
                 }
                 emit_stack_slot(expr.synthesized_attrs.stack_slot);
             } else {
@@ -1403,8 +1683,7 @@ ExprVisitorType ByteCodeGenerator::visit(VariableExpr &expr) {
             }
             return {};
         case IdentifierType::FUNCTION:
-            current_chunk->emit_string(expr.name.lexeme, expr.name.line);
-            current_chunk->emit_instruction(Instruction::LOAD_FUNCTION_SAME_MODULE, expr.name.line);
+            emit_function_load(current_module_index, expr.name.lexeme, expr.name.line);
             return {};
         case IdentifierType::CLASS: break;
     }
@@ -1413,7 +1692,17 @@ ExprVisitorType ByteCodeGenerator::visit(VariableExpr &expr) {
 
 StmtVisitorType ByteCodeGenerator::visit(BlockStmt &stmt) {
     begin_scope();
+    Stmt *previous = nullptr;
     for (auto &statement : stmt.stmts) {
+        // For-loops are desugared into their initializer followed by a while-loop with an increment, which is where
+        // indices that stay within bounds can be found
+        if (previous != nullptr && previous->type_tag() == NodeType::VarStmt &&
+            statement->type_tag() == NodeType::WhileStmt &&
+            dynamic_cast<WhileStmt *>(statement.get())->increment != nullptr) {
+            find_unchecked_in_loop(
+                *dynamic_cast<VarStmt *>(previous), *dynamic_cast<WhileStmt *>(statement.get()), unchecked_exprs);
+        }
+        previous = statement.get();
         compile(statement.get());
         // Statements written after a return statement will never execute anyway, so it's better to not emit anything
         // after one
@@ -1456,6 +1745,86 @@ StmtVisitorType ByteCodeGenerator::visit(ExpressionStmt &stmt) {
     }
 }
 
+StmtVisitorType ByteCodeGenerator::visit(ForRangeStmt &stmt) {
+    /*
+     * Taking an example of
+     * for i in 0..5 {
+     *      i
+     * }
+     * This will compile to
+     *
+     * CONSTANT            -> 0 | value = 0
+     * CONSTANT            -> 1 | value = 5
+     * ACCESS_LOCAL_SCALAR | access local 1
+     * ACCESS_LOCAL_SCALAR | access local 2
+     * ILESSER
+     * POP_JUMP_IF_FALSE   | offset = +24 bytes, jump to = 48 ----+
+     * ACCESS_LOCAL_SCALAR | access local 1 <-----------------+   | ) - These two instructions are the body of the loop
+     * POP                                                    |   | )
+     * FOR_RANGE           | local 1 < local 2, jump to = 28 -+   |
+     * POP <------------------------------------------------------+
+     * POP
+     *
+     *   The end of the range is only evaluated once, and is kept in an unnamed local after the loop variable. The
+     *   loop variable is const, so FOR_RANGE can increment it, compare it and jump back in a single instruction.
+     */
+    begin_scope();
+    find_unchecked_in_loop(stmt, unchecked_exprs);
+
+    for (Expr *bound : {stmt.begin.get(), stmt.end.get()}) {
+        compile(bound);
+        if (bound->synthesized_attrs.info->is_ref) {
+            current_chunk->emit_instruction(Instruction::DEREF, stmt.keyword.line);
+        }
+        add_to_scope(stmt.type.get());
+    }
+
+    for (std::size_t slot : {stmt.stack_slot, stmt.stack_slot + 1}) {
+        emit_variable_access(IdentifierType::LOCAL, stmt.type.get(), stmt.keyword.line);
+        emit_stack_slot(slot);
+    }
+    if (stmt.inclusive) {
+        current_chunk->emit_instruction(Instruction::IGREATER, stmt.keyword.line);
+        current_chunk->emit_instruction(Instruction::NOT, stmt.keyword.line);
+    } else {
+        current_chunk->emit_instruction(Instruction::ILESSER, stmt.keyword.line);
+    }
+    std::size_t skip_idx = current_chunk->emit_instruction(Instruction::POP_JUMP_IF_FALSE, stmt.keyword.line);
+    emit_operand(0);
+
+    break_stmts.emplace();
+    continue_stmts.emplace();
+
+    std::size_t loop_back_idx = current_chunk->bytes.size();
+    compile(stmt.body.get());
+
+    std::size_t increment_idx = current_chunk->emit_instruction(
+        stmt.inclusive ? Instruction::FOR_RANGE_INCLUSIVE : Instruction::FOR_RANGE, stmt.keyword.line);
+    emit_stack_slot(stmt.stack_slot);
+    // The extra operand words are emitted as HALT, so that they have no opcode bits of their own
+    current_chunk->emit_instruction(Instruction::HALT, stmt.keyword.line);
+    emit_stack_slot(stmt.stack_slot + 1);
+    std::size_t jump_back_idx = current_chunk->emit_instruction(Instruction::HALT, stmt.keyword.line);
+
+    std::size_t loop_end_idx = current_chunk->bytes.size();
+
+    patch_jump(jump_back_idx, loop_end_idx - loop_back_idx);
+    patch_jump(skip_idx, loop_end_idx - skip_idx - 1);
+
+    for (std::size_t continue_idx : continue_stmts.top()) {
+        patch_jump(continue_idx, increment_idx - continue_idx - 1);
+    }
+
+    for (std::size_t break_idx : break_stmts.top()) {
+        patch_jump(break_idx, loop_end_idx - break_idx - 1);
+    }
+
+    continue_stmts.pop();
+    break_stmts.pop();
+
+    end_scope();
+}
+
 StmtVisitorType ByteCodeGenerator::visit(ForStmt &stmt) {
     compile_ctx->logger.warning(current_module, {"Ignoring for-stmt"}, stmt.keyword);
 }
@@ -1463,13 +1832,7 @@ StmtVisitorType ByteCodeGenerator::visit(ForStmt &stmt) {
 StmtVisitorType ByteCodeGenerator::visit(FunctionStmt &stmt) {
     begin_scope();
     RuntimeFunction function{};
-    for (FunctionStmt::ParameterType &param : stmt.params) {
-        if (param.first.index() == FunctionStmt::IDENT_TUPLE) {
-            function.arity += vartuple_size(std::get<IdentifierTuple>(param.first).tuple);
-        } else {
-            function.arity += 1;
-        }
-    }
+    function.arity = get_arity(stmt);
 
     function.name = mangle_function(stmt);
 
@@ -1481,7 +1844,9 @@ StmtVisitorType ByteCodeGenerator::visit(FunctionStmt &stmt) {
         }
     }
 
+    function.code.constants = &runtime_ctx->constants;
     current_chunk = &function.code;
+    find_last_uses(stmt, last_uses);
     compile(stmt.body.get());
 
     remove_topmost_scope();
@@ -1541,19 +1906,47 @@ StmtVisitorType ByteCodeGenerator::visit(IfStmt &stmt) {
 }
 
 StmtVisitorType ByteCodeGenerator::visit(ReturnStmt &stmt) {
-    if (stmt.value != nullptr) {
+    if (is_tail_call(stmt)) {
+        // The called function reuses the frame of the current one, with its arguments taking the place of the
+        // current function's parameters and locals
+        auto *call = dynamic_cast<CallExpr *>(stmt.value.get());
+        emit_call_arguments(*call);
+        if (locals_need_destruction(stmt.function->scope_depth + 1)) {
+            // Set the arguments aside so that the locals below them can be destroyed
+            std::size_t arity = get_arity(*call->function->synthesized_attrs.func);
+            current_chunk->emit_instruction(Instruction::STASH_ARGUMENTS, stmt.keyword.line);
+            emit_operand(arity);
+            destroy_locals(stmt.function->scope_depth + 1);
+            current_chunk->emit_instruction(Instruction::RESTORE_ARGUMENTS, stmt.keyword.line);
+            emit_operand(arity);
+        }
+        compile(call->function.get());
+        assert(static_cast<Instruction>(current_chunk->bytes.back() >> 24) == Instruction::LOAD_FUNCTION &&
+               "Tail calls have to be to functions known at compile time");
+        current_chunk->bytes.back() &= 0x00ff'ffff;
+        current_chunk->bytes.back() |= static_cast<Chunk::InstructionSizeType>(Instruction::TAIL_CALL) << 24;
+        return;
+    }
+
+    if (stmt.value != nullptr && last_uses.count(stmt.value.get()) != 0) {
+        emit_last_use(stmt.value.get());
+    } else if (stmt.value != nullptr) {
         compile(stmt.value.get());
         if (auto &return_type = stmt.function->return_type; is_nontrivial_type(return_type->primitive) &&
                                                             not return_type->is_ref &&
                                                             stmt.value->synthesized_attrs.is_lvalue) {
             current_chunk->emit_instruction(Instruction::COPY_LIST, stmt.keyword.line);
+        } else if (is_scalar_variable(return_type.get()) && stmt.value->synthesized_attrs.info->is_ref) {
+            // The result is stored into a scalar variable as is, so it cannot be left as a reference
+            current_chunk->emit_instruction(Instruction::DEREF, stmt.keyword.line);
         }
     } else {
         current_chunk->emit_instruction(Instruction::PUSH_NULL, stmt.keyword.line);
     }
 
     if (not is_constructor(stmt.function) && not is_destructor(stmt.function)) {
-        current_chunk->emit_instruction(Instruction::ASSIGN_LOCAL, stmt.keyword.line);
+        // The return slot only ever holds null before this, so there is nothing to release or follow
+        current_chunk->emit_instruction(Instruction::ASSIGN_LOCAL_SCALAR, stmt.keyword.line);
         emit_operand(0);
     }
     current_chunk->emit_instruction(Instruction::POP, stmt.keyword.line);
@@ -1578,51 +1971,86 @@ StmtVisitorType ByteCodeGenerator::visit(SwitchStmt &stmt) {
      *
      * CONSTANT          -> 0 | value = 1
      * CONSTANT          -> 1 | value = 1
-     * POP_JUMP_IF_EQUAL | offset = +16 bytes, jump to = 24 ---+ <- case 1:
+     * POP_JUMP_IF_EQUAL | offset = +20 bytes, jump to = 32 ---+ <- case 1:
      * CONSTANT          -> 2 | value = 2                      |
-     * POP_JUMP_IF_EQUAL | offset = +16 bytes, jump to = 32 ---+-+ <- case 2:
-     * JUMP_FORWARD      | offset = +24 bytes, jump to = 44 ---+-+-+ <- default:
+     * POP_JUMP_IF_EQUAL | offset = +20 bytes, jump to = 40 ---+-+ <- case 2:
+     * POP                                                     | | <- No case matched, so the condition is popped
+     * JUMP_FORWARD      | offset = +24 bytes, jump to = 52 ---+-+-+ <- default:
      * CONSTANT          -> 3 | value = 1 <--------------------+ | |
      * POP                                                       | |
      * CONSTANT          -> 4 | value = 5 <----------------------+ |
      * POP                                                         |
-     * JUMP_FORWARD      | offset = +12 bytes, jump to = 52 -------+-+ <- The break statement
+     * JUMP_FORWARD      | offset = +12 bytes, jump to = 60 -------+-+ <- The break statement
      * CONSTANT          -> 5 | value = 6 <------------------------+ |
-     * POP <---------------------------------------------------------+
-     * HALT
+     * POP                                                           |
+     * HALT <--------------------------------------------------------+
+     *
+     * When there is no default case, the JUMP_FORWARD goes to the end of the switch instead.
      *
+     * With at least switch_table_min_cases cases which are all int or string literals, the comparisons are replaced
+     * by a single TABLE_SWITCH, LOOKUP_SWITCH or STRING_SWITCH, which pops the condition and looks up the case to jump
+     * to in a table stored in the chunk. The cases are laid out the same way.
      */
     break_stmts.emplace();
     compile(stmt.condition.get());
     if (stmt.condition->synthesized_attrs.info->is_ref) {
         current_chunk->emit_instruction(Instruction::DEREF, stmt.condition->synthesized_attrs.token.line);
     }
+
+    Instruction dispatch = switch_instruction(stmt);
     std::vector<std::size_t> jumps{};
-    std::size_t default_jump{};
-    for (auto &case_ : stmt.cases) {
-        compile(case_.first.get());
-        jumps.push_back(
-            current_chunk->emit_instruction(Instruction::POP_JUMP_IF_EQUAL, current_chunk->line_numbers.back().first));
-        emit_operand(0);
-    }
-    if (stmt.default_case != nullptr) {
-        default_jump = current_chunk->emit_instruction(Instruction::JUMP_FORWARD, 0);
+    std::size_t dispatch_idx{};
+    if (dispatch == Instruction::POP_JUMP_IF_EQUAL) {
+        for (auto &case_ : stmt.cases) {
+            compile(case_.first.get());
+            jumps.push_back(current_chunk->emit_instruction(
+                Instruction::POP_JUMP_IF_EQUAL, current_chunk->line_numbers.back().first));
+            emit_operand(0);
+        }
+        // None of the cases matched, so the condition is still on the stack
+        Type condition = stmt.condition->synthesized_attrs.info->primitive;
+        if (condition == Type::STRING) {
+            current_chunk->emit_instruction(Instruction::POP_STRING, 0);
+        } else if (is_nontrivial_type(condition)) {
+            current_chunk->emit_instruction(Instruction::POP_LIST, 0);
+        } else {
+            current_chunk->emit_instruction(Instruction::POP, 0);
+        }
+        jumps.push_back(current_chunk->emit_instruction(Instruction::JUMP_FORWARD, 0));
         emit_operand(0);
+    } else {
+        dispatch_idx = current_chunk->emit_instruction(dispatch, current_chunk->line_numbers.back().first);
+        emit_operand(current_chunk->switch_tables.size());
+        current_chunk->switch_tables.emplace_back();
     }
 
-    std::size_t i = 0;
+    std::vector<std::size_t> case_starts{};
     for (auto &case_ : stmt.cases) {
-        std::size_t jump_to = current_chunk->bytes.size();
-        patch_jump(jumps[i], jump_to - jumps[i] - 1);
+        case_starts.push_back(current_chunk->bytes.size());
         compile(case_.second.get());
-        i++;
     }
+    // Without a default case, the jump taken when no case matches goes to the end of the switch
+    case_starts.push_back(current_chunk->bytes.size());
     if (stmt.default_case != nullptr) {
-        std::size_t jump_to = current_chunk->bytes.size();
-        patch_jump(default_jump, jump_to - default_jump - 1);
         compile(stmt.default_case.get());
     }
 
+    if (dispatch == Instruction::POP_JUMP_IF_EQUAL) {
+        for (std::size_t i = 0; i < jumps.size(); i++) {
+            patch_jump(jumps[i], case_starts[i] - jumps[i] - 1);
+        }
+    } else {
+        std::vector<std::size_t> case_offsets{};
+        for (std::size_t case_start : case_starts) {
+            case_offsets.push_back(case_start - dispatch_idx - 1);
+        }
+        std::size_t default_offset = case_offsets.back();
+        case_offsets.pop_back();
+        fill_switch_table(stmt, dispatch,
+            current_chunk->switch_tables[current_chunk->bytes[dispatch_idx] & 0x00ff'ffff], case_offsets,
+            default_offset);
+    }
+
     for (std::size_t break_stmt : break_stmts.top()) {
         std::size_t jump_to = current_chunk->bytes.size();
         patch_jump(break_stmt, jump_to - break_stmt - 1);
@@ -1634,7 +2062,10 @@ StmtVisitorType ByteCodeGenerator::visit(SwitchStmt &stmt) {
 StmtVisitorType ByteCodeGenerator::visit(TypeStmt &stmt) {}
 
 StmtVisitorType ByteCodeGenerator::visit(VarStmt &stmt) {
-    if (stmt.type->is_ref && not stmt.initializer->synthesized_attrs.info->is_ref) {
+    bool moved = last_uses.count(stmt.initializer.get()) != 0;
+    if (moved) {
+        emit_last_use(stmt.initializer.get());
+    } else if (stmt.type->is_ref && not stmt.initializer->synthesized_attrs.info->is_ref) {
         make_ref_to(stmt.initializer);
     } else {
         compile(stmt.initializer.get());
@@ -1649,7 +2080,7 @@ StmtVisitorType ByteCodeGenerator::visit(VarStmt &stmt) {
             emit_conversion(stmt.conversion_type, stmt.name.line);
         }
     }
-    if (stmt.requires_copy) {
+    if (stmt.requires_copy && not moved) {
         current_chunk->emit_instruction(Instruction::COPY_LIST, stmt.name.line);
     }
     if (not variable_tracking_suppressed) {
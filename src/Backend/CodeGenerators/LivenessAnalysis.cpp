@@ -0,0 +1,375 @@
+/* Copyright (C) 2020-2022  Dhruv Chawla */
+/* See LICENSE at project root for license details */
+#include "nyx/Backend/CodeGenerators/LivenessAnalysis.hpp"
+
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace {
+// The stack slots of the locals which may still be read
+using LiveSet = std::set<std::size_t>;
+
+LiveSet merge(LiveSet first, const LiveSet &second) {
+    first.insert(second.begin(), second.end());
+    return first;
+}
+
+// The local which an lvalue is a part of, if there is one
+VariableExpr *root_local(Expr *expr) noexcept {
+    while (true) {
+        switch (expr->type_tag()) {
+            case NodeType::GetExpr: expr = static_cast<GetExpr *>(expr)->object.get(); break;
+            case NodeType::GroupingExpr: expr = static_cast<GroupingExpr *>(expr)->expr.get(); break;
+            case NodeType::IndexExpr: expr = static_cast<IndexExpr *>(expr)->object.get(); break;
+            case NodeType::VariableExpr: {
+                auto *variable = static_cast<VariableExpr *>(expr);
+                return variable->type == IdentifierType::LOCAL ? variable : nullptr;
+            }
+            default: return nullptr;
+        }
+    }
+}
+
+// Whether the expression names a local which owns a list, tuple or instance, which MOVE_LOCAL can take out of it
+bool is_movable_local(Expr *expr) noexcept {
+    if (expr->type_tag() != NodeType::VariableExpr ||
+        static_cast<VariableExpr *>(expr)->type != IdentifierType::LOCAL) {
+        return false;
+    }
+    QualifiedTypeInfo info = expr->synthesized_attrs.info;
+    if (info->is_ref) {
+        return false;
+    } else if (info->primitive == Type::CLASS) {
+        // The destruction of a moved out local is skipped by checking it for null, which an instance without any
+        // members cannot be told apart from
+        auto *type = dynamic_cast<UserDefinedType *>(info);
+        return type != nullptr && type->class_ != nullptr && not type->class_->members.empty();
+    }
+    return info->primitive == Type::LIST || info->primitive == Type::TUPLE;
+}
+
+// Walks the body of a function backwards, tracking which locals may still be read after each point in it. A use which
+// would copy a local that is not read afterwards is a last use. Anything it does not understand makes it give up.
+class LastUseFinder {
+    // Turned off while a loop is walked to find what is live around it, and for code which is compiled more than once
+    bool marking{true};
+    // What is live after the innermost loop or switch, and at the start of the next iteration of the innermost loop
+    std::vector<LiveSet> break_live{};
+    std::vector<LiveSet> continue_live{};
+
+  public:
+    bool understood{true};
+    std::vector<const Expr *> found{};
+    // Locals which a reference has been taken to, and which can be read through it after what looks like a last use
+    LiveSet escaped{};
+
+    LiveSet analyze(Expr *expr, LiveSet live);
+    LiveSet analyze(Stmt *stmt, LiveSet live);
+    // The same as analyze(), for a value which is copied if it is not moved
+    LiveSet analyze_copied(Expr *expr, LiveSet live);
+    LiveSet analyze_unmarked(Expr *expr, LiveSet live);
+    void escape(Expr *expr);
+
+    // Walks a loop until what is live at its start stops growing, and then once more to mark the last uses in it.
+    // `pass` walks the loop once given what is live at its start, and returns what is live at its start because of it
+    template <typename Pass>
+    LiveSet analyze_loop(Pass pass);
+};
+
+LiveSet LastUseFinder::analyze_copied(Expr *expr, LiveSet live) {
+    if (marking && is_movable_local(expr) && live.count(expr->synthesized_attrs.stack_slot) == 0) {
+        found.push_back(expr);
+    }
+    return analyze(expr, std::move(live));
+}
+
+LiveSet LastUseFinder::analyze_unmarked(Expr *expr, LiveSet live) {
+    bool was_marking = std::exchange(marking, false);
+    live = analyze(expr, std::move(live));
+    marking = was_marking;
+    return live;
+}
+
+void LastUseFinder::escape(Expr *expr) {
+    if (VariableExpr *root = root_local(expr); root != nullptr) {
+        escaped.insert(root->synthesized_attrs.stack_slot);
+    }
+}
+
+template <typename Pass>
+LiveSet LastUseFinder::analyze_loop(Pass pass) {
+    bool was_marking = std::exchange(marking, false);
+    LiveSet start{};
+    while (understood) {
+        LiveSet next = pass(start);
+        if (next == start) {
+            break;
+        }
+        start = std::move(next);
+    }
+    marking = was_marking;
+    return pass(start);
+}
+
+LiveSet LastUseFinder::analyze(Expr *expr, LiveSet live) {
+    if (expr == nullptr || not understood) {
+        return live;
+    }
+
+    switch (expr->type_tag()) {
+        case NodeType::AssignExpr: {
+            auto *assign = static_cast<AssignExpr *>(expr);
+            if (assign->target_type == IdentifierType::LOCAL) {
+                // Assigning through a reference or with a compound operator reads the old value
+                if (assign->synthesized_attrs.token.type == TokenType::EQUAL &&
+                    not assign->synthesized_attrs.info->is_ref) {
+                    live.erase(assign->synthesized_attrs.stack_slot);
+                } else {
+                    live.insert(assign->synthesized_attrs.stack_slot);
+                }
+            }
+            if (assign->synthesized_attrs.token.type == TokenType::EQUAL && assign->requires_copy &&
+                assign->conversion_type == NumericConversionType::NONE) {
+                return analyze_copied(assign->value.get(), std::move(live));
+            }
+            return analyze(assign->value.get(), std::move(live));
+        }
+        case NodeType::BinaryExpr: {
+            auto *binary = static_cast<BinaryExpr *>(expr);
+            return analyze(binary->left.get(), analyze(binary->right.get(), std::move(live)));
+        }
+        case NodeType::CallExpr: {
+            auto *call = static_cast<CallExpr *>(expr);
+            FunctionStmt *func = call->function->synthesized_attrs.func;
+            if (not call->is_native_call && func == nullptr) {
+                understood = false;
+                return live;
+            }
+            // The function is only loaded after the arguments have been evaluated. The name of a native is never
+            // resolved to a variable, so it has to be skipped instead of being read as a local
+            if (not call->is_native_call) {
+                live = analyze(call->function.get(), std::move(live));
+            }
+            for (std::size_t i = call->args.size(); i-- > 0;) {
+                auto &[arg, conversion_type, requires_copy] = call->args[i];
+                if (call->is_native_call) {
+                    live = analyze(arg.get(), std::move(live));
+                    continue;
+                }
+                auto &param = func->params[i];
+                if (param.first.index() == FunctionStmt::IDENT_TUPLE || param.second->is_ref) {
+                    escape(arg.get());
+                    live = analyze(arg.get(), std::move(live));
+                } else if (requires_copy && conversion_type == NumericConversionType::NONE) {
+                    live = analyze_copied(arg.get(), std::move(live));
+                } else {
+                    live = analyze(arg.get(), std::move(live));
+                }
+            }
+            return live;
+        }
+        case NodeType::CommaExpr: {
+            auto &exprs = static_cast<CommaExpr *>(expr)->exprs;
+            for (auto comma_expr = exprs.rbegin(); comma_expr != exprs.rend(); comma_expr++) {
+                live = analyze(comma_expr->get(), std::move(live));
+            }
+            return live;
+        }
+        case NodeType::GetExpr: return analyze(static_cast<GetExpr *>(expr)->object.get(), std::move(live));
+        case NodeType::GroupingExpr: return analyze(static_cast<GroupingExpr *>(expr)->expr.get(), std::move(live));
+        case NodeType::IndexExpr: {
+            auto *index = static_cast<IndexExpr *>(expr);
+            return analyze(index->object.get(), analyze(index->index.get(), std::move(live)));
+        }
+        case NodeType::ListExpr: {
+            auto *list = static_cast<ListExpr *>(expr);
+            for (auto element = list->elements.rbegin(); element != list->elements.rend(); element++) {
+                if (list->type->contained->is_ref) {
+                    escape(std::get<ExprNode>(*element).get());
+                }
+                live = analyze(std::get<ExprNode>(*element).get(), std::move(live));
+            }
+            return live;
+        }
+        case NodeType::ListAssignExpr: {
+            auto *assign = static_cast<ListAssignExpr *>(expr);
+            live = analyze(assign->value.get(), std::move(live));
+            live = analyze(assign->list.object.get(), analyze(assign->list.index.get(), std::move(live)));
+            if (assign->synthesized_attrs.token.type != TokenType::EQUAL) {
+                // The list and the index are compiled a second time to read the old value
+                live = analyze_unmarked(assign->list.index.get(), std::move(live));
+                live = analyze_unmarked(assign->list.object.get(), std::move(live));
+            }
+            return live;
+        }
+        case NodeType::ListRepeatExpr: {
+            // The repeated expression is evaluated once for every element
+            auto *repeat = static_cast<ListRepeatExpr *>(expr);
+            live = analyze_unmarked(std::get<ExprNode>(repeat->quantity).get(), std::move(live));
+            return analyze_unmarked(std::get<ExprNode>(repeat->expr).get(), std::move(live));
+        }
+        case NodeType::LogicalExpr: {
+            auto *logical = static_cast<LogicalExpr *>(expr);
+            return analyze(logical->left.get(), merge(live, analyze(logical->right.get(), live)));
+        }
+        case NodeType::MoveExpr: return analyze(static_cast<MoveExpr *>(expr)->expr.get(), std::move(live));
+        case NodeType::SetExpr: {
+            auto *set = static_cast<SetExpr *>(expr);
+            if (set->synthesized_attrs.info->is_ref) {
+                escape(set->value.get());
+            }
+            return analyze(set->object.get(), analyze(set->value.get(), std::move(live)));
+        }
+        case NodeType::TernaryExpr: {
+            auto *ternary = static_cast<TernaryExpr *>(expr);
+            return analyze(ternary->left.get(),
+                merge(analyze(ternary->middle.get(), live), analyze(ternary->right.get(), live)));
+        }
+        case NodeType::TupleExpr: {
+            auto *tuple = static_cast<TupleExpr *>(expr);
+            for (std::size_t i = tuple->elements.size(); i-- > 0;) {
+                if (tuple->type->types[i]->is_ref) {
+                    escape(std::get<ExprNode>(tuple->elements[i]).get());
+                }
+                live = analyze(std::get<ExprNode>(tuple->elements[i]).get(), std::move(live));
+            }
+            return live;
+        }
+        case NodeType::UnaryExpr: return analyze(static_cast<UnaryExpr *>(expr)->right.get(), std::move(live));
+        case NodeType::VariableExpr: {
+            if (static_cast<VariableExpr *>(expr)->type == IdentifierType::LOCAL) {
+                live.insert(expr->synthesized_attrs.stack_slot);
+            }
+            return live;
+        }
+        case NodeType::LiteralExpr:
+        case NodeType::ScopeAccessExpr:
+        case NodeType::ScopeNameExpr:
+        case NodeType::SuperExpr:
+        case NodeType::ThisExpr: return live;
+        default: understood = false; return live;
+    }
+}
+
+LiveSet LastUseFinder::analyze(Stmt *stmt, LiveSet live) {
+    if (stmt == nullptr || not understood) {
+        return live;
+    }
+
+    switch (stmt->type_tag()) {
+        case NodeType::BlockStmt: {
+            auto &stmts = static_cast<BlockStmt *>(stmt)->stmts;
+            for (auto block_stmt = stmts.rbegin(); block_stmt != stmts.rend(); block_stmt++) {
+                live = analyze(block_stmt->get(), std::move(live));
+            }
+            return live;
+        }
+        case NodeType::BreakStmt:
+        case NodeType::ContinueStmt: {
+            std::vector<LiveSet> &targets = stmt->type_tag() == NodeType::BreakStmt ? break_live : continue_live;
+            if (targets.empty()) {
+                understood = false;
+                return live;
+            }
+            return targets.back();
+        }
+        case NodeType::ExpressionStmt: return analyze(static_cast<ExpressionStmt *>(stmt)->expr.get(), std::move(live));
+        case NodeType::ForRangeStmt: {
+            auto *loop = static_cast<ForRangeStmt *>(stmt);
+            // After the body, FOR_RANGE either jumps back to its start or leaves the loop
+            LiveSet start = analyze_loop([this, loop, &live](const LiveSet &body_start) {
+                LiveSet body_end = merge(body_start, live);
+                break_live.push_back(live);
+                continue_live.push_back(body_end);
+                LiveSet result = analyze(loop->body.get(), std::move(body_end));
+                continue_live.pop_back();
+                break_live.pop_back();
+                return result;
+            });
+            return analyze(loop->begin.get(), analyze(loop->end.get(), merge(start, live)));
+        }
+        case NodeType::IfStmt: {
+            auto *if_stmt = static_cast<IfStmt *>(stmt);
+            return analyze(if_stmt->condition.get(),
+                merge(analyze(if_stmt->thenBranch.get(), live), analyze(if_stmt->elseBranch.get(), live)));
+        }
+        case NodeType::ReturnStmt: {
+            auto *return_stmt = static_cast<ReturnStmt *>(stmt);
+            if (return_stmt->value == nullptr) {
+                return {};
+            }
+            BaseType *return_type = return_stmt->function->return_type.get();
+            if (return_type->is_ref) {
+                escape(return_stmt->value.get());
+            } else if (is_nontrivial_type(return_type) && return_stmt->value->synthesized_attrs.is_lvalue) {
+                return analyze_copied(return_stmt->value.get(), {});
+            }
+            return analyze(return_stmt->value.get(), {});
+        }
+        case NodeType::SwitchStmt: {
+            // Cases fall through into the next one, and the last case into the default case
+            auto *switch_stmt = static_cast<SwitchStmt *>(stmt);
+            break_live.push_back(live);
+            LiveSet next_case = analyze(switch_stmt->default_case.get(), live);
+            LiveSet any_case = next_case;
+            for (auto case_ = switch_stmt->cases.rbegin(); case_ != switch_stmt->cases.rend(); case_++) {
+                next_case = analyze(case_->second.get(), std::move(next_case));
+                any_case = merge(std::move(any_case), next_case);
+            }
+            break_live.pop_back();
+            for (auto case_ = switch_stmt->cases.rbegin(); case_ != switch_stmt->cases.rend(); case_++) {
+                any_case = analyze(case_->first.get(), std::move(any_case));
+            }
+            return analyze(switch_stmt->condition.get(), std::move(any_case));
+        }
+        case NodeType::VarStmt: {
+            auto *var = static_cast<VarStmt *>(stmt);
+            live.erase(var->stack_slot);
+            if (var->initializer == nullptr) {
+                return live;
+            } else if (var->type->is_ref) {
+                escape(var->initializer.get());
+            } else if (var->requires_copy && var->conversion_type == NumericConversionType::NONE) {
+                return analyze_copied(var->initializer.get(), std::move(live));
+            }
+            return analyze(var->initializer.get(), std::move(live));
+        }
+        case NodeType::VarTupleStmt: {
+            // The names can be references to the parts of the initializer
+            auto *var = static_cast<VarTupleStmt *>(stmt);
+            escape(var->initializer.get());
+            return analyze(var->initializer.get(), std::move(live));
+        }
+        case NodeType::WhileStmt: {
+            // The condition is compiled after the body, with the loop jumping to it first
+            auto *loop = static_cast<WhileStmt *>(stmt);
+            return analyze_loop([this, loop, &live](const LiveSet &condition_start) {
+                break_live.push_back(live);
+                continue_live.push_back(analyze(loop->increment.get(), condition_start));
+                LiveSet body_start = analyze(loop->body.get(), continue_live.back());
+                continue_live.pop_back();
+                break_live.pop_back();
+                return analyze(loop->condition.get(), merge(std::move(body_start), live));
+            });
+        }
+        case NodeType::TypeStmt:
+        case NodeType::SingleLineCommentStmt:
+        case NodeType::MultiLineCommentStmt: return live;
+        default: understood = false; return live;
+    }
+}
+} // namespace
+
+void find_last_uses(FunctionStmt &function, std::unordered_set<const Expr *> &last_uses) {
+    LastUseFinder finder{};
+    finder.analyze(function.body.get(), {});
+    if (not finder.understood) {
+        return;
+    }
+    for (const Expr *use : finder.found) {
+        if (finder.escaped.count(use->synthesized_attrs.stack_slot) == 0) {
+            last_uses.insert(use);
+        }
+    }
+}
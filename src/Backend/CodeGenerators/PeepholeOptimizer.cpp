@@ -0,0 +1,233 @@
+/* Copyright (C) 2020-2022  Dhruv Chawla */
+/* See LICENSE at project root for license details */
+#include "nyx/Backend/CodeGenerators/PeepholeOptimizer.hpp"
+
+#include "nyx/Backend/VirtualMachine/Value.hpp"
+#include "nyx/Common.hpp"
+
+#include <vector>
+
+namespace {
+enum class JumpType { NONE, FORWARD, BACKWARD };
+
+struct PeepholeInstruction {
+    Instruction instruction{};
+    Chunk::InstructionSizeType operand{};
+    std::vector<Chunk::InstructionSizeType> extra_operands{};
+
+    JumpType jump{JumpType::NONE};
+    std::size_t target{}; // Index of the instruction jumped to, in the original chunk
+    std::size_t line{};
+    // For switch instructions, the targets of every entry of the jump table followed by the default target
+    std::vector<std::size_t> switch_targets{};
+};
+
+bool is_switch(Instruction instruction) noexcept {
+    return instruction == Instruction::TABLE_SWITCH || instruction == Instruction::LOOKUP_SWITCH ||
+           instruction == Instruction::STRING_SWITCH;
+}
+
+JumpType jump_type(Instruction instruction) noexcept {
+    switch (instruction) {
+        case Instruction::JUMP_FORWARD:
+        case Instruction::JUMP_IF_TRUE:
+        case Instruction::JUMP_IF_FALSE:
+        case Instruction::POP_JUMP_IF_EQUAL:
+        case Instruction::POP_JUMP_IF_FALSE: return JumpType::FORWARD;
+        case Instruction::JUMP_BACKWARD:
+        case Instruction::POP_JUMP_BACK_IF_TRUE:
+        case Instruction::FOR_RANGE:
+        case Instruction::FOR_RANGE_INCLUSIVE:
+        case Instruction::LOCAL_LT_CONST_JUMP_BACK: return JumpType::BACKWARD;
+        default: return JumpType::NONE;
+    }
+}
+
+bool is_int_constant(const Chunk &chunk, const PeepholeInstruction &insn) noexcept {
+    const std::vector<Value> &constants = chunk.constants->values;
+    return insn.instruction == Instruction::PUSH_INT_IMM ||
+           (insn.instruction == Instruction::CONSTANT && constants[insn.operand].get_tag() == Value::Tag::INT);
+}
+
+Value::IntType int_constant_value(const Chunk &chunk, const PeepholeInstruction &insn) noexcept {
+    return insn.instruction == Instruction::PUSH_INT_IMM ? Chunk::decode_int_immediate(insn.operand)
+                                                         : chunk.constants->values[insn.operand].get_int();
+}
+
+bool is_int_constant(const Chunk &chunk, const PeepholeInstruction &insn, Value::IntType value) noexcept {
+    return is_int_constant(chunk, insn) && int_constant_value(chunk, insn) == value;
+}
+
+std::vector<PeepholeInstruction> decode(const Chunk &chunk, std::vector<bool> &is_jump_target) {
+    std::vector<std::size_t> lines{};
+    for (auto [line, count] : chunk.line_numbers) {
+        lines.insert(lines.end(), count, line);
+    }
+
+    std::vector<PeepholeInstruction> result{};
+    std::vector<std::size_t> word_to_insn(chunk.bytes.size() + 1);
+    for (std::size_t i = 0; i < chunk.bytes.size();) {
+        PeepholeInstruction insn{};
+        insn.instruction = static_cast<Instruction>(chunk.bytes[i] >> 24);
+        insn.operand = chunk.bytes[i] & 0x00ff'ffff;
+        insn.line = i < lines.size() ? lines[i] : (lines.empty() ? 0 : lines.back());
+        std::size_t length = instruction_length(insn.instruction);
+        for (std::size_t j = 1; j < length; j++) {
+            insn.extra_operands.push_back(chunk.bytes[i + j] & 0x00ff'ffff);
+        }
+
+        insn.jump = jump_type(insn.instruction);
+        std::size_t offset = insn.extra_operands.empty() ? insn.operand : insn.extra_operands.back();
+        if (insn.jump == JumpType::FORWARD) {
+            insn.target = i + length + offset;
+        } else if (insn.jump == JumpType::BACKWARD) {
+            insn.target = i + length - offset;
+        }
+        if (is_switch(insn.instruction)) {
+            const Chunk::SwitchTable &table = chunk.switch_tables[insn.operand];
+            for (Chunk::InstructionSizeType case_offset : table.offsets) {
+                insn.switch_targets.push_back(i + length + case_offset);
+            }
+            insn.switch_targets.push_back(i + length + table.default_offset);
+        }
+
+        word_to_insn[i] = result.size();
+        result.push_back(std::move(insn));
+        i += length;
+    }
+    word_to_insn[chunk.bytes.size()] = result.size();
+
+    is_jump_target.assign(result.size() + 1, false);
+    for (PeepholeInstruction &insn : result) {
+        if (insn.jump != JumpType::NONE) {
+            insn.target = word_to_insn[insn.target];
+            is_jump_target[insn.target] = true;
+        }
+        for (std::size_t &target : insn.switch_targets) {
+            target = word_to_insn[target];
+            is_jump_target[target] = true;
+        }
+    }
+
+    return result;
+}
+
+bool matches(const std::vector<PeepholeInstruction> &code, const std::vector<bool> &is_jump_target, std::size_t i,
+    std::initializer_list<Instruction> pattern) noexcept {
+    if (i + pattern.size() > code.size()) {
+        return false;
+    }
+    std::size_t j = i;
+    for (Instruction instruction : pattern) {
+        // A CONSTANT in the pattern also stands for PUSH_INT_IMM, since both of them can push an int
+        bool same_instruction =
+            code[j].instruction == instruction ||
+            (instruction == Instruction::CONSTANT && code[j].instruction == Instruction::PUSH_INT_IMM);
+        // Jumping into the middle of a sequence would skip part of the fused instruction
+        if (not same_instruction || (j != i && is_jump_target[j])) {
+            return false;
+        }
+        j++;
+    }
+    return true;
+}
+} // namespace
+
+void peephole_optimize_chunk(Chunk &chunk) {
+    std::vector<bool> is_jump_target{};
+    std::vector<PeepholeInstruction> code = decode(chunk, is_jump_target);
+
+    std::vector<PeepholeInstruction> optimized{};
+    std::vector<std::size_t> new_index(code.size() + 1);
+    for (std::size_t i = 0; i < code.size();) {
+        new_index[i] = optimized.size();
+        const PeepholeInstruction &current = code[i];
+
+        // i = i + 1 (or i += 1) as a statement
+        if (matches(code, is_jump_target, i,
+                {Instruction::ACCESS_LOCAL_SCALAR, Instruction::CONSTANT, Instruction::IADD,
+                    Instruction::ASSIGN_LOCAL_SCALAR, Instruction::POP}) &&
+            is_int_constant(chunk, code[i + 1], 1) && code[i].operand == code[i + 3].operand) {
+            optimized.push_back(PeepholeInstruction{Instruction::INC_LOCAL, current.operand, {}, JumpType::NONE, 0,
+                current.line});
+            i += 5;
+        }
+        // Loop condition of the form 'i < N'
+        else if (matches(code, is_jump_target, i,
+                     {Instruction::ACCESS_LOCAL_SCALAR, Instruction::CONSTANT, Instruction::ILESSER,
+                         Instruction::POP_JUMP_BACK_IF_TRUE}) &&
+                 is_int_constant(chunk, code[i + 1])) {
+            // The fused instruction always reads its constant from the pool, so an immediate is added to it
+            std::size_t constant = code[i + 1].instruction == Instruction::CONSTANT
+                                       ? code[i + 1].operand
+                                       : chunk.constants->add_constant(Value{int_constant_value(chunk, code[i + 1])});
+            optimized.push_back(PeepholeInstruction{Instruction::LOCAL_LT_CONST_JUMP_BACK, current.operand,
+                {static_cast<Chunk::InstructionSizeType>(constant), 0}, JumpType::BACKWARD, code[i + 3].target,
+                current.line});
+            i += 4;
+        }
+        // Runs of POPs, mostly from locals going out of scope
+        else if (matches(code, is_jump_target, i, {Instruction::POP, Instruction::POP})) {
+            std::size_t count = 1;
+            while (matches(code, is_jump_target, i + count - 1, {Instruction::POP, Instruction::POP}) &&
+                   count < Chunk::const_long_max) {
+                count++;
+            }
+            optimized.push_back(
+                PeepholeInstruction{Instruction::POP_N, static_cast<Chunk::InstructionSizeType>(count), {},
+                    JumpType::NONE, 0, current.line});
+            i += count;
+        } else {
+            optimized.push_back(current);
+            i += 1;
+        }
+    }
+    new_index[code.size()] = optimized.size();
+
+    // Jump targets are never in the middle of a fused sequence, so each of them maps to the start of an instruction
+    std::vector<std::size_t> position(optimized.size() + 1);
+    for (std::size_t i = 0; i < optimized.size(); i++) {
+        position[i + 1] = position[i] + instruction_length(optimized[i].instruction);
+    }
+
+    chunk.bytes.clear();
+    chunk.line_numbers.clear();
+    for (std::size_t i = 0; i < optimized.size(); i++) {
+        PeepholeInstruction &insn = optimized[i];
+        if (insn.jump != JumpType::NONE) {
+            std::size_t end = position[i + 1];
+            std::size_t target = position[new_index[insn.target]];
+            Chunk::InstructionSizeType offset =
+                insn.jump == JumpType::FORWARD ? (target - end) & 0x00ff'ffff : (end - target) & 0x00ff'ffff;
+            (insn.extra_operands.empty() ? insn.operand : insn.extra_operands.back()) = offset;
+        }
+        if (not insn.switch_targets.empty()) {
+            Chunk::SwitchTable &table = chunk.switch_tables[insn.operand];
+            std::size_t end = position[i + 1];
+            for (std::size_t j = 0; j < table.offsets.size(); j++) {
+                table.offsets[j] = position[new_index[insn.switch_targets[j]]] - end;
+            }
+            table.default_offset = position[new_index[insn.switch_targets.back()]] - end;
+        }
+
+        chunk.bytes.push_back((static_cast<Chunk::InstructionSizeType>(insn.instruction) << 24) | insn.operand);
+        for (Chunk::InstructionSizeType extra : insn.extra_operands) {
+            chunk.bytes.push_back(extra);
+        }
+
+        std::size_t entries = instruction_length(insn.instruction);
+        if (chunk.line_numbers.empty() || chunk.line_numbers.back().first != insn.line) {
+            chunk.line_numbers.emplace_back(insn.line, entries);
+        } else {
+            chunk.line_numbers.back().second += entries;
+        }
+    }
+}
+
+void peephole_optimize_module(RuntimeModule &module) {
+    peephole_optimize_chunk(module.top_level_code);
+    peephole_optimize_chunk(module.teardown_code);
+    for (auto &[name, function] : module.functions) {
+        peephole_optimize_chunk(function.code);
+    }
+}
@@ -0,0 +1,370 @@
+/* Copyright (C) 2020-2022  Dhruv Chawla */
+/* See LICENSE at project root for license details */
+#include "nyx/Backend/CodeGenerators/RangeAnalysis.hpp"
+
+#include <vector>
+
+namespace {
+struct Variable {
+    IdentifierType type{};
+    std::size_t slot{};
+
+    bool operator==(const Variable &other) const noexcept { return type == other.type && slot == other.slot; }
+};
+
+bool as_variable(Expr *expr, Variable &variable) noexcept {
+    if (expr->type_tag() != NodeType::VariableExpr) {
+        return false;
+    }
+    auto *var = static_cast<VariableExpr *>(expr);
+    if (var->type != IdentifierType::LOCAL && var->type != IdentifierType::GLOBAL) {
+        return false;
+    }
+    variable = Variable{var->type, var->synthesized_attrs.stack_slot};
+    return true;
+}
+
+bool is_variable(Expr *expr, const Variable &variable) noexcept {
+    Variable found{};
+    return as_variable(expr, found) && found == variable;
+}
+
+bool is_positive_int(Expr *expr) noexcept {
+    if (expr->type_tag() != NodeType::LiteralExpr) {
+        return false;
+    }
+    auto *literal = static_cast<LiteralExpr *>(expr);
+    return literal->value.is_int() && literal->value.to_int() > 0;
+}
+
+bool is_size_of(Expr *expr, const Variable &list) noexcept {
+    if (expr->type_tag() != NodeType::CallExpr) {
+        return false;
+    }
+    auto *call = static_cast<CallExpr *>(expr);
+    return call->is_native_call && call->args.size() == 1 &&
+           static_cast<VariableExpr *>(call->function.get())->name.lexeme == "size" &&
+           is_variable(std::get<ExprNode>(call->args[0]).get(), list);
+}
+
+// Whether the increment of the loop only ever increases the counter
+bool only_increments(Stmt *increment, const Variable &counter) noexcept {
+    if (increment == nullptr || increment->type_tag() != NodeType::ExpressionStmt) {
+        return false;
+    }
+    Expr *expr = static_cast<ExpressionStmt *>(increment)->expr.get();
+
+    if (expr->type_tag() == NodeType::UnaryExpr) {
+        auto *unary = static_cast<UnaryExpr *>(expr);
+        return unary->oper.type == TokenType::PLUS_PLUS && is_variable(unary->right.get(), counter);
+    } else if (expr->type_tag() != NodeType::AssignExpr) {
+        return false;
+    }
+
+    auto *assign = static_cast<AssignExpr *>(expr);
+    if (not(Variable{assign->target_type, assign->synthesized_attrs.stack_slot} == counter)) {
+        return false;
+    }
+
+    if (assign->synthesized_attrs.token.type == TokenType::PLUS_EQUAL) {
+        return is_positive_int(assign->value.get());
+    } else if (assign->synthesized_attrs.token.type == TokenType::EQUAL &&
+               assign->value->type_tag() == NodeType::BinaryExpr) {
+        auto *sum = static_cast<BinaryExpr *>(assign->value.get());
+        return sum->synthesized_attrs.token.type == TokenType::PLUS &&
+               ((is_variable(sum->left.get(), counter) && is_positive_int(sum->right.get())) ||
+                   (is_positive_int(sum->left.get()) && is_variable(sum->right.get(), counter)));
+    }
+    return false;
+}
+
+// Walks the body of a loop, making sure that nothing in it can change the counter or the size of the indexed list or
+// string, while collecting the expressions whose checks depend only on those two. Anything it does not understand is
+// assumed to change both.
+class LoopBodyChecker {
+    Variable counter{};
+    Variable indexed{};
+    // A list or string which is global or a reference can also be changed through other names and by other functions,
+    // so then nothing in the body may change the size of any list or string, or call a function which might
+    bool indexed_may_alias{};
+
+  public:
+    std::vector<const Expr *> found{};
+
+    LoopBodyChecker(Variable counter, Variable indexed, bool indexed_may_alias)
+        : counter{counter}, indexed{indexed}, indexed_may_alias{indexed_may_alias} {}
+
+    bool check(Expr *expr);
+    bool check(Stmt *stmt);
+    bool check_index(IndexExpr &expr);
+};
+
+bool LoopBodyChecker::check_index(IndexExpr &expr) {
+    if (is_variable(expr.object.get(), indexed) && is_variable(expr.index.get(), counter)) {
+        found.push_back(&expr);
+    }
+    return check(expr.object.get()) && check(expr.index.get());
+}
+
+bool LoopBodyChecker::check(Expr *expr) {
+    if (expr == nullptr) {
+        return true;
+    }
+
+    switch (expr->type_tag()) {
+        case NodeType::AssignExpr: {
+            auto *assign = static_cast<AssignExpr *>(expr);
+            Variable target{assign->target_type, assign->synthesized_attrs.stack_slot};
+            Type primitive = assign->synthesized_attrs.info->primitive;
+            if (target == counter || target == indexed || assign->synthesized_attrs.info->is_ref ||
+                (indexed_may_alias && (primitive == Type::LIST || primitive == Type::STRING))) {
+                return false;
+            }
+            return check(assign->value.get());
+        }
+        case NodeType::BinaryExpr: {
+            auto *binary = static_cast<BinaryExpr *>(expr);
+            TokenType oper = binary->synthesized_attrs.token.type;
+            if ((oper == TokenType::LEFT_SHIFT || oper == TokenType::RIGHT_SHIFT) &&
+                binary->left->synthesized_attrs.info->primitive == Type::LIST) {
+                // Appending to or popping from a list which can only be the list it names
+                Variable target{};
+                if (indexed_may_alias || binary->left->synthesized_attrs.info->is_ref ||
+                    not as_variable(binary->left.get(), target) || target == indexed) {
+                    return false;
+                }
+            } else if ((oper == TokenType::SLASH || oper == TokenType::MODULO) &&
+                       binary->synthesized_attrs.info->primitive == Type::INT && is_size_of(binary->right.get(), indexed)) {
+                // The loop only runs while size(xs) is greater than the counter, which is never negative
+                found.push_back(binary);
+            }
+            return check(binary->left.get()) && check(binary->right.get());
+        }
+        case NodeType::CallExpr: {
+            auto *call = static_cast<CallExpr *>(expr);
+            if (not call->is_native_call) {
+                FunctionStmt *func = call->function->synthesized_attrs.func;
+                if (indexed_may_alias || func == nullptr) {
+                    return false;
+                }
+                for (auto &param : func->params) {
+                    if (param.second->is_ref) {
+                        return false;
+                    }
+                }
+            }
+            for (auto &arg : call->args) {
+                if (not check(std::get<ExprNode>(arg).get())) {
+                    return false;
+                }
+            }
+            return check(call->function.get());
+        }
+        case NodeType::CommaExpr: {
+            for (auto &comma_expr : static_cast<CommaExpr *>(expr)->exprs) {
+                if (not check(comma_expr.get())) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case NodeType::GetExpr: return check(static_cast<GetExpr *>(expr)->object.get());
+        case NodeType::GroupingExpr: return check(static_cast<GroupingExpr *>(expr)->expr.get());
+        case NodeType::IndexExpr: return check_index(*static_cast<IndexExpr *>(expr));
+        case NodeType::ListExpr: {
+            for (auto &element : static_cast<ListExpr *>(expr)->elements) {
+                if (not check(std::get<ExprNode>(element).get())) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case NodeType::ListAssignExpr: {
+            auto *assign = static_cast<ListAssignExpr *>(expr);
+            if (assign->list.synthesized_attrs.info->is_ref) {
+                return false;
+            }
+            return check_index(assign->list) && check(assign->value.get());
+        }
+        case NodeType::ListRepeatExpr: {
+            auto *repeat = static_cast<ListRepeatExpr *>(expr);
+            return check(std::get<ExprNode>(repeat->expr).get()) && check(std::get<ExprNode>(repeat->quantity).get());
+        }
+        case NodeType::LogicalExpr: {
+            auto *logical = static_cast<LogicalExpr *>(expr);
+            return check(logical->left.get()) && check(logical->right.get());
+        }
+        case NodeType::MoveExpr: {
+            auto *move = static_cast<MoveExpr *>(expr);
+            if (indexed_may_alias || is_variable(move->expr.get(), indexed)) {
+                return false;
+            }
+            return check(move->expr.get());
+        }
+        case NodeType::SetExpr: {
+            auto *set = static_cast<SetExpr *>(expr);
+            if (set->synthesized_attrs.info->is_ref) {
+                return false;
+            }
+            return check(set->object.get()) && check(set->value.get());
+        }
+        case NodeType::TernaryExpr: {
+            auto *ternary = static_cast<TernaryExpr *>(expr);
+            return check(ternary->left.get()) && check(ternary->middle.get()) && check(ternary->right.get());
+        }
+        case NodeType::TupleExpr: {
+            for (auto &element : static_cast<TupleExpr *>(expr)->elements) {
+                if (not check(std::get<ExprNode>(element).get())) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case NodeType::UnaryExpr: {
+            auto *unary = static_cast<UnaryExpr *>(expr);
+            if (unary->oper.type == TokenType::PLUS_PLUS || unary->oper.type == TokenType::MINUS_MINUS) {
+                if (unary->right->synthesized_attrs.info->is_ref || is_variable(unary->right.get(), counter)) {
+                    return false;
+                }
+            }
+            return check(unary->right.get());
+        }
+        case NodeType::LiteralExpr:
+        case NodeType::ScopeAccessExpr:
+        case NodeType::ScopeNameExpr:
+        case NodeType::SuperExpr:
+        case NodeType::ThisExpr:
+        case NodeType::VariableExpr: return true;
+        default: return false;
+    }
+}
+
+bool LoopBodyChecker::check(Stmt *stmt) {
+    if (stmt == nullptr) {
+        return true;
+    }
+
+    switch (stmt->type_tag()) {
+        case NodeType::BlockStmt: {
+            for (auto &block_stmt : static_cast<BlockStmt *>(stmt)->stmts) {
+                if (not check(block_stmt.get())) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case NodeType::ExpressionStmt: return check(static_cast<ExpressionStmt *>(stmt)->expr.get());
+        case NodeType::IfStmt: {
+            auto *if_stmt = static_cast<IfStmt *>(stmt);
+            return check(if_stmt->condition.get()) && check(if_stmt->thenBranch.get()) &&
+                   check(if_stmt->elseBranch.get());
+        }
+        case NodeType::ReturnStmt: return check(static_cast<ReturnStmt *>(stmt)->value.get());
+        case NodeType::SwitchStmt: {
+            auto *switch_stmt = static_cast<SwitchStmt *>(stmt);
+            for (auto &[value, case_stmt] : switch_stmt->cases) {
+                if (not check(value.get()) || not check(case_stmt.get())) {
+                    return false;
+                }
+            }
+            return check(switch_stmt->condition.get()) && check(switch_stmt->default_case.get());
+        }
+        case NodeType::VarStmt: return check(static_cast<VarStmt *>(stmt)->initializer.get());
+        case NodeType::VarTupleStmt: return check(static_cast<VarTupleStmt *>(stmt)->initializer.get());
+        case NodeType::ForRangeStmt: {
+            auto *loop = static_cast<ForRangeStmt *>(stmt);
+            return check(loop->begin.get()) && check(loop->end.get()) && check(loop->body.get());
+        }
+        case NodeType::WhileStmt: {
+            auto *loop = static_cast<WhileStmt *>(stmt);
+            return check(loop->condition.get()) && check(loop->body.get()) && check(loop->increment.get());
+        }
+        case NodeType::BreakStmt:
+        case NodeType::ContinueStmt:
+        case NodeType::SingleLineCommentStmt:
+        case NodeType::MultiLineCommentStmt: return true;
+        default: return false;
+    }
+}
+
+// Finds the unchecked expressions in a loop body which only runs while the counter, which never decreases and starts
+// out non-negative, is less than `bound`
+void find_unchecked_in_body(Variable counter, Expr *bound, Stmt *body, std::unordered_set<const Expr *> &unchecked) {
+    if (bound->type_tag() != NodeType::CallExpr) {
+        return;
+    }
+    auto *size_call = static_cast<CallExpr *>(bound);
+    Variable indexed{};
+    if (not size_call->is_native_call || size_call->args.size() != 1 ||
+        not as_variable(std::get<ExprNode>(size_call->args[0]).get(), indexed) ||
+        not is_size_of(size_call, indexed)) {
+        return;
+    }
+    QualifiedTypeInfo indexed_type = std::get<ExprNode>(size_call->args[0])->synthesized_attrs.info;
+    if (indexed_type->primitive != Type::LIST && indexed_type->primitive != Type::STRING) {
+        return;
+    }
+
+    LoopBodyChecker checker{counter, indexed, indexed.type == IdentifierType::GLOBAL || indexed_type->is_ref};
+    if (checker.check(body)) {
+        unchecked.insert(checker.found.begin(), checker.found.end());
+    }
+}
+} // namespace
+
+void find_unchecked_in_loop(VarStmt &initializer, WhileStmt &loop, std::unordered_set<const Expr *> &unchecked) {
+    if (loop.condition->type_tag() != NodeType::BinaryExpr) {
+        return;
+    }
+    auto *condition = static_cast<BinaryExpr *>(loop.condition.get());
+    if (condition->synthesized_attrs.token.type != TokenType::LESS ||
+        condition->left->type_tag() != NodeType::VariableExpr ||
+        condition->right->type_tag() != NodeType::CallExpr) {
+        return;
+    }
+
+    auto *counter_expr = static_cast<VariableExpr *>(condition->left.get());
+    if (counter_expr->type != IdentifierType::LOCAL || counter_expr->name.lexeme != initializer.name.lexeme ||
+        counter_expr->synthesized_attrs.info->primitive != Type::INT || counter_expr->synthesized_attrs.info->is_ref) {
+        return;
+    }
+    // The counter starts out non-negative, and only ever increases
+    if (initializer.type->is_ref || initializer.initializer->type_tag() != NodeType::LiteralExpr ||
+        not static_cast<LiteralExpr *>(initializer.initializer.get())->value.is_int() ||
+        static_cast<LiteralExpr *>(initializer.initializer.get())->value.to_int() < 0) {
+        return;
+    }
+    Variable counter{IdentifierType::LOCAL, counter_expr->synthesized_attrs.stack_slot};
+    if (not only_increments(loop.increment.get(), counter)) {
+        return;
+    }
+
+    find_unchecked_in_body(counter, condition->right.get(), loop.body.get(), unchecked);
+}
+
+void find_unchecked_in_loop(ForRangeStmt &loop, std::unordered_set<const Expr *> &unchecked) {
+    if (loop.inclusive || loop.begin->type_tag() != NodeType::LiteralExpr ||
+        not static_cast<LiteralExpr *>(loop.begin.get())->value.is_int() ||
+        static_cast<LiteralExpr *>(loop.begin.get())->value.to_int() < 0) {
+        return;
+    }
+    // The counter is const, so the body cannot change it
+    Variable counter{IdentifierType::LOCAL, loop.stack_slot};
+    find_unchecked_in_body(counter, loop.end.get(), loop.body.get(), unchecked);
+}
+
+bool is_nonzero_constant(Expr *expr) noexcept {
+    if (expr->type_tag() != NodeType::LiteralExpr) {
+        return false;
+    }
+    auto *literal = static_cast<LiteralExpr *>(expr);
+    return literal->value.is_int() && literal->value.to_int() != 0;
+}
+
+bool is_nonnegative_constant(Expr *expr) noexcept {
+    if (expr->type_tag() != NodeType::LiteralExpr) {
+        return false;
+    }
+    auto *literal = static_cast<LiteralExpr *>(expr);
+    return literal->value.is_int() && literal->value.to_int() >= 0;
+}
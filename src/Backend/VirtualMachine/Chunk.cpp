@@ -6,64 +6,81 @@
 #include "nyx/Common.hpp"
 #include "nyx/ErrorLogger/ErrorLogger.hpp"
 
+#include <cstring>
 #include <iostream>
 #include <limits>
 #include <utility>
 
-std::size_t Chunk::add_constant(Value value) {
-    constants.emplace_back(value);
-    return constants.size() - 1;
+std::size_t ConstantPool::add_constant(Value value) {
+    if (value.get_tag() == Value::Tag::INT) {
+        auto [constant, inserted] = int_constants.try_emplace(value.get_int(), values.size());
+        if (not inserted) {
+            return constant->second;
+        }
+    } else if (value.get_tag() == Value::Tag::FLOAT) {
+        // Keyed on the bits rather than the value, so that 0.0 and -0.0 stay distinct
+        std::uint64_t bits{};
+        Value::FloatType float_value = value.get_float();
+        std::memcpy(&bits, &float_value, sizeof(bits));
+        auto [constant, inserted] = float_constants.try_emplace(bits, values.size());
+        if (not inserted) {
+            return constant->second;
+        }
+    }
+    values.emplace_back(value);
+    return values.size() - 1;
 }
 
-std::size_t Chunk::add_string(std::string value) {
-    strings.emplace_back(std::move(value));
-    constants.emplace_back(Value{&strings.back()});
-    return constants.size() - 1;
+std::size_t ConstantPool::add_string(std::string value) {
+    auto [constant, inserted] = string_constants.try_emplace(value, values.size());
+    if (not inserted) {
+        return constant->second;
+    }
+    // Constants are long lived and often compared against, so they are hashed right away unlike most strings
+    (void)strings.emplace_back(std::move(value)).get_hash();
+    values.emplace_back(Value{&strings.back()});
+    return values.size() - 1;
 }
 
+// The operand bytes are part of the instruction word they are emitted into, so they do not get line number entries of
+// their own
 std::size_t Chunk::emit_byte(Chunk::InstructionSizeType value) {
     bytes.back() |= value;
-    if (line_numbers.empty()) {
-        line_numbers.emplace_back(1, 1);
-    } else {
-        line_numbers.back().second += 1;
-    }
     return bytes.size() - 1;
 }
 
 std::size_t Chunk::emit_bytes(Chunk::InstructionSizeType value_1, Chunk::InstructionSizeType value_2) {
     bytes.back() |= value_1 << 8;
     bytes.back() |= value_2 << 16;
-    if (line_numbers.empty()) {
-        line_numbers.emplace_back(1, 2);
-    } else {
-        line_numbers.back().second += 2;
-    }
     return bytes.size() - 2;
 }
 
 std::size_t Chunk::emit_constant(Value value, std::size_t line_number) {
-    if (constants.size() < const_long_max) {
-        std::size_t constant = add_constant(value);
+    if (value.get_tag() == Value::Tag::INT && value.get_int() >= int_immediate_min &&
+        value.get_int() <= int_immediate_max) {
+        emit_instruction(Instruction::PUSH_INT_IMM, line_number);
+        return emit_byte(encode_int_immediate(value.get_int()));
+    } else if (constants->values.size() < const_long_max) {
+        std::size_t constant = constants->add_constant(value);
         emit_instruction(Instruction::CONSTANT, line_number);
         emit_bytes((constant >> 16) & 0xff, (constant >> 8) & 0xff);
         emit_byte(constant & 0xff);
         return bytes.size() - 4;
     } else {
-        std::cerr << "\n!-| Compile error: Too many constants in chunk\n";
+        std::cerr << "\n!-| Compile error: Too many constants in program\n";
         return 0;
     }
 }
 
 std::size_t Chunk::emit_string(std::string value, std::size_t line_number) {
-    if (constants.size() < const_long_max) {
-        std::size_t constant = add_string(std::move(value));
+    if (constants->values.size() < const_long_max) {
+        std::size_t constant = constants->add_string(std::move(value));
         emit_instruction(Instruction::CONSTANT_STRING, line_number);
         emit_bytes((constant >> 16) & 0xff, (constant >> 8) & 0xff);
         emit_byte(constant & 0xff);
         return bytes.size() - 4;
     } else {
-        std::cerr << "\n!-| Compile error: Too many constants in chunk\n";
+        std::cerr << "\n!-| Compile error: Too many constants in program\n";
         return 0;
     }
 }
@@ -2,6 +2,7 @@
 /* See LICENSE at project root for license details */
 #include "nyx/Backend/VirtualMachine/Disassembler.hpp"
 
+#include "nyx/Backend/VirtualMachine/Natives.hpp"
 #include "nyx/Backend/VirtualMachine/Value.hpp"
 #include "nyx/ColoredPrintHelper.hpp"
 #include "nyx/Common.hpp"
@@ -56,8 +57,9 @@ void disassemble_chunk(Chunk &chunk, std::string_view module_name, std::string_v
     print_tab(1, 4) << "-----------\n" << pcife(colors_enabled, termcolor::reset);
     std::size_t i = 0;
     while (i < chunk.bytes.size()) {
-        disassemble_instruction(chunk, static_cast<Instruction>(chunk.bytes[i] >> 24), i, colors_enabled);
-        i++;
+        Instruction insn = static_cast<Instruction>(chunk.bytes[i] >> 24);
+        disassemble_instruction(chunk, insn, i, colors_enabled);
+        i += instruction_length(insn);
     }
 }
 
@@ -81,13 +83,13 @@ std::ostream &print_preamble(
 }
 
 void instruction(Chunk &chunk, std::string_view name, std::size_t where, bool colors_enabled) {
-    print_preamble(chunk, name, where * 4, where + 1, colors_enabled);
+    print_preamble(chunk, name, where * 4, where, colors_enabled);
     std::size_t next_bytes = chunk.bytes[where] & 0x00ff'ffff;
 
     auto print_trailing_bytes = [&chunk, &where, &colors_enabled] {
         for (int i = 1; i < 4; i++) {
             std::size_t offset_bit = chunk.bytes[where] & (0xff << (8 * (3 - i)));
-            print_preamble(chunk, "", where * 4 + i, where + 1, colors_enabled)
+            print_preamble(chunk, "", where * 4 + i, where, colors_enabled)
                 << pcife(colors_enabled, termcolor::cyan) << "| " << pcife(colors_enabled, termcolor::blue) << std::hex
                 << std::setw(8) << offset_bit;
             print_tab(1, 2) << pcife(colors_enabled, termcolor::green) << std::resetiosflags(std::ios_base::hex)
@@ -103,10 +105,13 @@ void instruction(Chunk &chunk, std::string_view name, std::size_t where, bool co
     // instructions
     if (name == "CONSTANT" || name == "CONSTANT_STRING") {
         std::cout << "\t\t";
-        print_tab(1) << PYEL << "-> " << next_bytes << " | value = " << PBLU << chunk.constants[next_bytes].repr()
-                     << '\n'
+        print_tab(1) << PYEL << "-> " << next_bytes << " | value = " << PBLU
+                     << chunk.constants->values[next_bytes].repr() << '\n'
                      << PRES;
         print_trailing_bytes();
+    } else if (name == "PUSH_INT_IMM") {
+        std::cout << PYEL << "\t\t| value = " << PBLU << Chunk::decode_int_immediate(next_bytes) << PRES << '\n';
+        print_trailing_bytes();
     } else if (name == "JUMP_FORWARD" || name == "POP_JUMP_IF_FALSE" || name == "JUMP_IF_FALSE" ||
                name == "JUMP_IF_TRUE" || name == "POP_JUMP_IF_EQUAL") {
         std::cout << PYEL << "\t\t| offset = " << PBLU << "+" << (next_bytes + 1) * 4 << PYEL
@@ -116,10 +121,10 @@ void instruction(Chunk &chunk, std::string_view name, std::size_t where, bool co
         std::cout << PYEL << "\t\t| offset = " << PBLU << "-" << (next_bytes - 1) * 4 << PYEL
                   << " bytes, jump to = " << PBLU << 4 * (where + 1 - next_bytes) << PRES << '\n';
         print_trailing_bytes();
-    } else if (name == "ASSIGN_LOCAL") {
+    } else if (name == "ASSIGN_LOCAL" || name == "ASSIGN_LOCAL_SCALAR") {
         std::cout << PYEL << "\t\t| assign to local " << PBLU << next_bytes << PRES << '\n';
         print_trailing_bytes();
-    } else if (name == "ASSIGN_GLOBAL") {
+    } else if (name == "ASSIGN_GLOBAL" || name == "ASSIGN_GLOBAL_SCALAR") {
         std::cout << PYEL << "\t\t| assign to global " << PBLU << next_bytes << PRES << '\n';
         print_trailing_bytes();
     } else if (name == "MAKE_REF_TO_LOCAL") {
@@ -128,16 +133,16 @@ void instruction(Chunk &chunk, std::string_view name, std::size_t where, bool co
     } else if (name == "MAKE_REF_TO_GLOBAL") {
         std::cout << PYEL << "\t\t| make ref to global " << PBLU << next_bytes << PRES << '\n';
         print_trailing_bytes();
-    } else if (name == "ACCESS_LOCAL" || name == "ACCESS_LOCAL_LIST") {
+    } else if (name == "ACCESS_LOCAL" || name == "ACCESS_LOCAL_LIST" || name == "ACCESS_LOCAL_SCALAR") {
         std::cout << PYEL << "\t\t| access local " << PBLU << next_bytes << PRES << '\n';
         print_trailing_bytes();
-    } else if (name == "ACCESS_GLOBAL" || name == "ACCESS_GLOBAL_LIST") {
+    } else if (name == "ACCESS_GLOBAL" || name == "ACCESS_GLOBAL_LIST" || name == "ACCESS_GLOBAL_SCALAR") {
         std::cout << PYEL << "\t\t| access global " << PBLU << next_bytes << PRES << '\n';
         print_trailing_bytes();
     } else if (name == "ACCESS_FROM_TOP") {
         std::cout << PYEL << "\t\t| access " << PBLU << next_bytes << PYEL << " from top\n" << PRES;
         print_trailing_bytes();
-    } else if (name == "ASSIGN_FROM_TOP") {
+    } else if (name == "ASSIGN_FROM_TOP" || name == "ASSIGN_FROM_TOP_SCALAR") {
         std::cout << PYEL << "\t\t| assign " << PBLU << next_bytes << PYEL << " from top\n" << PRES;
         print_trailing_bytes();
     } else if (name == "RETURN") {
@@ -148,11 +153,48 @@ void instruction(Chunk &chunk, std::string_view name, std::size_t where, bool co
                   << " from top\n"
                   << PRES;
         print_trailing_bytes();
-    } else if (name == "MAKE_LIST") {
+    } else if (name == "MAKE_LIST" || name == "MAKE_INT_LIST" || name == "MAKE_FLOAT_LIST" ||
+               name == "MAKE_BOOL_LIST") {
         std::cout << PYEL << "\t\t| size " << PBLU << next_bytes << "\n";
         print_trailing_bytes();
-    } else if (name == "LOAD_FUNCTION_MODULE_INDEX") {
-        std::cout << PYEL << "\t\t| module index " << PBLU << next_bytes << "\n";
+    } else if (name == "GET_FIELD" || name == "SET_FIELD") {
+        std::cout << PYEL << "\t\t| field " << PBLU << next_bytes << "\n";
+        print_trailing_bytes();
+    } else if (name == "INC_LOCAL") {
+        std::cout << PYEL << "\t\t| increment local " << PBLU << next_bytes << PRES << '\n';
+        print_trailing_bytes();
+    } else if (name == "POP_N") {
+        std::cout << PYEL << "\t\t| pop " << PBLU << next_bytes << PYEL << " value(s)\n" << PRES;
+        print_trailing_bytes();
+    } else if (name == "LOCAL_LT_CONST_JUMP_BACK") {
+        std::size_t constant = chunk.bytes[where + 1] & 0x00ff'ffff;
+        std::size_t offset = chunk.bytes[where + 2] & 0x00ff'ffff;
+        std::cout << PYEL << "\t| local " << PBLU << next_bytes << PYEL << " < " << PBLU
+                  << chunk.constants->values[constant].repr() << PYEL << ", jump to = " << PBLU << 4 * (where + 3 - offset) << PRES << '\n';
+        print_trailing_bytes();
+    } else if (name == "FOR_RANGE" || name == "FOR_RANGE_INCLUSIVE") {
+        std::size_t end = chunk.bytes[where + 1] & 0x00ff'ffff;
+        std::size_t offset = chunk.bytes[where + 2] & 0x00ff'ffff;
+        std::cout << PYEL << "\t\t| local " << PBLU << next_bytes << PYEL << (name == "FOR_RANGE" ? " < " : " <= ")
+                  << "local " << PBLU << end << PYEL << ", jump to = " << PBLU << 4 * (where + 3 - offset) << PRES << '\n';
+        print_trailing_bytes();
+    } else if (name == "TABLE_SWITCH" || name == "LOOKUP_SWITCH" || name == "STRING_SWITCH") {
+        const Chunk::SwitchTable &table = chunk.switch_tables[next_bytes];
+        std::cout << PYEL << "\t\t| table " << PBLU << next_bytes << PYEL << ", " << PBLU << table.offsets.size()
+                  << PYEL << " case(s), default jump to = " << PBLU << 4 * (where + 1 + table.default_offset) << PRES
+                  << '\n';
+        print_trailing_bytes();
+    } else if (name == "CALL_NATIVE") {
+        const NativeWrapper *native = native_wrappers.get_all_natives_by_id()[next_bytes];
+        std::cout << PYEL << "\t\t| native " << PBLU << next_bytes << PYEL << " ('" << PBLU << native->get_name()
+                  << PYEL << "')\n"
+                  << PRES;
+        print_trailing_bytes();
+    } else if (name == "STASH_ARGUMENTS" || name == "RESTORE_ARGUMENTS") {
+        std::cout << PYEL << "\t| " << PBLU << next_bytes << PYEL << " argument(s)\n" << PRES;
+        print_trailing_bytes();
+    } else if (name == "LOAD_FUNCTION" || name == "CALL_DIRECT" || name == "TAIL_CALL") {
+        std::cout << PYEL << "\t\t| function " << PBLU << next_bytes << "\n";
         print_trailing_bytes();
     } else {
         std::cout << '\n';
@@ -168,12 +210,15 @@ void disassemble_instruction(Chunk &chunk, Instruction insn, std::size_t where,
         case Instruction::HALT: instruction(chunk, "HALT", where, colors_enabled); return;
         case Instruction::POP: instruction(chunk, "POP", where, colors_enabled); return;
         case Instruction::CONSTANT: instruction(chunk, "CONSTANT", where, colors_enabled); return;
+        case Instruction::PUSH_INT_IMM: instruction(chunk, "PUSH_INT_IMM", where, colors_enabled); return;
         case Instruction::IADD: instruction(chunk, "IADD", where, colors_enabled); return;
         case Instruction::ISUB: instruction(chunk, "ISUB", where, colors_enabled); return;
         case Instruction::IMUL: instruction(chunk, "IMUL", where, colors_enabled); return;
         case Instruction::IDIV: instruction(chunk, "IDIV", where, colors_enabled); return;
         case Instruction::IMOD: instruction(chunk, "IMOD", where, colors_enabled); return;
         case Instruction::INEG: instruction(chunk, "INEG", where, colors_enabled); return;
+        case Instruction::IDIV_UNCHECKED: instruction(chunk, "IDIV_UNCHECKED", where, colors_enabled); return;
+        case Instruction::IMOD_UNCHECKED: instruction(chunk, "IMOD_UNCHECKED", where, colors_enabled); return;
         case Instruction::FADD: instruction(chunk, "FADD", where, colors_enabled); return;
         case Instruction::FSUB: instruction(chunk, "FSUB", where, colors_enabled); return;
         case Instruction::FMUL: instruction(chunk, "FMUL", where, colors_enabled); return;
@@ -184,6 +229,12 @@ void disassemble_instruction(Chunk &chunk, Instruction insn, std::size_t where,
         case Instruction::INT_TO_FLOAT: instruction(chunk, "INT_TO_FLOAT", where, colors_enabled); return;
         case Instruction::SHIFT_LEFT: instruction(chunk, "SHIFT_LEFT", where, colors_enabled); return;
         case Instruction::SHIFT_RIGHT: instruction(chunk, "SHIFT_RIGHT", where, colors_enabled); return;
+        case Instruction::SHIFT_LEFT_UNCHECKED:
+            instruction(chunk, "SHIFT_LEFT_UNCHECKED", where, colors_enabled);
+            return;
+        case Instruction::SHIFT_RIGHT_UNCHECKED:
+            instruction(chunk, "SHIFT_RIGHT_UNCHECKED", where, colors_enabled);
+            return;
         case Instruction::BIT_AND: instruction(chunk, "BIT_AND", where, colors_enabled); return;
         case Instruction::BIT_OR: instruction(chunk, "BIT_OR", where, colors_enabled); return;
         case Instruction::BIT_NOT: instruction(chunk, "BIT_NOT", where, colors_enabled); return;
@@ -192,6 +243,12 @@ void disassemble_instruction(Chunk &chunk, Instruction insn, std::size_t where,
         case Instruction::EQUAL: instruction(chunk, "EQUAL", where, colors_enabled); return;
         case Instruction::GREATER: instruction(chunk, "GREATER", where, colors_enabled); return;
         case Instruction::LESSER: instruction(chunk, "LESSER", where, colors_enabled); return;
+        case Instruction::IEQUAL: instruction(chunk, "IEQUAL", where, colors_enabled); return;
+        case Instruction::IGREATER: instruction(chunk, "IGREATER", where, colors_enabled); return;
+        case Instruction::ILESSER: instruction(chunk, "ILESSER", where, colors_enabled); return;
+        case Instruction::FEQUAL: instruction(chunk, "FEQUAL", where, colors_enabled); return;
+        case Instruction::FGREATER: instruction(chunk, "FGREATER", where, colors_enabled); return;
+        case Instruction::FLESSER: instruction(chunk, "FLESSER", where, colors_enabled); return;
         case Instruction::PUSH_TRUE: instruction(chunk, "PUSH_TRUE", where, colors_enabled); return;
         case Instruction::PUSH_FALSE: instruction(chunk, "PUSH_FALSE", where, colors_enabled); return;
         case Instruction::PUSH_NULL: instruction(chunk, "PUSH_NULL", where, colors_enabled); return;
@@ -204,32 +261,46 @@ void disassemble_instruction(Chunk &chunk, Instruction insn, std::size_t where,
         case Instruction::POP_JUMP_BACK_IF_TRUE:
             instruction(chunk, "POP_JUMP_BACK_IF_TRUE", where, colors_enabled);
             return;
+        case Instruction::FOR_RANGE: instruction(chunk, "FOR_RANGE", where, colors_enabled); return;
+        case Instruction::FOR_RANGE_INCLUSIVE:
+            instruction(chunk, "FOR_RANGE_INCLUSIVE", where, colors_enabled);
+            return;
+        case Instruction::TABLE_SWITCH: instruction(chunk, "TABLE_SWITCH", where, colors_enabled); return;
+        case Instruction::LOOKUP_SWITCH: instruction(chunk, "LOOKUP_SWITCH", where, colors_enabled); return;
+        case Instruction::STRING_SWITCH: instruction(chunk, "STRING_SWITCH", where, colors_enabled); return;
         case Instruction::ASSIGN_LOCAL: instruction(chunk, "ASSIGN_LOCAL", where, colors_enabled); return;
         case Instruction::ACCESS_LOCAL: instruction(chunk, "ACCESS_LOCAL", where, colors_enabled); return;
+        case Instruction::ASSIGN_LOCAL_SCALAR: instruction(chunk, "ASSIGN_LOCAL_SCALAR", where, colors_enabled); return;
+        case Instruction::ACCESS_LOCAL_SCALAR: instruction(chunk, "ACCESS_LOCAL_SCALAR", where, colors_enabled); return;
         case Instruction::MAKE_REF_TO_LOCAL: instruction(chunk, "MAKE_REF_TO_LOCAL", where, colors_enabled); return;
         case Instruction::DEREF: instruction(chunk, "DEREF", where, colors_enabled); return;
         case Instruction::ASSIGN_GLOBAL: instruction(chunk, "ASSIGN_GLOBAL", where, colors_enabled); return;
         case Instruction::ACCESS_GLOBAL: instruction(chunk, "ACCESS_GLOBAL", where, colors_enabled); return;
-        case Instruction::MAKE_REF_TO_GLOBAL: instruction(chunk, "MAKE_REF_TO_GLOBAL", where, colors_enabled); return;
-        case Instruction::LOAD_FUNCTION_SAME_MODULE:
-            instruction(chunk, "LOAD_FUNCTION_SAME_MODULE", where, colors_enabled);
+        case Instruction::ASSIGN_GLOBAL_SCALAR:
+            instruction(chunk, "ASSIGN_GLOBAL_SCALAR", where, colors_enabled);
             return;
-        case Instruction::LOAD_FUNCTION_MODULE_INDEX:
-            instruction(chunk, "LOAD_FUNCTION_MODULE_INDEX", where, colors_enabled);
-            return;
-        case Instruction::LOAD_FUNCTION_MODULE_PATH:
-            instruction(chunk, "LOAD_FUNCTION_MODULE_PATH", where, colors_enabled);
+        case Instruction::ACCESS_GLOBAL_SCALAR:
+            instruction(chunk, "ACCESS_GLOBAL_SCALAR", where, colors_enabled);
             return;
+        case Instruction::MAKE_REF_TO_GLOBAL: instruction(chunk, "MAKE_REF_TO_GLOBAL", where, colors_enabled); return;
+        case Instruction::LOAD_FUNCTION: instruction(chunk, "LOAD_FUNCTION", where, colors_enabled); return;
         case Instruction::CALL_FUNCTION: instruction(chunk, "CALL_FUNCTION", where, colors_enabled); return;
+        case Instruction::CALL_DIRECT: instruction(chunk, "CALL_DIRECT", where, colors_enabled); return;
         case Instruction::CALL_NATIVE: instruction(chunk, "CALL_NATIVE", where, colors_enabled); return;
         case Instruction::RETURN: instruction(chunk, "RETURN", where, colors_enabled); return;
         case Instruction::TRAP_RETURN: instruction(chunk, "TRAP_RETURN", where, colors_enabled); return;
+        case Instruction::TAIL_CALL: instruction(chunk, "TAIL_CALL", where, colors_enabled); return;
+        case Instruction::STASH_ARGUMENTS: instruction(chunk, "STASH_ARGUMENTS", where, colors_enabled); return;
+        case Instruction::RESTORE_ARGUMENTS: instruction(chunk, "RESTORE_ARGUMENTS", where, colors_enabled); return;
         case Instruction::CONSTANT_STRING: instruction(chunk, "CONSTANT_STRING", where, colors_enabled); return;
         case Instruction::INDEX_STRING: instruction(chunk, "INDEX_STRING", where, colors_enabled); return;
         case Instruction::CHECK_STRING_INDEX: instruction(chunk, "CHECK_STRING_INDEX", where, colors_enabled); return;
         case Instruction::POP_STRING: instruction(chunk, "POP_STRING", where, colors_enabled); return;
         case Instruction::CONCATENATE: instruction(chunk, "CONCATENATE", where, colors_enabled); return;
         case Instruction::MAKE_LIST: instruction(chunk, "MAKE_LIST", where, colors_enabled); return;
+        case Instruction::MAKE_INT_LIST: instruction(chunk, "MAKE_INT_LIST", where, colors_enabled); return;
+        case Instruction::MAKE_FLOAT_LIST: instruction(chunk, "MAKE_FLOAT_LIST", where, colors_enabled); return;
+        case Instruction::MAKE_BOOL_LIST: instruction(chunk, "MAKE_BOOL_LIST", where, colors_enabled); return;
         case Instruction::COPY_LIST: instruction(chunk, "COPY_LIST", where, colors_enabled); return;
         case Instruction::APPEND_LIST: instruction(chunk, "APPEND_LIST", where, colors_enabled); return;
         case Instruction::POP_FROM_LIST: instruction(chunk, "POP_FROM_LIST", where, colors_enabled); return;
@@ -237,6 +308,8 @@ void disassemble_instruction(Chunk &chunk, Instruction insn, std::size_t where,
         case Instruction::INDEX_LIST: instruction(chunk, "INDEX_LIST", where, colors_enabled); return;
         case Instruction::MAKE_REF_TO_INDEX: instruction(chunk, "MAKE_REF_TO_INDEX", where, colors_enabled); return;
         case Instruction::CHECK_LIST_INDEX: instruction(chunk, "CHECK_LIST_INDEX", where, colors_enabled); return;
+        case Instruction::GET_FIELD: instruction(chunk, "GET_FIELD", where, colors_enabled); return;
+        case Instruction::SET_FIELD: instruction(chunk, "SET_FIELD", where, colors_enabled); return;
         case Instruction::ACCESS_LOCAL_LIST: instruction(chunk, "ACCESS_LOCAL_LIST", where, colors_enabled); return;
         case Instruction::ACCESS_GLOBAL_LIST: instruction(chunk, "ACCESS_GLOBAL_LIST", where, colors_enabled); return;
         case Instruction::ASSIGN_LOCAL_LIST: instruction(chunk, "ASSIGN_LOCAL_LIST", where, colors_enabled); return;
@@ -244,11 +317,20 @@ void disassemble_instruction(Chunk &chunk, Instruction insn, std::size_t where,
         case Instruction::POP_LIST: instruction(chunk, "POP_LIST", where, colors_enabled); return;
         case Instruction::ACCESS_FROM_TOP: instruction(chunk, "ACCESS_FROM_TOP", where, colors_enabled); return;
         case Instruction::ASSIGN_FROM_TOP: instruction(chunk, "ASSIGN_FROM_TOP", where, colors_enabled); return;
+        case Instruction::ASSIGN_FROM_TOP_SCALAR:
+            instruction(chunk, "ASSIGN_FROM_TOP_SCALAR", where, colors_enabled);
+            return;
         case Instruction::EQUAL_SL: instruction(chunk, "EQUAL_SL", where, colors_enabled); return;
+        case Instruction::EQUAL_STRING: instruction(chunk, "EQUAL_STRING", where, colors_enabled); return;
         case Instruction::MOVE_LOCAL: instruction(chunk, "MOVE_LOCAL", where, colors_enabled); return;
         case Instruction::MOVE_GLOBAL: instruction(chunk, "MOVE_GLOBAL", where, colors_enabled); return;
         case Instruction::MOVE_INDEX: instruction(chunk, "MOVE_INDEX", where, colors_enabled); return;
         case Instruction::SWAP: instruction(chunk, "SWAP", where, colors_enabled); return;
+        case Instruction::INC_LOCAL: instruction(chunk, "INC_LOCAL", where, colors_enabled); return;
+        case Instruction::POP_N: instruction(chunk, "POP_N", where, colors_enabled); return;
+        case Instruction::LOCAL_LT_CONST_JUMP_BACK:
+            instruction(chunk, "LOCAL_LT_CONST_JUMP_BACK", where, colors_enabled);
+            return;
     }
     unreachable();
 }
@@ -0,0 +1,140 @@
+/* Copyright (C) 2020-2022  Dhruv Chawla */
+/* See LICENSE at project root for license details */
+#include "nyx/Backend/VirtualMachine/GuardedStack.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <csignal>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+std::size_t page_size() {
+#ifdef _WIN32
+    SYSTEM_INFO info{};
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+std::size_t round_to_pages(std::size_t bytes) {
+    std::size_t page = page_size();
+    return std::max((bytes + page - 1) / page, std::size_t{1}) * page;
+}
+
+#ifndef _WIN32
+struct GuardPage {
+    const char *begin{};
+    const char *end{};
+    const char *overflow_message{};
+};
+
+// The guard pages of every live GuardedStack, looked up by the SIGSEGV handler
+constexpr std::size_t max_guard_pages = 16;
+GuardPage guard_pages[max_guard_pages]{};
+struct sigaction previous_segv_action {};
+bool handler_installed = false;
+
+void guard_page_handler(int signal, siginfo_t *info, void *context) {
+    const char *address = static_cast<const char *>(info->si_addr);
+    for (const GuardPage &guard : guard_pages) {
+        if (guard.begin <= address && address < guard.end) {
+            // Only async-signal-safe functions may be used here
+            const char prefix[] = "\n!-| Error: ";
+            (void)!write(STDERR_FILENO, prefix, sizeof(prefix) - 1);
+            (void)!write(STDERR_FILENO, guard.overflow_message, std::strlen(guard.overflow_message));
+            (void)!write(STDERR_FILENO, "\n", 1);
+            _exit(EXIT_FAILURE);
+        }
+    }
+
+    // Not an overflow, so let the fault be handled as it would have been without the guard pages
+    if (previous_segv_action.sa_flags & SA_SIGINFO) {
+        previous_segv_action.sa_sigaction(signal, info, context);
+    } else if (previous_segv_action.sa_handler != SIG_DFL && previous_segv_action.sa_handler != SIG_IGN) {
+        previous_segv_action.sa_handler(signal);
+    } else {
+        std::signal(signal, SIG_DFL);
+    }
+}
+
+bool register_guard_page(const char *begin, std::size_t size, const char *overflow_message) {
+    if (not handler_installed) {
+        struct sigaction action {};
+        action.sa_sigaction = guard_page_handler;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, &previous_segv_action);
+        handler_installed = true;
+    }
+
+    auto free = std::find_if(std::begin(guard_pages), std::end(guard_pages),
+        [](const GuardPage &guard) { return guard.begin == nullptr; });
+    if (free == std::end(guard_pages)) {
+        return false;
+    }
+    *free = GuardPage{begin, begin + size, overflow_message};
+    return true;
+}
+
+void unregister_guard_page(const char *begin) {
+    for (GuardPage &guard : guard_pages) {
+        if (guard.begin == begin) {
+            guard = GuardPage{};
+        }
+    }
+}
+#endif
+} // namespace
+
+void *reserve_guarded_region(std::size_t bytes, const char *overflow_message) {
+    std::size_t usable = round_to_pages(bytes);
+    std::size_t guard = page_size();
+#ifdef _WIN32
+    // No handler is installed on Windows, so an overflow shows up as an access violation instead of a message
+    (void)overflow_message;
+    void *region = VirtualAlloc(nullptr, usable + guard, MEM_RESERVE, PAGE_NOACCESS);
+    if (region == nullptr || VirtualAlloc(region, usable, MEM_COMMIT, PAGE_READWRITE) == nullptr) {
+        throw std::bad_alloc{};
+    }
+#else
+    void *region = mmap(nullptr, usable + guard, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+        -1, 0);
+    if (region == MAP_FAILED) {
+        throw std::bad_alloc{};
+    }
+    char *guard_page = static_cast<char *>(region) + usable;
+    if (mprotect(guard_page, guard, PROT_NONE) != 0) {
+        munmap(region, usable + guard);
+        throw std::bad_alloc{};
+    }
+    // An overflow into an unregistered guard page would be an unexplained crash, so running out of slots is an error
+    if (not register_guard_page(guard_page, guard, overflow_message)) {
+        munmap(region, usable + guard);
+        throw std::runtime_error{"Too many guarded stacks are in use at once"};
+    }
+#endif
+    return region;
+}
+
+void release_guarded_region(void *region, std::size_t bytes) {
+#ifdef _WIN32
+    (void)bytes;
+    VirtualFree(region, 0, MEM_RELEASE);
+#else
+    std::size_t usable = round_to_pages(bytes);
+    unregister_guard_page(static_cast<char *>(region) + usable);
+    munmap(region, usable + page_size());
+#endif
+}
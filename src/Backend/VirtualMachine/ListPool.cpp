@@ -0,0 +1,15 @@
+/* Copyright (C) 2020-2022  Dhruv Chawla */
+/* See LICENSE at project root for license details */
+#include "nyx/Backend/VirtualMachine/ListPool.hpp"
+
+void *ListPool::carve(std::size_t bytes) {
+    std::size_t rounded = (size_class(bytes) + 1) * granularity;
+    if (static_cast<std::size_t>(chunk_end - chunk_top) < rounded) {
+        // Whatever is left of the current chunk is too small for any block of this size, so it is given up on
+        chunk_top = chunks.emplace_back(new char[chunk_size]).get();
+        chunk_end = chunk_top + chunk_size;
+        statistics.chunks++;
+    }
+    statistics.carved++;
+    return std::exchange(chunk_top, chunk_top + rounded);
+}
@@ -3,13 +3,16 @@
 #include "nyx/Backend/VirtualMachine/Natives.hpp"
 
 #include "nyx/Backend/RuntimeModule.hpp"
+#include "nyx/Backend/VirtualMachine/StringSearch.hpp"
 #include "nyx/Backend/VirtualMachine/VirtualMachine.hpp"
 #include "nyx/Common.hpp"
 
 #include <algorithm>
 #include <array>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <string_view>
 
 Value native_print(VirtualMachine &vm, Value *args);
 Value native_int(VirtualMachine &vm, Value *args);
@@ -20,6 +23,13 @@ Value native_size(VirtualMachine &vm, Value *args);
 Value native_fill_trivial(VirtualMachine &vm, Value *args);
 Value native_resize_list_trivial(VirtualMachine &vm, Value *args);
 Value native_println(VirtualMachine &vm, Value *args);
+Value native_find(VirtualMachine &vm, Value *args);
+Value native_rfind(VirtualMachine &vm, Value *args);
+Value native_split(VirtualMachine &vm, Value *args);
+Value native_replace(VirtualMachine &vm, Value *args);
+Value native_starts_with(VirtualMachine &vm, Value *args);
+Value native_trim(VirtualMachine &vm, Value *args);
+Value native_join(VirtualMachine &vm, Value *args);
 
 NativeWrappers native_wrappers{};
 
@@ -51,6 +61,10 @@ std::size_t NativeWrapper::get_arity() const noexcept {
     return arity;
 }
 
+std::size_t NativeWrapper::get_id() const noexcept {
+    return id;
+}
+
 bool NativeWrapper::check_arity(std::size_t num_args) const noexcept {
     return num_args == arity;
 }
@@ -65,6 +79,8 @@ const TypeNode &NativeWrapper::get_return_type() const noexcept {
 }
 
 void NativeWrappers::add_native(NativeWrapper &native) {
+    native.id = natives_by_id.size();
+    natives_by_id.push_back(&native);
     native_functions[native.get_name()] = &native;
 }
 
@@ -84,6 +100,10 @@ const NativeWrappers::NativeCollectionType &NativeWrappers::get_all_natives() co
     return native_functions;
 }
 
+const std::vector<NativeWrapper *> &NativeWrappers::get_all_natives_by_id() const noexcept {
+    return natives_by_id;
+}
+
 // clang-format off
 NativeWrapper print{
     native_print,
@@ -258,34 +278,168 @@ NativeWrapper println {
         return {true, ""};
     }
 };
+
+NativeWrapper find {
+    native_find,
+    "find",
+    TypeNode{allocate_node(PrimitiveType, Type::INT, false, false)},
+    2,
+    NATIVE_ARGUMENT_CHECKER_DEFINITION {
+        if (arguments.size() != 2) {
+            return {false, "arity incorrect, should be 2"};
+        }
+
+        if (NATIVE_ARGN_PRIMITIVE(0) != Type::STRING || NATIVE_ARGN_PRIMITIVE(1) != Type::STRING) {
+            return {false, "incorrect argument type, can only search for a string in a string"};
+        }
+
+        return {true, ""};
+    }
+};
+
+NativeWrapper rfind {
+    native_rfind,
+    "rfind",
+    TypeNode{allocate_node(PrimitiveType, Type::INT, false, false)},
+    2,
+    NATIVE_ARGUMENT_CHECKER_DEFINITION {
+        if (arguments.size() != 2) {
+            return {false, "arity incorrect, should be 2"};
+        }
+
+        if (NATIVE_ARGN_PRIMITIVE(0) != Type::STRING || NATIVE_ARGN_PRIMITIVE(1) != Type::STRING) {
+            return {false, "incorrect argument type, can only search for a string in a string"};
+        }
+
+        return {true, ""};
+    }
+};
+
+NativeWrapper split {
+    native_split,
+    "split",
+    TypeNode{allocate_node(ListType, Type::LIST, false, false,
+        TypeNode{allocate_node(PrimitiveType, Type::STRING, false, false)})},
+    2,
+    NATIVE_ARGUMENT_CHECKER_DEFINITION {
+        if (arguments.size() != 2) {
+            return {false, "arity incorrect, should be 2"};
+        }
+
+        if (NATIVE_ARGN_PRIMITIVE(0) != Type::STRING || NATIVE_ARGN_PRIMITIVE(1) != Type::STRING) {
+            return {false, "incorrect argument type, can only split a string by a string"};
+        }
+
+        return {true, ""};
+    }
+};
+
+NativeWrapper replace {
+    native_replace,
+    "replace",
+    TypeNode{allocate_node(PrimitiveType, Type::STRING, false, false)},
+    3,
+    NATIVE_ARGUMENT_CHECKER_DEFINITION {
+        if (arguments.size() != 3) {
+            return {false, "arity incorrect, should be 3"};
+        }
+
+        if (NATIVE_ARGN_PRIMITIVE(0) != Type::STRING || NATIVE_ARGN_PRIMITIVE(1) != Type::STRING ||
+            NATIVE_ARGN_PRIMITIVE(2) != Type::STRING) {
+            return {false, "incorrect argument type, all arguments have to be strings"};
+        }
+
+        return {true, ""};
+    }
+};
+
+NativeWrapper starts_with {
+    native_starts_with,
+    "starts_with",
+    TypeNode{allocate_node(PrimitiveType, Type::BOOL, false, false)},
+    2,
+    NATIVE_ARGUMENT_CHECKER_DEFINITION {
+        if (arguments.size() != 2) {
+            return {false, "arity incorrect, should be 2"};
+        }
+
+        if (NATIVE_ARGN_PRIMITIVE(0) != Type::STRING || NATIVE_ARGN_PRIMITIVE(1) != Type::STRING) {
+            return {false, "incorrect argument type, both arguments have to be strings"};
+        }
+
+        return {true, ""};
+    }
+};
+
+NativeWrapper trim {
+    native_trim,
+    "trim",
+    TypeNode{allocate_node(PrimitiveType, Type::STRING, false, false)},
+    1,
+    NATIVE_ARGUMENT_CHECKER_DEFINITION {
+        if (arguments.size() != 1) {
+            return {false, "arity incorrect, should be 1"};
+        }
+
+        if (NATIVE_ARGN_PRIMITIVE(0) != Type::STRING) {
+            return {false, "incorrect argument type, can only trim a string"};
+        }
+
+        return {true, ""};
+    }
+};
+
+NativeWrapper join {
+    native_join,
+    "join",
+    TypeNode{allocate_node(PrimitiveType, Type::STRING, false, false)},
+    2,
+    NATIVE_ARGUMENT_CHECKER_DEFINITION {
+        if (arguments.size() != 2) {
+            return {false, "arity incorrect, should be 2"};
+        }
+
+        auto *list = NATIVE_ARGN_TYPE(0);
+        if (list->primitive != Type::LIST || dynamic_cast<ListType*>(list)->contained->primitive != Type::STRING) {
+            return {false, "type of the first argument has to be a list of strings"};
+        }
+
+        if (NATIVE_ARGN_PRIMITIVE(1) != Type::STRING) {
+            return {false, "type of the separator has to be string"};
+        }
+
+        return {true, ""};
+    }
+};
 // clang-format on
 
 Value native_print(VirtualMachine &vm, Value *args) {
     Value &arg = args[0];
-    if (arg.tag == Value::Tag::INT) {
-        std::cout << arg.w_int;
-    } else if (arg.tag == Value::Tag::FLOAT) {
-        std::cout << arg.w_float;
-    } else if (arg.tag == Value::Tag::BOOL) {
-        std::cout << (arg.w_bool ? "true" : "false");
-    } else if (arg.tag == Value::Tag::STRING) {
-        std::cout << arg.w_str->str;
-    } else if (arg.tag == Value::Tag::REF) {
-        native_print(vm, arg.w_ref);
-    } else if (arg.tag == Value::Tag::LIST || arg.tag == Value::Tag::LIST_REF) {
-        if (arg.w_list == nullptr || arg.w_list->empty()) {
+    if (arg.get_tag() == Value::Tag::INT) {
+        std::cout << arg.get_int();
+    } else if (arg.get_tag() == Value::Tag::FLOAT) {
+        std::cout << arg.get_float();
+    } else if (arg.get_tag() == Value::Tag::BOOL) {
+        std::cout << (arg.get_bool() ? "true" : "false");
+    } else if (arg.get_tag() == Value::Tag::STRING) {
+        std::cout << arg.get_string()->get_str();
+    } else if (arg.get_tag() == Value::Tag::REF) {
+        native_print(vm, arg.get_ref());
+    } else if (arg.get_tag() == Value::Tag::LIST || arg.get_tag() == Value::Tag::LIST_REF) {
+        if (arg.get_list() == nullptr || arg.get_list()->empty()) {
             std::cout << "[]";
         } else {
             std::cout << "[";
-            auto begin = arg.w_list->begin();
-            for (; begin != arg.w_list->end() - 1; begin++) {
-                native_print(vm, &*begin);
-                std::cout << ", ";
+            for (std::size_t i = 0; i < arg.get_list()->size(); i++) {
+                Value element = arg.get_list()->get(i);
+                if (i != 0) {
+                    std::cout << ", ";
+                }
+                native_print(vm, &element);
             }
-            native_print(vm, &*begin);
             std::cout << "]";
         }
-    } else if (arg.tag == Value::Tag::INVALID) {
+    } else if (arg.get_tag() == Value::Tag::INVALID) {
         std::cout << "<invalid!>";
     }
     return Value{nullptr};
@@ -293,17 +447,17 @@ Value native_print(VirtualMachine &vm, Value *args) {
 
 Value native_int(VirtualMachine &vm, Value *args) {
     Value &arg = args[0];
-    if (arg.tag == Value::Tag::INT) {
+    if (arg.get_tag() == Value::Tag::INT) {
         return arg;
-    } else if (arg.tag == Value::Tag::FLOAT) {
-        return Value{static_cast<int>(arg.w_float)};
-    } else if (arg.tag == Value::Tag::STRING) {
-        return Value{std::stoi(arg.w_str->str)};
-    } else if (arg.tag == Value::Tag::BOOL) {
-        return Value{static_cast<int>(arg.w_bool)};
-    } else if (arg.tag == Value::Tag::REF) {
-        return native_int(vm, arg.w_ref);
-    } else if (arg.tag == Value::Tag::INVALID) {
+    } else if (arg.get_tag() == Value::Tag::FLOAT) {
+        return Value{static_cast<int>(arg.get_float())};
+    } else if (arg.get_tag() == Value::Tag::STRING) {
+        return Value{std::stoi(arg.get_string()->get_str())};
+    } else if (arg.get_tag() == Value::Tag::BOOL) {
+        return Value{static_cast<int>(arg.get_bool())};
+    } else if (arg.get_tag() == Value::Tag::REF) {
+        return native_int(vm, arg.get_ref());
+    } else if (arg.get_tag() == Value::Tag::INVALID) {
         return Value{0};
     }
     unreachable();
@@ -311,35 +465,35 @@ Value native_int(VirtualMachine &vm, Value *args) {
 
 Value native_float(VirtualMachine &vm, Value *args) {
     Value &arg = args[0];
-    if (arg.tag == Value::Tag::INT) {
-        return Value{static_cast<float>(arg.w_int)};
-    } else if (arg.tag == Value::Tag::FLOAT) {
+    if (arg.get_tag() == Value::Tag::INT) {
+        return Value{static_cast<float>(arg.get_int())};
+    } else if (arg.get_tag() == Value::Tag::FLOAT) {
         return arg;
-    } else if (arg.tag == Value::Tag::STRING) {
-        return Value{std::stod(arg.w_str->str)};
-    } else if (arg.tag == Value::Tag::BOOL) {
-        return Value{static_cast<float>(arg.w_bool)};
-    } else if (arg.tag == Value::Tag::REF) {
-        return native_int(vm, arg.w_ref);
+    } else if (arg.get_tag() == Value::Tag::STRING) {
+        return Value{std::stod(arg.get_string()->get_str())};
+    } else if (arg.get_tag() == Value::Tag::BOOL) {
+        return Value{static_cast<float>(arg.get_bool())};
+    } else if (arg.get_tag() == Value::Tag::REF) {
+        return native_int(vm, arg.get_ref());
     }
     unreachable();
 }
 
 Value native_string(VirtualMachine &vm, Value *args) {
     Value &arg = args[0];
-    if (arg.tag == Value::Tag::INT) {
-        return Value{&vm.store_string(std::to_string(arg.w_int))};
-    } else if (arg.tag == Value::Tag::FLOAT) {
-        return Value{&vm.store_string(std::to_string(arg.w_float))};
-    } else if (arg.tag == Value::Tag::STRING) {
+    if (arg.get_tag() == Value::Tag::INT) {
+        return Value{&vm.int_to_string(arg.get_int())};
+    } else if (arg.get_tag() == Value::Tag::FLOAT) {
+        return Value{&vm.store_string(std::to_string(arg.get_float()))};
+    } else if (arg.get_tag() == Value::Tag::STRING) {
         return arg;
-    } else if (arg.tag == Value::Tag::BOOL) {
-        return Value{&vm.store_string(arg.w_bool ? "true" : "false")};
-    } else if (arg.tag == Value::Tag::REF) {
-        return native_string(vm, arg.w_ref);
-    } else if (arg.tag == Value::Tag::LIST || arg.tag == Value::Tag::LIST_REF) {
+    } else if (arg.get_tag() == Value::Tag::BOOL) {
+        return Value{&vm.intern_string(arg.get_bool() ? "true" : "false")};
+    } else if (arg.get_tag() == Value::Tag::REF) {
+        return native_string(vm, arg.get_ref());
+    } else if (arg.get_tag() == Value::Tag::LIST || arg.get_tag() == Value::Tag::LIST_REF) {
         return Value{&vm.store_string(arg.repr())};
-    } else if (arg.tag == Value::Tag::INVALID) {
+    } else if (arg.get_tag() == Value::Tag::INVALID) {
         return Value{&vm.store_string("invalid")};
     }
     unreachable();
@@ -347,10 +501,10 @@ Value native_string(VirtualMachine &vm, Value *args) {
 
 Value native_readline(VirtualMachine &vm, Value *args) {
     Value &prompt = args[0];
-    if (prompt.tag == Value::Tag::REF) {
-        std::cout << prompt.w_ref->w_str->str;
+    if (prompt.get_tag() == Value::Tag::REF) {
+        std::cout << prompt.get_ref()->get_string()->get_str();
     } else {
-        std::cout << prompt.w_str->str;
+        std::cout << prompt.get_string()->get_str();
     }
     std::string result{};
     std::getline(std::cin, result);
@@ -360,12 +514,12 @@ Value native_readline(VirtualMachine &vm, Value *args) {
 
 Value native_size(VirtualMachine &vm, Value *args) {
     Value &arg = args[0];
-    if (arg.tag == Value::Tag::STRING) {
-        return Value{static_cast<Value::IntType>(arg.w_str->str.length())};
-    } else if (arg.tag == Value::Tag::LIST || arg.tag == Value::Tag::LIST_REF) {
-        return Value{static_cast<Value::IntType>(arg.w_list->size())};
-    } else if (arg.tag == Value::Tag::REF) {
-        return native_string(vm, arg.w_ref);
+    if (arg.get_tag() == Value::Tag::STRING) {
+        return Value{static_cast<Value::IntType>(arg.get_string()->size())};
+    } else if (arg.get_tag() == Value::Tag::LIST || arg.get_tag() == Value::Tag::LIST_REF) {
+        return Value{static_cast<Value::IntType>(arg.get_list()->size())};
+    } else if (arg.get_tag() == Value::Tag::REF) {
+        return native_string(vm, arg.get_ref());
     }
     unreachable();
 }
@@ -374,17 +528,21 @@ Value native_fill_trivial(VirtualMachine &vm, Value *args) {
     Value &list = args[0];
     Value *value = &args[1];
 
-    if (value->tag == Value::Tag::REF) {
-        value = value->w_ref;
+    if (value->get_tag() == Value::Tag::REF) {
+        value = value->get_ref();
     }
 
-    if (value->tag == Value::Tag::STRING) {
-        std::for_each(list.w_list->begin(), list.w_list->end(), [&vm](const Value &v) { vm.remove_string(v.w_str); });
-        for (auto &e : *list.w_list) {
-            e = Value{&vm.store_string(value->w_str->str)};
+    vm.unshare_list(list.get_list());
+    if (value->get_tag() == Value::Tag::STRING) {
+        for (auto &e : *list.get_list()) {
+            // Freshly resized lists hold invalid values, which have no string to release
+            if (e.get_tag() == Value::Tag::STRING) {
+                vm.remove_string(e.get_string());
+            }
+            e = Value{&StringCacher::retain(*value->get_string())};
         }
     } else {
-        std::fill(list.w_list->begin(), list.w_list->end(), *value);
+        list.get_list()->fill(*value);
     }
     return Value{nullptr};
 }
@@ -393,16 +551,18 @@ Value native_resize_list_trivial(VirtualMachine &vm, Value *args) {
     Value &list = args[0];
     Value *size = &args[1];
 
-    if (size->tag == Value::Tag::REF) {
-        size = size->w_ref;
+    if (size->get_tag() == Value::Tag::REF) {
+        size = size->get_ref();
     }
 
-    if (not list.w_list->empty() && (*list.w_list)[0].tag == Value::Tag::STRING) {
-        for (auto i = static_cast<std::size_t>(size->w_int); i < list.w_list->size(); i++) {
-            vm.remove_string((*list.w_list)[i].w_str);
+    vm.unshare_list(list.get_list());
+    if (not list.get_list()->is_packed() && not list.get_list()->empty() &&
+        (*list.get_list())[0].get_tag() == Value::Tag::STRING) {
+        for (auto i = static_cast<std::size_t>(size->get_int()); i < list.get_list()->size(); i++) {
+            vm.remove_string((*list.get_list())[i].get_string());
         }
     }
-    list.w_list->resize(size->w_int);
+    list.get_list()->resize(size->get_int());
     return Value{nullptr};
 }
 
@@ -410,4 +570,130 @@ Value native_println(VirtualMachine &vm, Value *args) {
     native_print(vm, args);
     std::cout << '\n';
     return Value{nullptr};
-}
\ No newline at end of file
+}
+
+namespace {
+// Arguments of the string natives may be references to strings, or references to lists of strings
+Value &dereference(Value &arg) {
+    return arg.get_tag() == Value::Tag::REF ? *arg.get_ref() : arg;
+}
+
+const std::string &string_argument(Value &arg) {
+    return dereference(arg).get_string()->get_str();
+}
+} // namespace
+
+Value native_find(VirtualMachine &, Value *args) {
+    std::size_t found = find_substring(string_argument(args[0]), string_argument(args[1]));
+    return Value{found == std::string_view::npos ? -1 : static_cast<Value::IntType>(found)};
+}
+
+Value native_rfind(VirtualMachine &, Value *args) {
+    std::size_t found = rfind_substring(string_argument(args[0]), string_argument(args[1]));
+    return Value{found == std::string_view::npos ? -1 : static_cast<Value::IntType>(found)};
+}
+
+Value native_split(VirtualMachine &vm, Value *args) {
+    std::string_view string = string_argument(args[0]);
+    std::string_view separator = string_argument(args[1]);
+    Value::ListType *parts = vm.store_list();
+
+    if (separator.empty()) {
+        parts->reserve(string.size());
+        for (const char &ch : string) {
+            parts->push_back(Value{&vm.intern_string(std::string_view{&ch, 1})});
+        }
+        return Value{parts};
+    }
+
+    std::size_t count = 1;
+    for (std::size_t found = find_substring(string, separator); found != std::string_view::npos;
+         found = find_substring(string, separator, found + separator.size())) {
+        count++;
+    }
+
+    parts->reserve(count);
+    std::size_t begin = 0;
+    for (std::size_t i = 1; i < count; i++) {
+        std::size_t end = find_substring(string, separator, begin);
+        parts->push_back(Value{&vm.store_string(std::string{string.substr(begin, end - begin)})});
+        begin = end + separator.size();
+    }
+    parts->push_back(Value{&vm.store_string(std::string{string.substr(begin)})});
+    return Value{parts};
+}
+
+Value native_replace(VirtualMachine &vm, Value *args) {
+    Value &original = dereference(args[0]);
+    std::string_view string = original.get_string()->get_str();
+    std::string_view pattern = string_argument(args[1]);
+    std::string_view replacement = string_argument(args[2]);
+
+    std::size_t count = 0;
+    if (not pattern.empty()) {
+        for (std::size_t found = find_substring(string, pattern); found != std::string_view::npos;
+             found = find_substring(string, pattern, found + pattern.size())) {
+            count++;
+        }
+    }
+    if (count == 0) {
+        return Value{&StringCacher::retain(*original.get_string())};
+    }
+
+    std::string result{};
+    result.reserve(string.size() - count * pattern.size() + count * replacement.size());
+    std::size_t begin = 0;
+    for (std::size_t i = 0; i < count; i++) {
+        std::size_t end = find_substring(string, pattern, begin);
+        result.append(string.substr(begin, end - begin)).append(replacement);
+        begin = end + pattern.size();
+    }
+    result.append(string.substr(begin));
+    return Value{&vm.store_string(std::move(result))};
+}
+
+Value native_starts_with(VirtualMachine &, Value *args) {
+    const std::string &string = string_argument(args[0]);
+    const std::string &prefix = string_argument(args[1]);
+    return Value{string.size() >= prefix.size() && std::memcmp(string.data(), prefix.data(), prefix.size()) == 0};
+}
+
+Value native_trim(VirtualMachine &vm, Value *args) {
+    Value &original = dereference(args[0]);
+    std::string_view string = original.get_string()->get_str();
+    auto is_space = [](char ch) { return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == '\v' || ch == '\f'; };
+
+    std::size_t begin = 0;
+    std::size_t end = string.size();
+    while (begin < end && is_space(string[begin])) {
+        begin++;
+    }
+    while (end > begin && is_space(string[end - 1])) {
+        end--;
+    }
+
+    if (begin == 0 && end == string.size()) {
+        return Value{&StringCacher::retain(*original.get_string())};
+    }
+    return Value{&vm.store_string(std::string{string.substr(begin, end - begin)})};
+}
+
+Value native_join(VirtualMachine &vm, Value *args) {
+    const Value::ListType &parts = *dereference(args[0]).get_list();
+    std::string_view separator = string_argument(args[1]);
+
+    std::size_t length = parts.empty() ? 0 : separator.size() * (parts.size() - 1);
+    for (const Value &part : parts) {
+        length += part.get_string()->size();
+    }
+
+    std::string result{};
+    result.reserve(length);
+    for (std::size_t i = 0; i < parts.size(); i++) {
+        if (i != 0) {
+            result.append(separator);
+        }
+        result.append(parts[i].get_string()->get_str());
+    }
+    return Value{&vm.store_string(std::move(result))};
+}
@@ -2,43 +2,204 @@
 /* See LICENSE at project root for license details */
 #include "nyx/Backend/VirtualMachine/StringCacher.hpp"
 
-#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
 
-const HashedString &StringCacher::concat(const HashedString &first, const HashedString &second) {
-    return insert(first.str + second.str);
+namespace {
+constexpr std::uint64_t secret[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull};
+
+// Multiplies a and b into a 128 bit product, leaving its low half in a and its high half in b
+void multiply(std::uint64_t &a, std::uint64_t &b) noexcept {
+#ifdef __SIZEOF_INT128__
+    __uint128_t product = static_cast<__uint128_t>(a) * b;
+    a = static_cast<std::uint64_t>(product);
+    b = static_cast<std::uint64_t>(product >> 64);
+#else
+    std::uint64_t a_high = a >> 32, a_low = static_cast<std::uint32_t>(a);
+    std::uint64_t b_high = b >> 32, b_low = static_cast<std::uint32_t>(b);
+    std::uint64_t high = a_high * b_high, middle_1 = a_high * b_low, middle_2 = a_low * b_high, low = a_low * b_low;
+    std::uint64_t carry = ((low >> 32) + static_cast<std::uint32_t>(middle_1) + static_cast<std::uint32_t>(middle_2)) >> 32;
+    a = low + (middle_1 << 32) + (middle_2 << 32);
+    b = high + (middle_1 >> 32) + (middle_2 >> 32) + carry;
+#endif
+}
+
+std::uint64_t mix(std::uint64_t a, std::uint64_t b) noexcept {
+    multiply(a, b);
+    return a ^ b;
 }
 
-const HashedString &StringCacher::insert(std::string &&value) {
-    return insert(HashedString{std::move(value)});
+std::uint64_t read_64(const char *bytes) noexcept {
+    std::uint64_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
 }
 
-const HashedString &StringCacher::insert(const std::string &value) {
-    return insert(HashedString{value});
+std::uint64_t read_32(const char *bytes) noexcept {
+    std::uint32_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
 }
+} // namespace
+
+std::size_t hash_string(std::string_view string) noexcept {
+    const char *bytes = string.data();
+    std::size_t length = string.size();
+    std::uint64_t seed = mix(secret[0], secret[1]);
+    std::uint64_t a{}, b{};
 
-const HashedString &StringCacher::insert(HashedString &&value) {
-    if (auto it = strings.find(value); it != strings.end()) {
-        it->second++;
-        return it->first;
+    if (length <= 16) {
+        if (length >= 4) {
+            // Two possibly overlapping reads from each end cover every byte
+            std::size_t offset = (length >> 3) << 2;
+            a = (read_32(bytes) << 32) | read_32(bytes + offset);
+            b = (read_32(bytes + length - 4) << 32) | read_32(bytes + length - 4 - offset);
+        } else if (length > 0) {
+            a = (static_cast<std::uint64_t>(static_cast<unsigned char>(bytes[0])) << 16) |
+                (static_cast<std::uint64_t>(static_cast<unsigned char>(bytes[length >> 1])) << 8) |
+                static_cast<unsigned char>(bytes[length - 1]);
+        }
     } else {
-        return strings.emplace(std::move(value), 1).first->first;
+        std::size_t remaining = length;
+        if (remaining > 48) {
+            std::uint64_t seed_1 = seed, seed_2 = seed;
+            do {
+                seed = mix(read_64(bytes) ^ secret[1], read_64(bytes + 8) ^ seed);
+                seed_1 = mix(read_64(bytes + 16) ^ secret[2], read_64(bytes + 24) ^ seed_1);
+                seed_2 = mix(read_64(bytes + 32) ^ secret[3], read_64(bytes + 40) ^ seed_2);
+                bytes += 48;
+                remaining -= 48;
+            } while (remaining > 48);
+            seed ^= seed_1 ^ seed_2;
+        }
+        while (remaining > 16) {
+            seed = mix(read_64(bytes) ^ secret[1], read_64(bytes + 8) ^ seed);
+            bytes += 16;
+            remaining -= 16;
+        }
+        a = read_64(bytes + remaining - 16);
+        b = read_64(bytes + remaining - 8);
     }
+
+    a ^= secret[1];
+    b ^= seed;
+    multiply(a, b);
+    return static_cast<std::size_t>(mix(a ^ secret[0] ^ length, b ^ secret[1]));
 }
 
-const HashedString &StringCacher::insert(const HashedString &value) {
-    if (auto it = strings.find(value); it != strings.end()) {
-        it->second++;
-        return it->first;
-    } else {
-        return strings.emplace(value, 1).first->first;
+// Ropes built by a loop are as deep as the number of iterations, so neither flattening nor destroying them may recurse
+void HashedString::flatten() const {
+    std::string result{};
+    result.reserve(length);
+
+    std::vector<const HashedString *> pending{right, left};
+    while (not pending.empty()) {
+        const HashedString *current = pending.back();
+        pending.pop_back();
+        if (current->left != nullptr) {
+            pending.push_back(current->right);
+            pending.push_back(current->left);
+        } else {
+            result.append(current->str);
+        }
+    }
+
+    StringCacher::release(*left);
+    StringCacher::release(*right);
+    left = right = nullptr;
+    str = std::move(result);
+}
+
+void StringCacher::destroy(const HashedString &value) noexcept {
+    if (value.left == nullptr) {
+        delete &value;
+        return;
+    }
+
+    std::vector<const HashedString *> pending{&value};
+    while (not pending.empty()) {
+        const HashedString *current = pending.back();
+        pending.pop_back();
+        if (current->left != nullptr) {
+            for (const HashedString *half : {current->left, current->right}) {
+                if (--half->refcount == 0) {
+                    pending.push_back(half);
+                }
+            }
+        }
+        delete current;
+    }
+}
+
+StringCacher::StringCacher() {
+    for (std::size_t i = 0; i < characters.size(); i++) {
+        characters[i] = HashedString{std::string(1, static_cast<char>(i))};
+        (void)characters[i].get_hash();
+    }
+}
+
+StringCacher::~StringCacher() {
+    for (auto &[contents, string] : interned) {
+        release(*string);
     }
 }
 
-void StringCacher::remove(const HashedString &value) {
-    if (auto it = strings.find(value); it != strings.end()) {
-        it->second--;
-        if (it->second <= 0) {
-            strings.erase(it);
+const HashedString &StringCacher::concat(const HashedString &first, const HashedString &second) {
+    if (first.size() + second.size() < min_rope_length) {
+        std::string result{};
+        result.reserve(first.size() + second.size());
+        result.append(first.get_str()).append(second.get_str());
+        return make(std::move(result));
+    }
+
+    // A rope that nothing else refers to is reused, with short strings appended to its right half instead of getting a
+    // node of their own. This keeps a string built up piece by piece from needing a node for every piece
+    if (first.refcount == 1 && first.left != nullptr && first.right->left == nullptr &&
+        first.right->size() + second.size() < min_rope_length) {
+        if (first.right->refcount == 1) {
+            first.right->str.append(second.get_str());
+            first.right->hashed = false;
+            first.right->length = first.right->str.size();
+        } else {
+            const HashedString *appended = &make(first.right->str + second.get_str());
+            release(*first.right);
+            first.right = appended;
         }
+        first.length += second.size();
+        return retain(first);
     }
-}
\ No newline at end of file
+
+    return *new HashedString{&retain(first), &retain(second)};
+}
+
+const HashedString &StringCacher::make(std::string value) {
+    return *new HashedString{std::move(value)};
+}
+
+const HashedString &StringCacher::from_int(std::int32_t value) {
+    if (value >= 0 && static_cast<std::size_t>(value) < small_ints.size()) {
+        return retain(small_ints[value]);
+    }
+    return make(std::to_string(value));
+}
+
+void StringCacher::make_small_int_strings(std::size_t count) {
+    small_ints.clear();
+    small_ints.reserve(count);
+    for (std::size_t i = 0; i < count; i++) {
+        (void)small_ints.emplace_back(std::to_string(i)).get_hash();
+    }
+}
+
+const HashedString &StringCacher::intern(std::string_view value) {
+    if (auto it = interned.find(value); it != interned.end()) {
+        return retain(*it->second);
+    }
+
+    // The table keeps a reference of its own, so interned strings live at least as long as the StringCacher
+    const HashedString &string = make(std::string{value});
+    interned.emplace(string.get_str(), &string);
+    return retain(string);
+}
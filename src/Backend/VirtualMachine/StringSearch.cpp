@@ -0,0 +1,159 @@
+/* Copyright (C) 2020-2022  Dhruv Chawla */
+/* See LICENSE at project root for license details */
+#include "nyx/Backend/VirtualMachine/StringSearch.hpp"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_KERNELS      1
+#define DETECT_AVX2      1
+#define TARGET(features) __attribute__((target(features)))
+#include <immintrin.h>
+#elif defined(_M_X64)
+#define X86_KERNELS 1
+#define DETECT_AVX2 0
+#define TARGET(features)
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#define X86_KERNELS 0
+#define DETECT_AVX2 0
+#endif
+
+namespace {
+// Every kernel takes a needle of at least one byte which is no longer than the haystack
+using SearchKernel = std::size_t (*)(std::string_view haystack, std::string_view needle) noexcept;
+
+std::size_t find_scalar(std::string_view haystack, std::string_view needle) noexcept {
+    return haystack.find(needle);
+}
+
+std::size_t rfind_scalar(std::string_view haystack, std::string_view needle) noexcept {
+    return haystack.rfind(needle);
+}
+
+#if X86_KERNELS
+unsigned lowest_bit(unsigned mask) noexcept {
+#ifdef __GNUC__
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#else
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#endif
+}
+
+unsigned highest_bit(unsigned mask) noexcept {
+#ifdef __GNUC__
+    return 31 - static_cast<unsigned>(__builtin_clz(mask));
+#else
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return index;
+#endif
+}
+
+// Whether the bytes between the first and the last byte of the needle match, as those two are already known to
+bool middle_matches(const char *candidate, std::string_view needle) noexcept {
+    return needle.size() <= 2 || std::memcmp(candidate + 1, needle.data() + 1, needle.size() - 2) == 0;
+}
+
+// Generates a forward and a reverse kernel processing `width` candidate positions per step. Positions which do not
+// fill a whole block are left to the scalar kernels
+#define DEFINE_KERNELS(name, features, width, vector, set1, loadu, cmpeq, and_, movemask)                            \
+    TARGET(features) std::size_t find_##name(std::string_view haystack, std::string_view needle) noexcept {           \
+        const vector first = set1(needle.front());                                                                   \
+        const vector last = set1(needle.back());                                                                     \
+        const char *bytes = haystack.data();                                                                         \
+        std::size_t candidates = haystack.size() - needle.size() + 1;                                                \
+        std::size_t i = 0;                                                                                           \
+        for (; i + width <= candidates; i += width) {                                                                \
+            vector block_first = loadu(reinterpret_cast<const vector *>(bytes + i));                                 \
+            vector block_last = loadu(reinterpret_cast<const vector *>(bytes + i + needle.size() - 1));              \
+            auto mask = static_cast<unsigned>(movemask(and_(cmpeq(first, block_first), cmpeq(last, block_last))));   \
+            for (; mask != 0; mask &= mask - 1) {                                                                    \
+                unsigned bit = lowest_bit(mask);                                                                     \
+                if (middle_matches(bytes + i + bit, needle)) {                                                       \
+                    return i + bit;                                                                                  \
+                }                                                                                                    \
+            }                                                                                                        \
+        }                                                                                                            \
+        std::size_t found = find_scalar(haystack.substr(i), needle);                                                 \
+        return found == std::string_view::npos ? found : i + found;                                                  \
+    }                                                                                                                \
+                                                                                                                     \
+    TARGET(features) std::size_t rfind_##name(std::string_view haystack, std::string_view needle) noexcept {          \
+        const vector first = set1(needle.front());                                                                   \
+        const vector last = set1(needle.back());                                                                     \
+        const char *bytes = haystack.data();                                                                         \
+        std::size_t candidates = haystack.size() - needle.size() + 1;                                                \
+        for (; candidates >= width; candidates -= width) {                                                           \
+            std::size_t i = candidates - width;                                                                      \
+            vector block_first = loadu(reinterpret_cast<const vector *>(bytes + i));                                 \
+            vector block_last = loadu(reinterpret_cast<const vector *>(bytes + i + needle.size() - 1));              \
+            auto mask = static_cast<unsigned>(movemask(and_(cmpeq(first, block_first), cmpeq(last, block_last))));   \
+            for (; mask != 0; mask &= ~(1u << highest_bit(mask))) {                                                  \
+                unsigned bit = highest_bit(mask);                                                                    \
+                if (middle_matches(bytes + i + bit, needle)) {                                                       \
+                    return i + bit;                                                                                  \
+                }                                                                                                    \
+            }                                                                                                        \
+        }                                                                                                            \
+        return rfind_scalar(haystack.substr(0, candidates + needle.size() - 1), needle);                             \
+    }
+
+DEFINE_KERNELS(sse2, "sse2", 16, __m128i, _mm_set1_epi8, _mm_loadu_si128, _mm_cmpeq_epi8, _mm_and_si128,
+    _mm_movemask_epi8)
+#if DETECT_AVX2
+DEFINE_KERNELS(avx2, "avx2", 32, __m256i, _mm256_set1_epi8, _mm256_loadu_si256, _mm256_cmpeq_epi8, _mm256_and_si256,
+    _mm256_movemask_epi8)
+#endif
+
+#undef DEFINE_KERNELS
+#endif
+
+struct Kernels {
+    SearchKernel find;
+    SearchKernel rfind;
+};
+
+Kernels select_kernels() noexcept {
+#if X86_KERNELS
+#if DETECT_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {find_avx2, rfind_avx2};
+    }
+#endif
+    return {find_sse2, rfind_sse2};
+#else
+    return {find_scalar, rfind_scalar};
+#endif
+}
+
+const Kernels kernels = select_kernels();
+} // namespace
+
+std::size_t find_substring(std::string_view haystack, std::string_view needle, std::size_t from) noexcept {
+    if (from > haystack.size() || needle.size() > haystack.size() - from) {
+        return std::string_view::npos;
+    } else if (needle.empty()) {
+        return from;
+    }
+
+    std::size_t found = kernels.find(haystack.substr(from), needle);
+    return found == std::string_view::npos ? found : from + found;
+}
+
+std::size_t rfind_substring(std::string_view haystack, std::string_view needle) noexcept {
+    if (needle.size() > haystack.size()) {
+        return std::string_view::npos;
+    } else if (needle.empty()) {
+        return haystack.size();
+    }
+    return kernels.rfind(haystack, needle);
+}
+
+#undef X86_KERNELS
+#undef DETECT_AVX2
+#undef TARGET
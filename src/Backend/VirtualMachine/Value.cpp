@@ -5,8 +5,37 @@
 #include "nyx/Common.hpp"
 
 #include <algorithm>
+#include <cmath>
 #include <cstring>
+#include <limits>
+#include <utility>
 
+#if NAN_BOXING
+Value::Value() noexcept : bits{box(Tag::INVALID, 0)} {}
+Value::Value(IntType value) noexcept : bits{box(Tag::INT, static_cast<std::uint32_t>(value))} {}
+Value::Value(FloatType value) noexcept : bits{} {
+    if (std::isnan(value) && std::signbit(value)) {
+        // A negative quiet NaN has 0xfff8 as its top bits, so the quiet bit is dropped to keep it below the boxed tags
+        bits = negative_nan_bits;
+        return;
+    } else if (std::isnan(value)) {
+        value = std::numeric_limits<FloatType>::quiet_NaN();
+    }
+    std::memcpy(&bits, &value, sizeof(bits));
+}
+Value::Value(StringType value) noexcept : bits{box(Tag::STRING, reinterpret_cast<std::uintptr_t>(value))} {}
+Value::Value(BoolType value) noexcept : bits{box(Tag::BOOL, value)} {}
+Value::Value(NullType) noexcept : bits{box(Tag::NULL_, 0)} {}
+Value::Value(ReferenceType value) noexcept : bits{box(Tag::REF, reinterpret_cast<std::uintptr_t>(value))} {}
+Value::Value(FunctionType value) noexcept : bits{box(Tag::FUNCTION, reinterpret_cast<std::uintptr_t>(value))} {}
+Value::Value(ListType *value) noexcept : bits{box(Tag::LIST, reinterpret_cast<std::uintptr_t>(value))} {}
+
+Value Value::make_list_ref(ListType *value) noexcept {
+    Value result{};
+    result.bits = box(Tag::LIST_REF, reinterpret_cast<std::uintptr_t>(value));
+    return result;
+}
+#else
 Value::Value() noexcept : w_invalid{}, tag{Tag::INVALID} {}
 Value::Value(IntType value) noexcept : w_int{value}, tag{Tag::INT} {}
 Value::Value(FloatType value) noexcept : w_float{value}, tag{Tag::FLOAT} {}
@@ -17,14 +46,21 @@ Value::Value(ReferenceType value) noexcept : w_ref{value}, tag{Tag::REF} {}
 Value::Value(FunctionType value) noexcept : w_fun{value}, tag{Tag::FUNCTION} {}
 Value::Value(ListType *value) noexcept : w_list{value}, tag{Tag::LIST} {}
 
+Value Value::make_list_ref(ListType *value) noexcept {
+    Value result{value};
+    result.tag = Tag::LIST_REF;
+    return result;
+}
+#endif
+
 std::string Value::repr() const noexcept {
-    if (tag == Tag::INT) {
-        return std::to_string(w_int);
-    } else if (tag == Tag::FLOAT) {
-        return std::to_string(w_float);
-    } else if (tag == Tag::STRING) {
+    if (get_tag() == Tag::INT) {
+        return std::to_string(get_int());
+    } else if (get_tag() == Tag::FLOAT) {
+        return std::to_string(get_float());
+    } else if (get_tag() == Tag::STRING) {
         using namespace std::string_literals;
-        std::string string_value{w_str->str};
+        std::string string_value{get_string()->get_str()};
         std::string result{};
         auto is_escape = [](char ch) {
             switch (ch) {
@@ -59,30 +95,29 @@ std::string Value::repr() const noexcept {
             }
         }
         return "\""s + result + "\""s;
-    } else if (tag == Tag::BOOL) {
-        return w_bool ? "true" : "false";
-    } else if (tag == Tag::NULL_) {
+    } else if (get_tag() == Tag::BOOL) {
+        return get_bool() ? "true" : "false";
+    } else if (get_tag() == Tag::NULL_) {
         return "null";
-    } else if (tag == Tag::REF) {
+    } else if (get_tag() == Tag::REF) {
         char name[35];
-        std::sprintf(name, "ref to %p", reinterpret_cast<void *>(w_ref));
+        std::sprintf(name, "ref to %p", reinterpret_cast<void *>(get_ref()));
         return {name};
-    } else if (tag == Tag::FUNCTION) {
+    } else if (get_tag() == Tag::FUNCTION) {
         char addr[50];
-        std::sprintf(addr, " at %p>", reinterpret_cast<void *>(w_fun));
-        return "<function " + w_fun->name + addr;
-    } else if (tag == Tag::LIST || tag == Tag::LIST_REF) {
-        if (w_list == nullptr || w_list->empty()) {
-            return tag == Tag::LIST ? "[]" : "ref to []";
+        std::sprintf(addr, " at %p>", reinterpret_cast<void *>(get_function()));
+        return "<function " + get_function()->name + addr;
+    } else if (get_tag() == Tag::LIST || get_tag() == Tag::LIST_REF) {
+        if (get_list() == nullptr || get_list()->empty()) {
+            return get_tag() == Tag::LIST ? "[]" : "ref to []";
         }
-        std::string result = tag == Tag::LIST ? "[" : "ref to [";
-        auto begin = w_list->begin();
-        for (; begin != w_list->end() - 1; begin++) {
-            result += begin->repr() + ", ";
+        std::string result = get_tag() == Tag::LIST ? "[" : "ref to [";
+        for (std::size_t i = 0; i + 1 < get_list()->size(); i++) {
+            result += get_list()->get(i).repr() + ", ";
         }
-        result += begin->repr() + "]";
+        result += get_list()->get(get_list()->size() - 1).repr() + "]";
         return result;
-    } else if (tag == Tag::INVALID) {
+    } else if (get_tag() == Tag::INVALID) {
         return {"<invalid!>"};
     }
 
@@ -90,23 +125,23 @@ std::string Value::repr() const noexcept {
 }
 
 Value::operator bool() const noexcept {
-    if (tag == Tag::INT) {
-        return w_int != 0;
-    } else if (tag == Tag::FLOAT) {
-        return w_float != 0;
-    } else if (tag == Tag::STRING) {
-        return w_str != nullptr && w_str->str[0] != '\0';
-    } else if (tag == Tag::BOOL) {
-        return w_bool;
-    } else if (tag == Tag::NULL_) {
+    if (get_tag() == Tag::INT) {
+        return get_int() != 0;
+    } else if (get_tag() == Tag::FLOAT) {
+        return get_float() != 0;
+    } else if (get_tag() == Tag::STRING) {
+        return get_string() != nullptr && get_string()->get_str()[0] != '\0';
+    } else if (get_tag() == Tag::BOOL) {
+        return get_bool();
+    } else if (get_tag() == Tag::NULL_) {
         return false;
-    } else if (tag == Tag::REF) {
-        return (bool)(*w_ref);
-    } else if (tag == Tag::FUNCTION) {
+    } else if (get_tag() == Tag::REF) {
+        return (bool)(*get_ref());
+    } else if (get_tag() == Tag::FUNCTION) {
         return true;
-    } else if (tag == Tag::LIST || tag == Tag::LIST_REF) {
-        return not w_list->empty();
-    } else if (tag == Tag::INVALID) {
+    } else if (get_tag() == Tag::LIST || get_tag() == Tag::LIST_REF) {
+        return not get_list()->empty();
+    } else if (get_tag() == Tag::INVALID) {
         return false;
     }
 
@@ -114,38 +149,38 @@ Value::operator bool() const noexcept {
 }
 
 bool Value::operator==(const Value &other) const noexcept {
-    if (tag != Tag::REF && tag != other.tag) {
+    if (get_tag() != Tag::REF && get_tag() != other.get_tag()) {
         return false;
-    } else if (tag == Tag::INT) {
-        return w_int == other.w_int;
-    } else if (tag == Tag::FLOAT) {
-        return w_float == other.w_float;
-    } else if (tag == Tag::STRING) {
-        return *w_str == *other.w_str;
-    } else if (tag == Tag::BOOL) {
-        return w_bool == other.w_bool;
-    } else if (tag == Tag::NULL_) {
+    } else if (get_tag() == Tag::INT) {
+        return get_int() == other.get_int();
+    } else if (get_tag() == Tag::FLOAT) {
+        return get_float() == other.get_float();
+    } else if (get_tag() == Tag::STRING) {
+        return *get_string() == *other.get_string();
+    } else if (get_tag() == Tag::BOOL) {
+        return get_bool() == other.get_bool();
+    } else if (get_tag() == Tag::NULL_) {
         return true;
-    } else if (tag == Tag::REF) {
-        if (other.tag == Tag::REF) {
-            return (w_ref == other.w_ref) || (*w_ref == *other.w_ref);
+    } else if (get_tag() == Tag::REF) {
+        if (other.get_tag() == Tag::REF) {
+            return (get_ref() == other.get_ref()) || (*get_ref() == *other.get_ref());
         } else {
-            return *w_ref == other;
+            return *get_ref() == other;
         }
-    } else if (tag == Tag::FUNCTION) {
-        return w_fun == other.w_fun;
-    } else if (tag == Tag::LIST || tag == Tag::LIST_REF) {
-        if (w_list->size() != other.w_list->size()) {
+    } else if (get_tag() == Tag::FUNCTION) {
+        return get_function() == other.get_function();
+    } else if (get_tag() == Tag::LIST || get_tag() == Tag::LIST_REF) {
+        if (get_list()->size() != other.get_list()->size()) {
             return false;
         }
 
-        for (std::size_t i = 0; i < w_list->size(); i++) {
-            if (not((*w_list)[i] == (*other.w_list)[i])) {
+        for (std::size_t i = 0; i < get_list()->size(); i++) {
+            if (not(get_list()->get(i) == other.get_list()->get(i))) {
                 return false;
             }
         }
         return true;
-    } else if (tag == Tag::INVALID) {
+    } else if (get_tag() == Tag::INVALID) {
         return true;
     }
 
@@ -153,36 +188,36 @@ bool Value::operator==(const Value &other) const noexcept {
 }
 
 bool Value::operator<(const Value &other) const noexcept {
-    if (tag != Tag::REF && tag != other.tag) {
+    if (get_tag() != Tag::REF && get_tag() != other.get_tag()) {
         return false;
-    } else if (tag == Tag::INT) {
-        return w_int < other.w_int;
-    } else if (tag == Tag::FLOAT) {
-        return w_float < other.w_float;
-    } else if (tag == Tag::STRING) {
-        return w_str != other.w_str && *w_str < *other.w_str;
-    } else if (tag == Tag::BOOL) {
-        return w_bool == other.w_bool;
-    } else if (tag == Tag::NULL_) {
+    } else if (get_tag() == Tag::INT) {
+        return get_int() < other.get_int();
+    } else if (get_tag() == Tag::FLOAT) {
+        return get_float() < other.get_float();
+    } else if (get_tag() == Tag::STRING) {
+        return get_string() != other.get_string() && *get_string() < *other.get_string();
+    } else if (get_tag() == Tag::BOOL) {
+        return get_bool() == other.get_bool();
+    } else if (get_tag() == Tag::NULL_) {
         return true;
-    } else if (tag == Tag::REF) {
-        if (other.tag == Tag::REF) {
-            return w_ref != other.w_ref && *w_ref < *other.w_ref;
+    } else if (get_tag() == Tag::REF) {
+        if (other.get_tag() == Tag::REF) {
+            return get_ref() != other.get_ref() && *get_ref() < *other.get_ref();
         } else {
-            return *w_ref < other;
+            return *get_ref() < other;
         }
-    } else if (tag == Tag::LIST || tag == Tag::LIST_REF) {
-        if (w_list->size() != other.w_list->size()) {
-            return w_list->size() < other.w_list->size();
+    } else if (get_tag() == Tag::LIST || get_tag() == Tag::LIST_REF) {
+        if (get_list()->size() != other.get_list()->size()) {
+            return get_list()->size() < other.get_list()->size();
         }
 
-        for (std::size_t i = 0; i < w_list->size(); i++) {
-            if (not((*w_list)[i] < (*other.w_list)[i])) {
+        for (std::size_t i = 0; i < get_list()->size(); i++) {
+            if (not(get_list()->get(i) < other.get_list()->get(i))) {
                 return false;
             }
         }
         return true;
-    } else if (tag == Tag::INVALID) {
+    } else if (get_tag() == Tag::INVALID) {
         return false;
     }
 
@@ -190,38 +225,143 @@ bool Value::operator<(const Value &other) const noexcept {
 }
 
 bool Value::operator>(const Value &other) const noexcept {
-    if (tag != Tag::REF && tag != other.tag) {
+    if (get_tag() != Tag::REF && get_tag() != other.get_tag()) {
         return false;
-    } else if (tag == Tag::INT) {
-        return w_int > other.w_int;
-    } else if (tag == Tag::FLOAT) {
-        return w_float > other.w_float;
-    } else if (tag == Tag::STRING) {
-        return w_str != other.w_str && *w_str > *other.w_str;
-    } else if (tag == Tag::BOOL) {
-        return w_bool == other.w_bool;
-    } else if (tag == Tag::NULL_) {
+    } else if (get_tag() == Tag::INT) {
+        return get_int() > other.get_int();
+    } else if (get_tag() == Tag::FLOAT) {
+        return get_float() > other.get_float();
+    } else if (get_tag() == Tag::STRING) {
+        return get_string() != other.get_string() && *get_string() > *other.get_string();
+    } else if (get_tag() == Tag::BOOL) {
+        return get_bool() == other.get_bool();
+    } else if (get_tag() == Tag::NULL_) {
         return true;
-    } else if (tag == Tag::REF) {
-        if (other.tag == Tag::REF) {
-            return w_ref != other.w_ref && *w_ref > *other.w_ref;
+    } else if (get_tag() == Tag::REF) {
+        if (other.get_tag() == Tag::REF) {
+            return get_ref() != other.get_ref() && *get_ref() > *other.get_ref();
         } else {
-            return *w_ref > other;
+            return *get_ref() > other;
         }
-    } else if (tag == Tag::LIST || tag == Tag::LIST_REF) {
-        if (w_list->size() != other.w_list->size()) {
-            return w_list->size() > other.w_list->size();
+    } else if (get_tag() == Tag::LIST || get_tag() == Tag::LIST_REF) {
+        if (get_list()->size() != other.get_list()->size()) {
+            return get_list()->size() > other.get_list()->size();
         }
 
-        for (std::size_t i = 0; i < w_list->size(); i++) {
-            if (not((*w_list)[i] > (*other.w_list)[i])) {
+        for (std::size_t i = 0; i < get_list()->size(); i++) {
+            if (not(get_list()->get(i) > other.get_list()->get(i))) {
                 return false;
             }
         }
         return true;
-    } else if (tag == Tag::INVALID) {
+    } else if (get_tag() == Tag::INVALID) {
         return false;
     }
 
     unreachable();
-}
\ No newline at end of file
+}
+
+List::~List() {
+    release(elements, capacity, kind);
+}
+
+std::size_t List::element_size(Kind kind) noexcept {
+    switch (kind) {
+        case Kind::VALUE: return sizeof(Value);
+        case Kind::INT: return sizeof(Value::IntType);
+        case Kind::FLOAT: return sizeof(Value::FloatType);
+        case Kind::BOOL: return sizeof(std::uint8_t);
+    }
+    unreachable();
+}
+
+void List::reallocate(std::size_t new_capacity) {
+    std::size_t size = element_size(kind);
+    void *reallocated = static_cast<char *>(pool->allocate(header_size + new_capacity * size)) + header_size;
+    *reinterpret_cast<std::size_t *>(static_cast<char *>(reallocated) - header_size) = 1;
+    if (elements != nullptr) {
+        std::memcpy(reallocated, elements, length * size);
+        release(elements, capacity, kind);
+    }
+    elements = reallocated;
+    capacity = new_capacity;
+}
+
+void List::release(void *released, std::size_t released_capacity, Kind released_kind) noexcept {
+    if (released == nullptr) {
+        return;
+    }
+    char *header = static_cast<char *>(released) - header_size;
+    if (--*reinterpret_cast<std::size_t *>(header) == 0) {
+        pool->deallocate(header, header_size + released_capacity * element_size(released_kind));
+    }
+}
+
+void List::resize(std::size_t new_length) {
+    if (new_length > capacity) {
+        reallocate(std::max(new_length, capacity * 2));
+    }
+    if (new_length > length) {
+        if (kind == Kind::VALUE) {
+            std::fill(data<Value>() + length, data<Value>() + new_length, Value{});
+        } else {
+            std::memset(data<char>() + length * element_size(kind), 0, (new_length - length) * element_size(kind));
+        }
+    }
+    length = new_length;
+}
+
+void List::reserve(std::size_t new_capacity) {
+    if (new_capacity > capacity) {
+        reallocate(new_capacity);
+    }
+}
+
+void List::fill(Value value) noexcept {
+    switch (kind) {
+        case Kind::VALUE: std::fill(data<Value>(), data<Value>() + length, value); break;
+        case Kind::INT: std::fill(data<Value::IntType>(), data<Value::IntType>() + length, value.get_int()); break;
+        case Kind::FLOAT: std::fill(data<Value::FloatType>(), data<Value::FloatType>() + length, value.get_float()); break;
+        case Kind::BOOL: std::memset(elements, value.get_bool(), length); break;
+    }
+}
+
+void List::share(const List &other) noexcept {
+    elements = other.elements;
+    length = other.length;
+    capacity = other.capacity;
+    if (elements != nullptr) {
+        refcount()++;
+    }
+}
+
+void List::detach() {
+    // Only as much room as is used is taken, as the elements are copied again if the list grows
+    reallocate(std::max<std::size_t>(length, 1));
+}
+
+void List::unpack() {
+    if (kind == Kind::VALUE) {
+        return;
+    }
+
+    void *packed = std::exchange(elements, nullptr);
+    std::size_t packed_capacity = std::exchange(capacity, 0);
+    Kind packed_kind = std::exchange(kind, Kind::VALUE);
+    if (packed == nullptr) {
+        return;
+    }
+
+    if (length != 0) {
+        reallocate(length);
+        for (std::size_t i = 0; i < length; i++) {
+            switch (packed_kind) {
+                case Kind::INT: data<Value>()[i] = Value{static_cast<const Value::IntType *>(packed)[i]}; break;
+                case Kind::FLOAT: data<Value>()[i] = Value{static_cast<const Value::FloatType *>(packed)[i]}; break;
+                case Kind::BOOL: data<Value>()[i] = Value{static_cast<const std::uint8_t *>(packed)[i] != 0}; break;
+                case Kind::VALUE: break;
+            }
+        }
+    }
+    release(packed, packed_capacity, packed_kind);
+}
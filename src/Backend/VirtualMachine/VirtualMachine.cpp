@@ -6,20 +6,39 @@
 #include "nyx/Backend/VirtualMachine/Instructions.hpp"
 #include "nyx/Backend/VirtualMachine/StringCacher.hpp"
 #include "nyx/CLIConfigParser.hpp"
+#include "nyx/Common.hpp"
 #include "nyx/ErrorLogger/ErrorLogger.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <memory>
 #include <termcolor/termcolor.hpp>
 
 #define is (Chunk::InstructionSizeType)
 
-VirtualMachine::VirtualMachine()
-    : stack{std::make_unique<Value[]>(VirtualMachine::stack_size)},
-      frames{std::make_unique<CallFrame[]>(VirtualMachine::frame_size)},
-      modules{std::make_unique<ModuleFrame[]>(VirtualMachine::module_size)} {
-    for (const auto &[name, wrapper] : native_wrappers.get_all_natives()) {
-        natives[name] = wrapper->get_native();
+constexpr const char *call_depth_exceeded =
+    "Stack overflow: the maximum call depth was exceeded (see --" MAX_CALL_DEPTH ")";
+constexpr const char *value_stack_exceeded = "Stack overflow: the value stack is full (see --" MAX_STACK_SIZE ")";
+
+std::string CallFrame::get_name() const {
+    return function != nullptr ? function->name : "<" + module->name + ":tlc>";
+}
+
+VirtualMachine::VirtualMachine() {
+    for (const NativeWrapper *wrapper : native_wrappers.get_all_natives_by_id()) {
+        natives.push_back(wrapper->get_native());
+    }
+}
+
+VirtualMachine::~VirtualMachine() {
+    // Execution can stop part way through after an error, in which case the values still on the stack are freed here
+    for (std::size_t i = 0; i < stack_top; i++) {
+        if (stack[i].get_tag() == Value::Tag::STRING) {
+            cache.release(*stack[i].get_string());
+        } else if (stack[i].get_tag() == Value::Tag::LIST) {
+            destroy_list(stack[i].get_list());
+        }
     }
 }
 
@@ -34,8 +53,30 @@ void VirtualMachine::set_function_module_info(RuntimeModule *module, std::size_t
     }
 }
 
-Chunk::InstructionSizeType VirtualMachine::read_next() {
-    return *(ip++);
+bool VirtualMachine::has_stack_space(std::size_t from, const Chunk &chunk) const noexcept {
+    // No instruction pushes more than one value, so running a chunk never takes more slots than it has instructions
+    return from + chunk.decoded.size() <= max_stack_size;
+}
+
+void VirtualMachine::predecode(Chunk &chunk) {
+    chunk.decoded.clear();
+    chunk.decoded.reserve(chunk.bytes.size());
+    for (Chunk::InstructionSizeType bytes : chunk.bytes) {
+        Chunk::DecodedInstruction &decoded = chunk.decoded.emplace_back();
+        decoded.instruction = bytes >> 24;
+        decoded.operand = bytes & 0x00ff'ffff;
+#if THREADED_DISPATCH
+        decoded.handler = handlers[decoded.instruction];
+#endif
+    }
+}
+
+void VirtualMachine::predecode(RuntimeModule &module) {
+    predecode(module.top_level_code);
+    predecode(module.teardown_code);
+    for (auto &[name, function] : module.functions) {
+        predecode(function.code);
+    }
 }
 
 void VirtualMachine::push(Value value) noexcept {
@@ -47,29 +88,38 @@ void VirtualMachine::pop() noexcept {
 }
 
 std::size_t VirtualMachine::get_current_line() const noexcept {
-    return current_chunk->get_line_number(ip - &current_chunk->bytes[0] - 1);
+    return current_chunk->get_line_number(ip - &current_chunk->decoded[0] - 1);
 }
 
 void VirtualMachine::destroy_list(Value::ListType *list) {
-    for (auto &elem : *list) {
-        if (elem.tag == Value::Tag::STRING) {
-            cache.remove(*elem.w_str);
-        } else if (elem.tag == Value::Tag::LIST) {
-            destroy_list(elem.w_list);
+    // Elements which are shared with other lists are still owned by those
+    if (not list->is_packed() && not list->is_shared()) {
+        for (auto &elem : *list) {
+            if (elem.get_tag() == Value::Tag::STRING) {
+                cache.release(*elem.get_string());
+            } else if (elem.get_tag() == Value::Tag::LIST) {
+                destroy_list(elem.get_list());
+            }
         }
     }
-    delete list;
+    std::destroy_at(list);
+    list_pool.deallocate(list, sizeof(Value::ListType));
 }
 
-Value::ListType *VirtualMachine::make_new_list() {
-    return new Value::ListType;
+Value::ListType *VirtualMachine::make_new_list(List::Kind kind) {
+    return new (list_pool.allocate(sizeof(Value::ListType))) Value::ListType{&list_pool, kind};
 }
 
 Value VirtualMachine::copy(Value &value) {
-    if (value.tag == Value::Tag::LIST || value.tag == Value::Tag::LIST_REF) {
-        Value::ListType *new_list = make_new_list();
-        new_list->resize(value.w_list->size());
-        copy_into(new_list, value.w_list);
+    if (value.get_tag() == Value::Tag::LIST || value.get_tag() == Value::Tag::LIST_REF) {
+        Value::ListType *new_list = make_new_list(value.get_list()->get_kind());
+        if (not value.get_list()->is_pinned()) {
+            // The elements are only copied once either list is modified, see unshare_list()
+            new_list->share(*value.get_list());
+        } else {
+            new_list->resize(value.get_list()->size());
+            copy_into(new_list, value.get_list());
+        }
         return Value{new_list};
     } else {
         return value;
@@ -78,16 +128,76 @@ Value VirtualMachine::copy(Value &value) {
 
 void VirtualMachine::copy_into(Value::ListType *list, Value::ListType *what) {
     for (std::size_t i = 0; i < what->size(); i++) {
-        if ((*what)[i].tag == Value::Tag::LIST) {
+        if ((*what)[i].get_tag() == Value::Tag::LIST) {
             (*list)[i] = copy((*what)[i]);
-        } else if ((*what)[i].tag == Value::Tag::STRING) {
-            (*list)[i] = Value{&cache.insert(*(*what)[i].w_str)};
+        } else if ((*what)[i].get_tag() == Value::Tag::STRING) {
+            (*list)[i] = Value{&cache.retain(*(*what)[i].get_string())};
         } else {
             (*list)[i] = (*what)[i];
         }
     }
 }
 
+void VirtualMachine::unshare_list(Value::ListType *list) {
+    if (not list->is_shared()) {
+        return;
+    }
+    list->detach();
+    if (not list->is_packed()) {
+        for (Value &elem : *list) {
+            if (elem.get_tag() == Value::Tag::STRING) {
+                cache.retain(*elem.get_string());
+            } else if (elem.get_tag() == Value::Tag::LIST) {
+                elem = copy(elem);
+            }
+        }
+    }
+}
+
+Value VirtualMachine::access_element(Value::ListType *list, std::size_t index) {
+    if (list->is_packed()) {
+        return list->get(index);
+    }
+
+    if ((*list)[index].get_tag() == Value::Tag::LIST) {
+        // The inner list can be modified through the reference, so it has to belong to this list alone
+        unshare_list(list);
+        list->pin();
+        return Value::make_list_ref((*list)[index].get_list());
+    } else if ((*list)[index].get_tag() == Value::Tag::STRING) {
+        cache.retain(*(*list)[index].get_string());
+    }
+    return (*list)[index];
+}
+
+Value VirtualMachine::assign_element(Value::ListType *list, std::size_t index, Value assigned) {
+    unshare_list(list);
+    if (list->is_packed()) {
+        list->set(index, assigned);
+        return assigned;
+    }
+
+    Value &element = (*list)[index];
+    Value::Tag tag = element.get_tag();
+    if (tag == Value::Tag::LIST) {
+        destroy_list(element.get_list());
+    } else if (tag == Value::Tag::STRING) {
+        cache.release(*element.get_string());
+        cache.retain(*assigned.get_string());
+    }
+
+    if (tag == Value::Tag::REF) {
+        *element.get_ref() = assigned;
+    } else {
+        element = assigned;
+    }
+    if (tag == Value::Tag::LIST) {
+        list->pin();
+        return Value::make_list_ref(element.get_list());
+    }
+    return element;
+}
+
 void VirtualMachine::initialize_modules() {
     std::size_t i = 0;
     for (auto &module : ctx->compiled_modules) {
@@ -98,16 +208,19 @@ void VirtualMachine::initialize_modules() {
         }
 #endif
 
+        if (not has_stack_space(stack_top, module.top_level_code)) {
+            ctx->logger.runtime_error(value_stack_exceeded, module.top_level_code.get_line_number(0));
+            return;
+        }
+
         modules[module_top++] = {&stack[stack_top], module.name};
         current_module = &module;
         current_chunk = &module.top_level_code;
-        ip = &current_chunk->bytes[0];
+        ip = &current_chunk->decoded[0];
 
-        frames[frame_top++] =
-            CallFrame{&stack[stack_top], nullptr, nullptr, current_module, i++, "<" + current_module->name + ":tlc>"};
+        frames[frame_top++] = CallFrame{&stack[stack_top], nullptr, nullptr, current_module, i++, nullptr};
 
-        while (step() != ExecutionState::FINISHED)
-            ;
+        execute();
 
 #if !NO_TRACE_VM
         if (debug_print_module_init) {
@@ -130,10 +243,9 @@ void VirtualMachine::teardown_modules() {
 
         current_module = &ctx->compiled_modules[module_top - 1];
         current_chunk = &current_module->teardown_code;
-        ip = &current_chunk->bytes[0];
+        ip = &current_chunk->decoded[0];
 
-        while (step() != ExecutionState::FINISHED)
-            ;
+        execute();
 
         frame_top--;
         module_top--;
@@ -162,16 +274,19 @@ void VirtualMachine::run_function(RuntimeFunction &function) {
 #endif
 
     std::size_t function_frame = frame_top;
+    if (not has_stack_space(stack_top + function.arity + 1, function.code)) {
+        ctx->logger.runtime_error(value_stack_exceeded, function.code.get_line_number(0));
+        return;
+    }
 
     push(Value{nullptr});
 
     frames[frame_top++] = CallFrame{&stack[stack_top - (function.arity + 1)], current_chunk, ip, function.module,
-        function.module_index, function.name};
+        function.module_index, &function};
     current_chunk = &function.code;
-    ip = &function.code.bytes[0];
+    ip = &function.code.decoded[0];
 
-    while (frame_top > function_frame && step() != ExecutionState::FINISHED)
-        ;
+    execute(function_frame);
 
 #if !NO_TRACE_VM
     if (debug_print_module_init) {
@@ -183,16 +298,48 @@ void VirtualMachine::run_function(RuntimeFunction &function) {
     pop();
 }
 
+#if THREADED_DISPATCH
+const void *const *VirtualMachine::get_handlers() {
+    const void *const *table{};
+    execute(0, &table);
+    return table;
+}
+#endif
+
 void VirtualMachine::run(RuntimeModule &module) {
+#if THREADED_DISPATCH
+    handlers = get_handlers();
+#endif
+    // Entering a function or module checks that both stacks have room for it, so that running out of either is reported
+    // as a runtime error and pushes need no checks. The guard pages only catch what those checks miss
+    stack = GuardedStack<Value>{max_stack_size, value_stack_exceeded};
+    frames = GuardedStack<CallFrame>{max_call_depth, call_depth_exceeded};
+    modules.resize(ctx->compiled_modules.size() + 1);
+    cache.make_small_int_strings(small_int_strings);
+    constants = ctx->constants.values.data();
+
+    for (RuntimeModule &compiled : ctx->compiled_modules) {
+        predecode(compiled);
+    }
+    predecode(module);
+
     initialize_modules();
+    if (ctx->logger.had_runtime_error()) {
+        return;
+    }
+
+    if (not has_stack_space(stack_top, module.top_level_code)) {
+        ctx->logger.runtime_error(value_stack_exceeded, module.top_level_code.get_line_number(0));
+        return;
+    }
 
     modules[module_top++] = {&stack[stack_top], module.name};
     current_module = &module;
     current_chunk = &module.top_level_code;
-    ip = &current_chunk->bytes[0];
+    ip = &current_chunk->decoded[0];
 
-    frames[frame_top++] = CallFrame{
-        &stack[stack_top], nullptr, nullptr, current_module, ctx->compiled_modules.size(), "<" + module.name + ":tlc>"};
+    frames[frame_top++] =
+        CallFrame{&stack[stack_top], nullptr, nullptr, current_module, ctx->compiled_modules.size(), nullptr};
 
 #if !NO_TRACE_VM
     if (debug_print_module_init) {
@@ -201,8 +348,7 @@ void VirtualMachine::run(RuntimeModule &module) {
     }
 #endif
 
-    while (step() != ExecutionState::FINISHED)
-        ;
+    execute();
 
 #if !NO_TRACE_VM
     if (debug_print_module_init) {
@@ -211,13 +357,21 @@ void VirtualMachine::run(RuntimeModule &module) {
     }
 #endif
 
+    // The stacks are left as they were when the error occurred, which is not a state execution can continue from
+    if (ctx->logger.had_runtime_error()) {
+        return;
+    }
+
     if (ctx->main->functions.find("main") != ctx->main->functions.end()) {
         run_function(ctx->main->functions["main"]);
+        if (ctx->logger.had_runtime_error()) {
+            return;
+        }
     }
 
     current_module = &module;
     current_chunk = &current_module->teardown_code;
-    ip = &current_chunk->bytes[0];
+    ip = &current_chunk->decoded[0];
 
 #if !NO_TRACE_VM
     if (debug_print_module_init) {
@@ -226,8 +380,7 @@ void VirtualMachine::run(RuntimeModule &module) {
     }
 #endif
 
-    while (step() != ExecutionState::FINISHED)
-        ;
+    execute();
 
 #if !NO_TRACE_VM
     if (debug_print_module_init) {
@@ -238,27 +391,19 @@ void VirtualMachine::run(RuntimeModule &module) {
 
     module_top--;
     teardown_modules();
-}
 
-#define arith_binary_op(op, type, member)                                                                              \
-    {                                                                                                                  \
-        Value::type val2 = stack[--stack_top].member;                                                                  \
-        Value::type val1 = stack[stack_top - 1].member;                                                                \
-        stack[stack_top - 1].member = val1 op val2;                                                                    \
-    }                                                                                                                  \
-    break
-
-#define comp_binary_op(op)                                                                                             \
-    {                                                                                                                  \
-        Value val2 = stack[--stack_top];                                                                               \
-        Value val1 = stack[stack_top - 1];                                                                             \
-        stack[stack_top - 1].w_bool = (val1 op val2);                                                                  \
-        stack[stack_top - 1].tag = Value::Tag::BOOL;                                                                   \
-    }                                                                                                                  \
-    break
+    if (print_list_pool_stats) {
+        const ListPool::Statistics &statistics = list_pool.get_statistics();
+        std::size_t total = statistics.reused + statistics.carved + statistics.large;
+        std::cerr << "List pool: " << total << " allocations, " << statistics.reused << " reused ("
+                  << (total == 0 ? 0.0 : 100.0 * static_cast<double>(statistics.reused) / static_cast<double>(total))
+                  << "%), " << statistics.carved << " carved out of " << statistics.chunks << " chunks, "
+                  << statistics.large << " too large for the pool\n";
+    }
+}
 
-ExecutionState VirtualMachine::step() {
 #if !NO_TRACE_VM
+void VirtualMachine::trace_state() {
     if (debug_print_stack) {
         std::cout << pcife(termcolor::green) << "Stack   : ";
         for (Value *begin{&stack[0]}; begin < &stack[stack_top]; begin++) {
@@ -269,7 +414,7 @@ ExecutionState VirtualMachine::step() {
     if (debug_print_frames) {
         std::cout << pcife(termcolor::green) << "\nFrames  : ";
         for (CallFrame *begin{&frames[0]}; begin < &frames[frame_top]; begin++) {
-            std::cout << pcife(termcolor::blue) << "[ " << pcife(termcolor::red) << begin->name
+            std::cout << pcife(termcolor::blue) << "[ " << pcife(termcolor::red) << begin->get_name()
                       << pcife(termcolor::reset) << " : " << pcife(termcolor::cyan) << begin->stack
                       << pcife(termcolor::blue) << " ] ";
         }
@@ -288,532 +433,821 @@ ExecutionState VirtualMachine::step() {
 
     if (debug_print_instructions) {
         disassemble_instruction(
-            *current_chunk, static_cast<Instruction>(*ip >> 24), (ip - &current_chunk->bytes[0]), colors_enabled);
+            *current_chunk, static_cast<Instruction>(ip->instruction), (ip - &current_chunk->decoded[0]), colors_enabled);
     }
+}
 #endif
 
-    Chunk::InstructionSizeType next = read_next();
-    Chunk::InstructionSizeType instruction = next & 0xff00'0000;
-    Chunk::InstructionSizeType operand = next & 0x00ff'ffff;
-    switch (instruction >> 24) {
-        case is Instruction::HALT: return ExecutionState::FINISHED;
-        case is Instruction::POP: {
-            pop();
-            break;
-        }
-        /* Push constants onto stack */
-        case is Instruction::CONSTANT: {
-            push(current_chunk->constants[operand]);
-            break;
-        }
-        /* Integer operations */
-        case is Instruction::IADD: arith_binary_op(+, IntType, w_int);
-        case is Instruction::ISUB: arith_binary_op(-, IntType, w_int);
-        case is Instruction::IMUL: arith_binary_op(*, IntType, w_int);
-        case is Instruction::IMOD: {
-            if (stack[stack_top - 1].w_int == 0) {
-                ctx->logger.runtime_error("Cannot modulo by zero", get_current_line());
-                return ExecutionState::FINISHED;
+#define arith_binary_op(op, type, getter)                                                                              \
+    {                                                                                                                  \
+        Value::type val2 = stack[--stack_top].getter();                                                                \
+        Value::type val1 = stack[stack_top - 1].getter();                                                              \
+        stack[stack_top - 1] = Value{val1 op val2};                                                                    \
+    }                                                                                                                  \
+    DISPATCH()
+
+#define comp_binary_op(op)                                                                                             \
+    {                                                                                                                  \
+        Value val2 = stack[--stack_top];                                                                               \
+        Value val1 = stack[stack_top - 1];                                                                             \
+        stack[stack_top - 1] = Value{val1 op val2};                                                                    \
+    }                                                                                                                  \
+    DISPATCH()
+
+#define typed_comp_binary_op(op, type, getter)                                                                         \
+    {                                                                                                                  \
+        Value::type val2 = stack[--stack_top].getter();                                                                \
+        Value::type val1 = stack[stack_top - 1].getter();                                                              \
+        stack[stack_top - 1] = Value{val1 op val2};                                                                    \
+    }                                                                                                                  \
+    DISPATCH()
+
+#define check_call_depth()                                                                                             \
+    if (frame_top == max_call_depth) {                                                                                 \
+        ctx->logger.runtime_error(call_depth_exceeded, get_current_line());                                            \
+        return ExecutionState::FINISHED;                                                                               \
+    }
+
+#define check_stack_space(from, called)                                                                                \
+    if (not has_stack_space(from, (called)->code)) {                                                                   \
+        ctx->logger.runtime_error(value_stack_exceeded, get_current_line());                                           \
+        return ExecutionState::FINISHED;                                                                               \
+    }
+
+#if THREADED_DISPATCH
+// Taking the address of a label and computed gotos are GNU extensions
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+ExecutionState VirtualMachine::execute(std::size_t return_frame, const void *const **handler_table) {
+#if !NO_TRACE_VM
+    const bool tracing = debug_print_stack || debug_print_frames || debug_print_modules || debug_print_instructions;
+#define TRACE_EXECUTION()                                                                                              \
+    if (tracing) {                                                                                                     \
+        trace_state();                                                                                                 \
+    }
+#else
+#define TRACE_EXECUTION()
+#endif
+
+    Chunk::InstructionSizeType operand{};
+
+#if THREADED_DISPATCH
+    // One label per instruction, in the same order as the Instruction enum
+    static const void *dispatch_table[] = {
+        &&op_HALT, &&op_POP, &&op_CONSTANT, &&op_PUSH_INT_IMM, &&op_IADD, &&op_ISUB, &&op_IMUL, &&op_IDIV, &&op_IMOD,
+        &&op_INEG, &&op_IDIV_UNCHECKED, &&op_IMOD_UNCHECKED, &&op_FADD, &&op_FSUB, &&op_FMUL, &&op_FDIV, &&op_FMOD,
+        &&op_FNEG,
+        &&op_FLOAT_TO_INT, &&op_INT_TO_FLOAT, &&op_SHIFT_LEFT, &&op_SHIFT_RIGHT, &&op_SHIFT_LEFT_UNCHECKED,
+        &&op_SHIFT_RIGHT_UNCHECKED, &&op_BIT_AND, &&op_BIT_OR, &&op_BIT_NOT, &&op_BIT_XOR, &&op_NOT, &&op_EQUAL,
+        &&op_GREATER, &&op_LESSER, &&op_IEQUAL, &&op_IGREATER, &&op_ILESSER, &&op_FEQUAL, &&op_FGREATER, &&op_FLESSER,
+        &&op_PUSH_TRUE,
+        &&op_PUSH_FALSE, &&op_PUSH_NULL, &&op_JUMP_FORWARD, &&op_JUMP_BACKWARD, &&op_JUMP_IF_TRUE, &&op_JUMP_IF_FALSE,
+        &&op_POP_JUMP_IF_EQUAL, &&op_POP_JUMP_IF_FALSE, &&op_POP_JUMP_BACK_IF_TRUE, &&op_FOR_RANGE,
+        &&op_FOR_RANGE_INCLUSIVE, &&op_TABLE_SWITCH, &&op_LOOKUP_SWITCH, &&op_STRING_SWITCH, &&op_ASSIGN_LOCAL,
+        &&op_ACCESS_LOCAL, &&op_ASSIGN_LOCAL_SCALAR, &&op_ACCESS_LOCAL_SCALAR, &&op_MAKE_REF_TO_LOCAL, &&op_DEREF,
+        &&op_ASSIGN_GLOBAL, &&op_ACCESS_GLOBAL, &&op_ASSIGN_GLOBAL_SCALAR, &&op_ACCESS_GLOBAL_SCALAR,
+        &&op_MAKE_REF_TO_GLOBAL, &&op_LOAD_FUNCTION, &&op_CALL_FUNCTION, &&op_CALL_DIRECT, &&op_CALL_NATIVE,
+        &&op_RETURN, &&op_TRAP_RETURN, &&op_TAIL_CALL, &&op_STASH_ARGUMENTS, &&op_RESTORE_ARGUMENTS,
+        &&op_CONSTANT_STRING, &&op_INDEX_STRING, &&op_CHECK_STRING_INDEX, &&op_POP_STRING, &&op_CONCATENATE,
+        &&op_MAKE_LIST, &&op_MAKE_INT_LIST, &&op_MAKE_FLOAT_LIST, &&op_MAKE_BOOL_LIST, &&op_COPY_LIST,
+        &&op_APPEND_LIST, &&op_POP_FROM_LIST, &&op_ASSIGN_LIST, &&op_INDEX_LIST, &&op_MAKE_REF_TO_INDEX,
+        &&op_CHECK_LIST_INDEX, &&op_GET_FIELD, &&op_SET_FIELD, &&op_ACCESS_LOCAL_LIST, &&op_ACCESS_GLOBAL_LIST,
+        &&op_ASSIGN_LOCAL_LIST, &&op_ASSIGN_GLOBAL_LIST, &&op_POP_LIST, &&op_ACCESS_FROM_TOP, &&op_ASSIGN_FROM_TOP,
+        &&op_ASSIGN_FROM_TOP_SCALAR, &&op_EQUAL_SL, &&op_EQUAL_STRING, &&op_MOVE_LOCAL, &&op_MOVE_GLOBAL,
+        &&op_MOVE_INDEX, &&op_SWAP, &&op_INC_LOCAL, &&op_POP_N, &&op_LOCAL_LT_CONST_JUMP_BACK,
+    };
+    static_assert(sizeof(dispatch_table) / sizeof(dispatch_table[0]) ==
+                      static_cast<std::size_t>(Instruction::LOCAL_LT_CONST_JUMP_BACK) + 1,
+        "Every instruction needs an entry in the dispatch table");
+
+    if (handler_table != nullptr) {
+        *handler_table = dispatch_table;
+        return ExecutionState::FINISHED;
+    }
+
+#define TARGET(name) op_##name
+#define DISPATCH()                                                                                                     \
+    {                                                                                                                  \
+        TRACE_EXECUTION();                                                                                             \
+        operand = ip->operand;                                                                                         \
+        goto *(ip++)->handler;                                                                                         \
+    }
+
+    DISPATCH();
+    {
+#else
+    (void)handler_table;
+
+#define TARGET(name) case is Instruction::name
+#define DISPATCH() continue
+
+    while (true) {
+        TRACE_EXECUTION();
+        operand = ip->operand;
+        switch ((ip++)->instruction) {
+#endif
+            TARGET(HALT): return ExecutionState::FINISHED;
+            TARGET(POP): {
+                pop();
+                DISPATCH();
             }
-            arith_binary_op(%, IntType, w_int);
-        }
-        case is Instruction::IDIV: {
-            if (stack[stack_top - 1].w_int == 0) {
-                ctx->logger.runtime_error("Cannot divide by zero", get_current_line());
-                return ExecutionState::FINISHED;
+            /* Push constants onto stack */
+            TARGET(CONSTANT): {
+                push(constants[operand]);
+                DISPATCH();
             }
-            arith_binary_op(/, IntType, w_int);
-        }
-        case is Instruction::INEG: {
-            stack[stack_top - 1].w_int = -stack[stack_top - 1].w_int;
-            break;
-        }
-        /* Floating point operations */
-        case is Instruction::FADD: arith_binary_op(+, FloatType, w_float);
-        case is Instruction::FSUB: arith_binary_op(-, FloatType, w_float);
-        case is Instruction::FMUL: arith_binary_op(*, FloatType, w_float);
-        case is Instruction::FMOD: {
-            if (stack[stack_top - 1].w_float == 0.0) {
-                ctx->logger.runtime_error("Cannot modulo by zero", get_current_line());
-                return ExecutionState::FINISHED;
+            TARGET(PUSH_INT_IMM): {
+                push(Value{Chunk::decode_int_immediate(operand)});
+                DISPATCH();
             }
-            Value::FloatType val2 = stack[--stack_top].w_float;
-            Value::FloatType val1 = stack[stack_top - 1].w_float;
-            stack[stack_top - 1].w_float = std::fmod(val1, val2);
-            break;
-        }
-        case is Instruction::FDIV: {
-            if (stack[stack_top - 1].w_float == 0.0) {
-                ctx->logger.runtime_error("Cannot divide by zero", get_current_line());
-                return ExecutionState::FINISHED;
+            /* Integer operations */
+            TARGET(IADD): arith_binary_op(+, IntType, get_int);
+            TARGET(ISUB): arith_binary_op(-, IntType, get_int);
+            TARGET(IMUL): arith_binary_op(*, IntType, get_int);
+            TARGET(IMOD): {
+                if (stack[stack_top - 1].get_int() == 0) {
+                    ctx->logger.runtime_error("Cannot modulo by zero", get_current_line());
+                    return ExecutionState::FINISHED;
+                }
+                arith_binary_op(%, IntType, get_int);
             }
-            arith_binary_op(/, FloatType, w_float);
-        }
-        case is Instruction::FNEG: {
-            stack[stack_top - 1].w_float = -stack[stack_top - 1].w_float;
-            break;
-        }
-        /* Floating <-> integral conversions */
-        case is Instruction::FLOAT_TO_INT: {
-            stack[stack_top - 1].w_int = static_cast<Value::IntType>(stack[stack_top - 1].w_float);
-            stack[stack_top - 1].tag = Value::Tag::INT;
-            break;
-        }
-        case is Instruction::INT_TO_FLOAT: {
-            stack[stack_top - 1].w_float = static_cast<Value::FloatType>(stack[stack_top - 1].w_int);
-            stack[stack_top - 1].tag = Value::Tag::FLOAT;
-            break;
-        }
-        /* Bitwise operations */
-        case is Instruction::SHIFT_LEFT: {
-            if (stack[stack_top - 1].w_int < 0) {
-                ctx->logger.runtime_error("Cannot bitshift with value less than zero", get_current_line());
+            TARGET(IDIV): {
+                if (stack[stack_top - 1].get_int() == 0) {
+                    ctx->logger.runtime_error("Cannot divide by zero", get_current_line());
+                    return ExecutionState::FINISHED;
+                }
+                arith_binary_op(/, IntType, get_int);
             }
-            arith_binary_op(<<, IntType, w_int);
-        }
-        case is Instruction::SHIFT_RIGHT: {
-            if (stack[stack_top - 1].w_int < 0) {
-                ctx->logger.runtime_error("Cannot bitshift with value less than zero", get_current_line());
+            TARGET(INEG): {
+                stack[stack_top - 1] = Value{-stack[stack_top - 1].get_int()};
+                DISPATCH();
             }
-            arith_binary_op(>>, IntType, w_int);
-        }
-        case is Instruction::BIT_AND: arith_binary_op(&, IntType, w_int);
-        case is Instruction::BIT_OR: arith_binary_op(|, IntType, w_int);
-        case is Instruction::BIT_NOT: stack[stack_top - 1].w_int = ~stack[stack_top - 1].w_int; break;
-        case is Instruction::BIT_XOR: arith_binary_op(^, IntType, w_int);
-        /* Logical operations */
-        case is Instruction::NOT: {
-            stack[stack_top - 1].w_bool = not stack[stack_top - 1];
-            stack[stack_top - 1].tag = Value::Tag::BOOL;
-            break;
-        }
-        case is Instruction::EQUAL: comp_binary_op(==);
-        case is Instruction::GREATER: comp_binary_op(>);
-        case is Instruction::LESSER: comp_binary_op(<);
-        /* Constant operations */
-        case is Instruction::PUSH_TRUE: {
-            stack[stack_top].w_bool = true;
-            stack[stack_top++].tag = Value::Tag::BOOL;
-            break;
-        }
-        case is Instruction::PUSH_FALSE: {
-            stack[stack_top].w_bool = false;
-            stack[stack_top++].tag = Value::Tag::BOOL;
-            break;
-        }
-        case is Instruction::PUSH_NULL: {
-            stack[stack_top].w_null = nullptr;
-            stack[stack_top++].tag = Value::Tag::NULL_;
-            break;
-        }
-        /* Jump operations */
-        case is Instruction::JUMP_FORWARD: {
-            ip += operand;
-            break;
-        }
-        case is Instruction::JUMP_BACKWARD: {
-            ip -= operand;
-            break;
-        }
-        case is Instruction::JUMP_IF_TRUE: {
-            if (stack[stack_top - 1]) {
-                ip += operand;
+            TARGET(IDIV_UNCHECKED): arith_binary_op(/, IntType, get_int);
+            TARGET(IMOD_UNCHECKED): arith_binary_op(%, IntType, get_int);
+            /* Floating point operations */
+            TARGET(FADD): arith_binary_op(+, FloatType, get_float);
+            TARGET(FSUB): arith_binary_op(-, FloatType, get_float);
+            TARGET(FMUL): arith_binary_op(*, FloatType, get_float);
+            TARGET(FMOD): {
+                if (stack[stack_top - 1].get_float() == 0.0) {
+                    ctx->logger.runtime_error("Cannot modulo by zero", get_current_line());
+                    return ExecutionState::FINISHED;
+                }
+                Value::FloatType val2 = stack[--stack_top].get_float();
+                Value::FloatType val1 = stack[stack_top - 1].get_float();
+                stack[stack_top - 1] = Value{std::fmod(val1, val2)};
+                DISPATCH();
             }
-            break;
-        }
-        case is Instruction::JUMP_IF_FALSE: {
-            if (not stack[stack_top - 1]) {
-                ip += operand;
+            TARGET(FDIV): {
+                if (stack[stack_top - 1].get_float() == 0.0) {
+                    ctx->logger.runtime_error("Cannot divide by zero", get_current_line());
+                    return ExecutionState::FINISHED;
+                }
+                arith_binary_op(/, FloatType, get_float);
             }
-            break;
-        }
-        case is Instruction::POP_JUMP_IF_EQUAL: {
-            if (stack[stack_top - 2] == stack[stack_top - 1]) {
-                ip += operand;
-                stack_top--;
+            TARGET(FNEG): {
+                stack[stack_top - 1] = Value{-stack[stack_top - 1].get_float()};
+                DISPATCH();
             }
-            stack_top--;
-            break;
-        }
-        case is Instruction::POP_JUMP_IF_FALSE: {
-            if (not stack[--stack_top]) {
+            /* Floating <-> integral conversions */
+            TARGET(FLOAT_TO_INT): {
+                stack[stack_top - 1] = Value{static_cast<Value::IntType>(stack[stack_top - 1].get_float())};
+                DISPATCH();
+            }
+            TARGET(INT_TO_FLOAT): {
+                stack[stack_top - 1] = Value{static_cast<Value::FloatType>(stack[stack_top - 1].get_int())};
+                DISPATCH();
+            }
+            /* Bitwise operations */
+            TARGET(SHIFT_LEFT): {
+                if (stack[stack_top - 1].get_int() < 0) {
+                    ctx->logger.runtime_error("Cannot bitshift with value less than zero", get_current_line());
+                }
+                arith_binary_op(<<, IntType, get_int);
+            }
+            TARGET(SHIFT_RIGHT): {
+                if (stack[stack_top - 1].get_int() < 0) {
+                    ctx->logger.runtime_error("Cannot bitshift with value less than zero", get_current_line());
+                }
+                arith_binary_op(>>, IntType, get_int);
+            }
+            TARGET(SHIFT_LEFT_UNCHECKED): arith_binary_op(<<, IntType, get_int);
+            TARGET(SHIFT_RIGHT_UNCHECKED): arith_binary_op(>>, IntType, get_int);
+            TARGET(BIT_AND): arith_binary_op(&, IntType, get_int);
+            TARGET(BIT_OR): arith_binary_op(|, IntType, get_int);
+            TARGET(BIT_NOT): {
+                stack[stack_top - 1] = Value{~stack[stack_top - 1].get_int()};
+                DISPATCH();
+            }
+            TARGET(BIT_XOR): arith_binary_op(^, IntType, get_int);
+            /* Logical operations */
+            TARGET(NOT): {
+                stack[stack_top - 1] = Value{not stack[stack_top - 1]};
+                DISPATCH();
+            }
+            TARGET(EQUAL): comp_binary_op(==);
+            TARGET(GREATER): comp_binary_op(>);
+            TARGET(LESSER): comp_binary_op(<);
+            TARGET(IEQUAL): typed_comp_binary_op(==, IntType, get_int);
+            TARGET(IGREATER): typed_comp_binary_op(>, IntType, get_int);
+            TARGET(ILESSER): typed_comp_binary_op(<, IntType, get_int);
+            TARGET(FEQUAL): typed_comp_binary_op(==, FloatType, get_float);
+            TARGET(FGREATER): typed_comp_binary_op(>, FloatType, get_float);
+            TARGET(FLESSER): typed_comp_binary_op(<, FloatType, get_float);
+            /* Constant operations */
+            TARGET(PUSH_TRUE): {
+                push(Value{true});
+                DISPATCH();
+            }
+            TARGET(PUSH_FALSE): {
+                push(Value{false});
+                DISPATCH();
+            }
+            TARGET(PUSH_NULL): {
+                push(Value{nullptr});
+                DISPATCH();
+            }
+            /* Jump operations */
+            TARGET(JUMP_FORWARD): {
                 ip += operand;
+                DISPATCH();
             }
-            break;
-        }
-        case is Instruction::POP_JUMP_BACK_IF_TRUE: {
-            if (stack[--stack_top]) {
+            TARGET(JUMP_BACKWARD): {
                 ip -= operand;
+                DISPATCH();
             }
-            break;
-        }
-        /* Local variable operations */
-        case is Instruction::ASSIGN_LOCAL: {
-            Value *assigned = &frames[frame_top - 1].stack[operand];
-            if (assigned->tag == Value::Tag::REF) {
-                assigned = assigned->w_ref;
-            }
-            if (assigned->tag == Value::Tag::STRING) {
-                cache.remove(*assigned->w_str);
-                *assigned = Value{&cache.insert(*stack[stack_top - 1].w_str)};
-            } else {
-                *assigned = stack[stack_top - 1];
-            }
-            break;
-        }
-        case is Instruction::ACCESS_LOCAL: {
-            push(frames[frame_top - 1].stack[operand]);
-            if (stack[stack_top - 1].tag == Value::Tag::STRING) {
-                (void)cache.insert(*stack[stack_top - 1].w_str);
+            TARGET(JUMP_IF_TRUE): {
+                if (stack[stack_top - 1]) {
+                    ip += operand;
+                }
+                DISPATCH();
             }
-            break;
-        }
-        case is Instruction::MAKE_REF_TO_LOCAL: {
-            Value &value = frames[frame_top - 1].stack[operand];
-            if (value.tag == Value::Tag::LIST) {
-                push(Value{value.w_list});
-                stack[stack_top - 1].tag = Value::Tag::LIST_REF;
-            } else {
-                push(Value{&value});
-            }
-            break;
-        }
-        case is Instruction::DEREF: {
-            stack[stack_top - 1] = *stack[stack_top - 1].w_ref;
-            break;
-        }
-        /* Global variable operations */
-        case is Instruction::ASSIGN_GLOBAL: {
-            Value *assigned = &modules[frames[frame_top - 1].module_index].stack[operand];
-            if (assigned->tag == Value::Tag::REF) {
-                assigned = assigned->w_ref;
-            }
-            if (assigned->tag == Value::Tag::STRING) {
-                cache.remove(*assigned->w_str);
-                *assigned = Value{&cache.insert(*stack[stack_top - 1].w_str)};
-            } else {
-                *assigned = stack[stack_top - 1];
-            }
-            break;
-        }
-        case is Instruction::ACCESS_GLOBAL: {
-            push(Value{modules[frames[frame_top - 1].module_index].stack[operand]});
-            if (stack[stack_top - 1].tag == Value::Tag::STRING) {
-                (void)cache.insert(*stack[stack_top - 1].w_str);
+            TARGET(JUMP_IF_FALSE): {
+                if (not stack[stack_top - 1]) {
+                    ip += operand;
+                }
+                DISPATCH();
             }
-            break;
-        }
-        case is Instruction::MAKE_REF_TO_GLOBAL: {
-            Value &value = modules[frames[frame_top - 1].module_index].stack[operand];
-            if (value.tag == Value::Tag::LIST) {
-                push(Value{value.w_list});
-                stack[stack_top - 1].tag = Value::Tag::LIST_REF;
-            } else {
-                push(Value{&value});
-            }
-            break;
-        }
-        /* Function calls */
-        case is Instruction::LOAD_FUNCTION_SAME_MODULE: {
-            RuntimeFunction *function = &frames[frame_top - 1].module->functions[stack[stack_top - 1].w_str->str];
-            stack[stack_top - 1].w_fun = function;
-            stack[stack_top - 1].tag = Value::Tag::FUNCTION;
-            break;
-        }
-        case is Instruction::LOAD_FUNCTION_MODULE_INDEX: {
-            RuntimeFunction *function = &ctx->compiled_modules[operand].functions[stack[stack_top - 1].w_str->str];
-            stack[stack_top - 1].w_fun = function;
-            stack[stack_top - 1].tag = Value::Tag::FUNCTION;
-            break;
-        }
-        case is Instruction::LOAD_FUNCTION_MODULE_PATH: {
-            Value::StringType path = stack[--stack_top].w_str;
-            RuntimeFunction *function = &ctx->get_module_string(path->str)->functions[stack[stack_top - 1].w_str->str];
-            cache.remove(*path);
-            stack[stack_top - 1].w_fun = function;
-            stack[stack_top - 1].tag = Value::Tag::FUNCTION;
-            break;
-        }
-        case is Instruction::CALL_FUNCTION: {
-            RuntimeFunction *called = stack[--stack_top].w_fun;
-            frames[frame_top++] = CallFrame{&stack[stack_top - (called->arity + 1)], current_chunk, ip, called->module,
-                called->module_index, called->name};
-            current_chunk = &called->code;
-            ip = &called->code.bytes[0];
-            break;
-        }
-        case is Instruction::CALL_NATIVE: {
-            Native called = natives[stack[--stack_top].w_str->str];
-            cache.remove(*stack[stack_top].w_str);
-            Value result = called.code(*this, &stack[stack_top] - called.arity);
-            stack[stack_top - called.arity - 1] = result;
-            break;
-        }
-        case is Instruction::RETURN: {
-            ip = frames[frame_top - 1].return_ip;
-            current_chunk = frames[--frame_top].return_chunk;
-            break;
-        }
-        case is Instruction::TRAP_RETURN: {
-            ctx->logger.runtime_error("Reached end of non-null function", get_current_line());
-            return ExecutionState::FINISHED;
-        }
-        /* String instructions */
-        case is Instruction::CONSTANT_STRING: {
-            Value::StringType string = current_chunk->constants[operand].w_str;
-            push(Value{&cache.insert(*string)});
-            break;
-        }
-        case is Instruction::INDEX_STRING: {
-            Value &index = stack[--stack_top];
-            Value *string = &stack[stack_top - 1];
-            if (string->tag == Value::Tag::REF) {
-                string = string->w_ref;
-            }
-            Value temp = stack[stack_top - 1];
-            stack[stack_top - 1] = Value{&cache.insert({(string->w_str->str)[index.w_int]})};
-            if (temp.tag == Value::Tag::STRING) {
-                cache.remove(*temp.w_str);
-            }
-            break;
-        }
-        case is Instruction::CHECK_STRING_INDEX: {
-            Value &index = stack[stack_top - 1];
-            Value *string = &stack[stack_top - 2];
-            if (string->tag == Value::Tag::REF) {
-                string = string->w_ref;
-            }
-            if (index.w_int > static_cast<int>(string->w_str->str.size())) {
-                ctx->logger.runtime_error("String index out of range", get_current_line());
-                return ExecutionState::FINISHED;
+            TARGET(POP_JUMP_IF_EQUAL): {
+                if (stack[stack_top - 2] == stack[stack_top - 1]) {
+                    ip += operand;
+                    stack_top--;
+                }
+                stack_top--;
+                DISPATCH();
             }
-            break;
-        }
-        case is Instruction::POP_STRING: {
-            cache.remove(*stack[--stack_top].w_str);
-            break;
-        }
-        case is Instruction::CONCATENATE: {
-            Value::StringType val2 = stack[--stack_top].w_str;
-            Value::StringType val1 = stack[stack_top - 1].w_str;
-            stack[stack_top - 1].w_str = &cache.concat(*val1, *val2);
-            cache.remove(*val1);
-            cache.remove(*val2);
-            break;
-        }
-        /* List instructions */
-        case is Instruction::MAKE_LIST: {
-            push(Value{make_new_list()});
-            if (operand != 0) {
-                stack[stack_top - 1].w_list->resize(operand);
+            TARGET(POP_JUMP_IF_FALSE): {
+                if (not stack[--stack_top]) {
+                    ip += operand;
+                }
+                DISPATCH();
             }
-            break;
-        }
-        case is Instruction::COPY_LIST: {
-            // COPY_LIST is a no-op for temporary lists, i.e those not bound to names
-            if (stack[stack_top - 1].tag == Value::Tag::LIST_REF) {
-                stack[stack_top - 1] = copy(stack[stack_top - 1]);
-                stack[stack_top - 1].tag = Value::Tag::LIST;
+            TARGET(POP_JUMP_BACK_IF_TRUE): {
+                if (stack[--stack_top]) {
+                    ip -= operand;
+                }
+                DISPATCH();
             }
-            break;
-        }
-        case is Instruction::APPEND_LIST: {
-            Value &appended = stack[--stack_top];
-            Value &list = stack[stack_top - 1];
-            list.w_list->push_back(appended);
-            break;
-        }
-        case is Instruction::POP_FROM_LIST: {
-            Value &how_many = stack[--stack_top];
-            Value &list = stack[stack_top - 1];
-            if (static_cast<Value::IntType>(list.w_list->size()) < how_many.w_int) {
-                ctx->logger.runtime_error("Trying to pop from empty list", get_current_line());
-                return ExecutionState::FINISHED;
+            TARGET(FOR_RANGE): {
+                Value &counter = frames[frame_top - 1].stack[operand];
+                Value::IntType end = frames[frame_top - 1].stack[(ip++)->operand].get_int();
+                Chunk::InstructionSizeType offset = (ip++)->operand;
+                counter = Value{counter.get_int() + 1};
+                if (counter.get_int() < end) {
+                    ip -= offset;
+                }
+                DISPATCH();
             }
-            for (Value::IntType i = 0; i < how_many.w_int; i++) {
-                if (list.w_list->back().tag == Value::Tag::LIST) {
-                    destroy_list(list.w_list->back().w_list);
-                } else if (list.w_list->back().tag == Value::Tag::STRING) {
-                    cache.remove(*list.w_list->back().w_str);
+            TARGET(FOR_RANGE_INCLUSIVE): {
+                // Checking before incrementing means that a range ending at the largest int does not overflow
+                Value &counter = frames[frame_top - 1].stack[operand];
+                Value::IntType end = frames[frame_top - 1].stack[(ip++)->operand].get_int();
+                Chunk::InstructionSizeType offset = (ip++)->operand;
+                if (counter.get_int() < end) {
+                    counter = Value{counter.get_int() + 1};
+                    ip -= offset;
                 }
-                list.w_list->pop_back();
+                DISPATCH();
             }
-            break;
-        }
-        case is Instruction::ASSIGN_LIST: {
-            Value &assigned = stack[--stack_top];
-            Value &index = stack[--stack_top];
-            Value &list = stack[stack_top - 1];
-            Value::Tag tag = (*list.w_list)[index.w_int].tag;
-            if (tag == Value::Tag::LIST) {
-                destroy_list((*list.w_list)[index.w_int].w_list);
-            } else if (tag == Value::Tag::STRING) {
-                cache.remove(*(*list.w_list)[index.w_int].w_str);
-                (void)cache.insert(*assigned.w_str);
-            }
-
-            if (tag == Value::Tag::REF) {
-                *(*list.w_list)[index.w_int].w_ref = assigned;
-            } else {
-                (*list.w_list)[index.w_int] = assigned;
-            }
-            stack[stack_top - 1] = (*list.w_list)[index.w_int];
-            if (tag == Value::Tag::LIST) {
-                stack[stack_top - 1].tag = Value::Tag::LIST_REF;
-            }
-            break;
-        }
-        case is Instruction::INDEX_LIST: {
-            Value &index = stack[--stack_top];
-            Value &list = stack[stack_top - 1];
-            stack[stack_top - 1] = (*list.w_list)[index.w_int];
-            if (stack[stack_top - 1].tag == Value::Tag::STRING) {
-                (void)cache.insert(*stack[stack_top - 1].w_str);
-            } else if (stack[stack_top - 1].tag == Value::Tag::LIST) {
-                stack[stack_top - 1].tag = Value::Tag::LIST_REF;
-            }
-            break;
-        }
-        case is Instruction::MAKE_REF_TO_INDEX: {
-            Value &index = stack[--stack_top];
-            Value &list = stack[stack_top - 1];
-            if ((*list.w_list)[index.w_int].tag == Value::Tag::LIST) {
-                stack[stack_top - 1] = (*list.w_list)[index.w_int];
-                stack[stack_top - 1].tag = Value::Tag::LIST_REF;
-            } else {
-                stack[stack_top - 1] = Value{&(*list.w_list)[index.w_int]};
-            }
-            break;
-        }
-        case is Instruction::CHECK_LIST_INDEX: {
-            Value &index = stack[stack_top - 1];
-            Value &list = stack[stack_top - 2];
-            if (index.w_int > static_cast<int>(list.w_list->size())) {
-                ctx->logger.runtime_error("List index out of range", get_current_line());
+            TARGET(TABLE_SWITCH): {
+                const Chunk::SwitchTable &table = current_chunk->switch_tables[operand];
+                // Widened so that subtracting the lowest case cannot overflow
+                std::int64_t entry = std::int64_t{stack[--stack_top].get_int()} - table.low;
+                if (entry >= 0 && entry < static_cast<std::int64_t>(table.offsets.size())) {
+                    ip += table.offsets[entry];
+                } else {
+                    ip += table.default_offset;
+                }
+                DISPATCH();
+            }
+            TARGET(LOOKUP_SWITCH): {
+                const Chunk::SwitchTable &table = current_chunk->switch_tables[operand];
+                Value::IntType value = stack[--stack_top].get_int();
+                auto key = std::lower_bound(table.keys.begin(), table.keys.end(), value);
+                if (key != table.keys.end() && *key == value) {
+                    ip += table.offsets[key - table.keys.begin()];
+                } else {
+                    ip += table.default_offset;
+                }
+                DISPATCH();
+            }
+            TARGET(STRING_SWITCH): {
+                const Chunk::SwitchTable &table = current_chunk->switch_tables[operand];
+                Value::StringType string = stack[--stack_top].get_string();
+                std::size_t hash = string->get_hash();
+                auto entry = std::lower_bound(table.strings.begin(), table.strings.end(), hash,
+                    [](const std::pair<std::size_t, std::string> &string, std::size_t hash) {
+                        return string.first < hash;
+                    });
+                Chunk::InstructionSizeType offset = table.default_offset;
+                for (; entry != table.strings.end() && entry->first == hash; entry++) {
+                    if (*string == entry->second) {
+                        offset = table.offsets[entry - table.strings.begin()];
+                        break;
+                    }
+                }
+                cache.release(*string);
+                ip += offset;
+                DISPATCH();
+            }
+            /* Local variable operations */
+            TARGET(ASSIGN_LOCAL): {
+                Value *assigned = &frames[frame_top - 1].stack[operand];
+                if (assigned->get_tag() == Value::Tag::REF) {
+                    assigned = assigned->get_ref();
+                }
+                if (assigned->get_tag() == Value::Tag::STRING) {
+                    cache.release(*assigned->get_string());
+                    *assigned = Value{&cache.retain(*stack[stack_top - 1].get_string())};
+                } else {
+                    *assigned = stack[stack_top - 1];
+                }
+                DISPATCH();
+            }
+            TARGET(ACCESS_LOCAL): {
+                push(frames[frame_top - 1].stack[operand]);
+                if (stack[stack_top - 1].get_tag() == Value::Tag::STRING) {
+                    cache.retain(*stack[stack_top - 1].get_string());
+                }
+                DISPATCH();
+            }
+            TARGET(ASSIGN_LOCAL_SCALAR): {
+                frames[frame_top - 1].stack[operand] = stack[stack_top - 1];
+                DISPATCH();
+            }
+            TARGET(ACCESS_LOCAL_SCALAR): {
+                push(frames[frame_top - 1].stack[operand]);
+                DISPATCH();
+            }
+            TARGET(MAKE_REF_TO_LOCAL): {
+                Value &value = frames[frame_top - 1].stack[operand];
+                if (value.get_tag() == Value::Tag::LIST) {
+                    push(Value::make_list_ref(value.get_list()));
+                } else {
+                    push(Value{&value});
+                }
+                DISPATCH();
+            }
+            TARGET(DEREF): {
+                stack[stack_top - 1] = *stack[stack_top - 1].get_ref();
+                // The string is now owned by whatever consumes it, the same as after an ACCESS_LOCAL
+                if (stack[stack_top - 1].get_tag() == Value::Tag::STRING) {
+                    cache.retain(*stack[stack_top - 1].get_string());
+                }
+                DISPATCH();
+            }
+            /* Global variable operations */
+            TARGET(ASSIGN_GLOBAL): {
+                Value *assigned = &modules[frames[frame_top - 1].module_index].stack[operand];
+                if (assigned->get_tag() == Value::Tag::REF) {
+                    assigned = assigned->get_ref();
+                }
+                if (assigned->get_tag() == Value::Tag::STRING) {
+                    cache.release(*assigned->get_string());
+                    *assigned = Value{&cache.retain(*stack[stack_top - 1].get_string())};
+                } else {
+                    *assigned = stack[stack_top - 1];
+                }
+                DISPATCH();
+            }
+            TARGET(ACCESS_GLOBAL): {
+                push(Value{modules[frames[frame_top - 1].module_index].stack[operand]});
+                if (stack[stack_top - 1].get_tag() == Value::Tag::STRING) {
+                    cache.retain(*stack[stack_top - 1].get_string());
+                }
+                DISPATCH();
+            }
+            TARGET(ASSIGN_GLOBAL_SCALAR): {
+                modules[frames[frame_top - 1].module_index].stack[operand] = stack[stack_top - 1];
+                DISPATCH();
+            }
+            TARGET(ACCESS_GLOBAL_SCALAR): {
+                push(modules[frames[frame_top - 1].module_index].stack[operand]);
+                DISPATCH();
+            }
+            TARGET(MAKE_REF_TO_GLOBAL): {
+                Value &value = modules[frames[frame_top - 1].module_index].stack[operand];
+                if (value.get_tag() == Value::Tag::LIST) {
+                    push(Value::make_list_ref(value.get_list()));
+                } else {
+                    push(Value{&value});
+                }
+                DISPATCH();
+            }
+            /* Function calls */
+            TARGET(LOAD_FUNCTION): {
+                push(Value{ctx->functions[operand]});
+                DISPATCH();
+            }
+            TARGET(CALL_FUNCTION): {
+                RuntimeFunction *called = stack[--stack_top].get_function();
+                check_call_depth();
+                check_stack_space(stack_top, called);
+                frames[frame_top++] = CallFrame{&stack[stack_top - (called->arity + 1)], current_chunk, ip, called->module,
+                    called->module_index, called};
+                current_chunk = &called->code;
+                ip = &called->code.decoded[0];
+                DISPATCH();
+            }
+            TARGET(CALL_DIRECT): {
+                RuntimeFunction *called = ctx->functions[operand];
+                check_call_depth();
+                check_stack_space(stack_top, called);
+                frames[frame_top++] = CallFrame{&stack[stack_top - (called->arity + 1)], current_chunk, ip, called->module,
+                    called->module_index, called};
+                current_chunk = &called->code;
+                ip = &called->code.decoded[0];
+                DISPATCH();
+            }
+            TARGET(CALL_NATIVE): {
+                // Bound by reference: computed gotos do not run destructors for locals when leaving a handler
+                const Native &called = natives[operand];
+                Value result = called.code(*this, &stack[stack_top] - called.arity);
+                stack[stack_top - called.arity - 1] = result;
+                DISPATCH();
+            }
+            TARGET(RETURN): {
+                ip = frames[frame_top - 1].return_ip;
+                current_chunk = frames[--frame_top].return_chunk;
+                if (frame_top == return_frame) {
+                    return ExecutionState::RUNNING;
+                }
+                DISPATCH();
+            }
+            TARGET(TRAP_RETURN): {
+                ctx->logger.runtime_error("Reached end of non-null function", get_current_line());
                 return ExecutionState::FINISHED;
             }
-            break;
-        }
-        case is Instruction::ACCESS_LOCAL_LIST: {
-            push(frames[frame_top - 1].stack[operand]);
-            stack[stack_top - 1].tag = Value::Tag::LIST_REF;
-            break;
-        }
-        case is Instruction::ACCESS_GLOBAL_LIST: {
-            push(modules[frames[frame_top - 1].module_index].stack[operand]);
-            stack[stack_top - 1].tag = Value::Tag::LIST_REF;
-            break;
-        }
-        case is Instruction::ASSIGN_LOCAL_LIST: {
-            Value &assigned = frames[frame_top - 1].stack[operand];
-            if (assigned.w_list != nullptr) {
-                destroy_list(assigned.w_list);
-            }
-            if (assigned.tag == Value::Tag::REF) {
-                *assigned.w_ref = stack[stack_top - 1];
-            } else {
-                assigned = stack[stack_top - 1];
-            }
-            stack[stack_top - 1].tag = Value::Tag::LIST_REF;
-            break;
-        }
-        case is Instruction::ASSIGN_GLOBAL_LIST: {
-            Value &assigned = modules[frames[frame_top - 1].module_index].stack[operand];
-            if (assigned.w_list != nullptr) {
-                destroy_list(assigned.w_list);
-            }
-            if (assigned.tag == Value::Tag::REF) {
-                *assigned.w_ref = stack[stack_top - 1];
-            } else {
-                assigned = stack[stack_top - 1];
-            }
-            stack[stack_top - 1].tag = Value::Tag::LIST_REF;
-            break;
-        }
-        case is Instruction::POP_LIST: {
-            if (stack[stack_top - 1].tag == Value::Tag::LIST) {
-                destroy_list(stack[--stack_top].w_list);
-            } else if (stack[stack_top - 1].tag == Value::Tag::LIST_REF ||
-                       stack[stack_top - 1].tag == Value::Tag::NULL_) {
-                stack_top--;
+            TARGET(TAIL_CALL): {
+                RuntimeFunction *called = ctx->functions[operand];
+                CallFrame &frame = frames[frame_top - 1];
+                check_stack_space(static_cast<std::size_t>(frame.stack - stack.get()) + called->arity + 1, called);
+                // The arguments always lie above the slots they are moved into, so a forward copy is safe
+                std::copy(&stack[stack_top - called->arity], &stack[stack_top], frame.stack + 1);
+                stack_top = static_cast<std::size_t>(frame.stack - stack.get()) + called->arity + 1;
+                frame.module = called->module;
+                frame.module_index = called->module_index;
+                frame.function = called;
+                current_chunk = &called->code;
+                ip = &called->code.decoded[0];
+                DISPATCH();
             }
-            break;
-        }
-        /* Miscellaneous */
-        case is Instruction::ACCESS_FROM_TOP: {
-            push(stack[stack_top - operand]);
-            break;
-        }
-        case is Instruction::ASSIGN_FROM_TOP: {
-            Value *assigned = &stack[stack_top - operand];
-            if (assigned->tag == Value::Tag::REF) {
-                assigned = assigned->w_ref;
-            }
-            if (assigned->tag == Value::Tag::STRING) {
-                cache.remove(*assigned->w_str);
-                *assigned = Value{&cache.insert(*stack[stack_top - 1].w_str)};
-            } else {
-                *assigned = stack[stack_top - 1];
-            }
-            break;
-        }
-        case is Instruction::EQUAL_SL: {
-            Value val2 = stack[--stack_top];
-            Value val1 = stack[stack_top - 1];
-            bool result = val1 == val2;
-            if (val1.tag == Value::Tag::STRING) {
-                cache.remove(*val2.w_str);
-                cache.remove(*val1.w_str);
-            }
-            if (val1.tag == Value::Tag::LIST) {
-                destroy_list(val1.w_list);
-            }
-            if (val2.tag == Value::Tag::LIST) {
-                destroy_list(val2.w_list);
-            }
-            stack[stack_top - 1] = Value{result};
-            break;
-        }
-        /* Move instructions */
-        case is Instruction::MOVE_LOCAL: {
-            Value &moved = frames[frame_top - 1].stack[operand];
-            stack[stack_top] = moved;
-            stack[stack_top++].tag = Value::Tag::LIST;
-            moved = Value{Value::NullType{}};
-            break;
-        }
-        case is Instruction::MOVE_GLOBAL: {
-            Value &moved = modules[frames[frame_top - 1].module_index].stack[operand];
-            stack[stack_top++] = moved;
-            moved = Value{Value::NullType{}};
-            break;
-        }
-        case is Instruction::MOVE_INDEX: {
-            Value::IntType index = stack[--stack_top].w_int;
-            Value::ListType &list = *stack[stack_top - 1].w_list;
-            stack[stack_top - 1] = list[index];
-            list[index] = Value{Value::NullType{}};
-            break;
-        }
-        /* Swap instructions */
-        case is Instruction::SWAP: {
-            Value first = stack[stack_top - operand];
-            Value second = stack[stack_top - operand - 1];
-            stack[stack_top - operand - 1] = first;
-            stack[stack_top - operand] = second;
-            break;
+            TARGET(STASH_ARGUMENTS): {
+                stashed_arguments.insert(stashed_arguments.end(), &stack[stack_top - operand], &stack[stack_top]);
+                stack_top -= operand;
+                DISPATCH();
+            }
+            TARGET(RESTORE_ARGUMENTS): {
+                std::copy(stashed_arguments.end() - operand, stashed_arguments.end(), &stack[stack_top]);
+                stashed_arguments.resize(stashed_arguments.size() - operand);
+                stack_top += operand;
+                DISPATCH();
+            }
+            /* String instructions */
+            TARGET(CONSTANT_STRING): {
+                Value::StringType string = constants[operand].get_string();
+                push(Value{&cache.retain(*string)});
+                DISPATCH();
+            }
+            TARGET(INDEX_STRING): {
+                Value &index = stack[--stack_top];
+                Value *string = &stack[stack_top - 1];
+                if (string->get_tag() == Value::Tag::REF) {
+                    string = string->get_ref();
+                }
+                Value temp = stack[stack_top - 1];
+                stack[stack_top - 1] = Value{&cache.character(string->get_string()->get_str()[index.get_int()])};
+                if (temp.get_tag() == Value::Tag::STRING) {
+                    cache.release(*temp.get_string());
+                }
+                DISPATCH();
+            }
+            TARGET(CHECK_STRING_INDEX): {
+                Value &index = stack[stack_top - 1];
+                Value *string = &stack[stack_top - 2];
+                if (string->get_tag() == Value::Tag::REF) {
+                    string = string->get_ref();
+                }
+                if (index.get_int() > static_cast<int>(string->get_string()->size())) {
+                    ctx->logger.runtime_error("String index out of range", get_current_line());
+                    return ExecutionState::FINISHED;
+                }
+                DISPATCH();
+            }
+            TARGET(POP_STRING): {
+                cache.release(*stack[--stack_top].get_string());
+                DISPATCH();
+            }
+            TARGET(CONCATENATE): {
+                Value::StringType val2 = stack[--stack_top].get_string();
+                Value::StringType val1 = stack[stack_top - 1].get_string();
+                stack[stack_top - 1] = Value{&cache.concat(*val1, *val2)};
+                cache.release(*val1);
+                cache.release(*val2);
+                DISPATCH();
+            }
+            /* List instructions */
+            TARGET(MAKE_LIST): {
+                push(Value{make_new_list()});
+                if (operand != 0) {
+                    stack[stack_top - 1].get_list()->resize(operand);
+                }
+                DISPATCH();
+            }
+            TARGET(MAKE_INT_LIST): {
+                push(Value{make_new_list(List::Kind::INT)});
+                if (operand != 0) {
+                    stack[stack_top - 1].get_list()->resize(operand);
+                }
+                DISPATCH();
+            }
+            TARGET(MAKE_FLOAT_LIST): {
+                push(Value{make_new_list(List::Kind::FLOAT)});
+                if (operand != 0) {
+                    stack[stack_top - 1].get_list()->resize(operand);
+                }
+                DISPATCH();
+            }
+            TARGET(MAKE_BOOL_LIST): {
+                push(Value{make_new_list(List::Kind::BOOL)});
+                if (operand != 0) {
+                    stack[stack_top - 1].get_list()->resize(operand);
+                }
+                DISPATCH();
+            }
+            TARGET(COPY_LIST): {
+                // COPY_LIST is a no-op for temporary lists, i.e those not bound to names
+                if (stack[stack_top - 1].get_tag() == Value::Tag::LIST_REF) {
+                    stack[stack_top - 1] = copy(stack[stack_top - 1]);
+                }
+                DISPATCH();
+            }
+            TARGET(APPEND_LIST): {
+                Value &appended = stack[--stack_top];
+                Value &list = stack[stack_top - 1];
+                unshare_list(list.get_list());
+                list.get_list()->push_back(appended);
+                DISPATCH();
+            }
+            TARGET(POP_FROM_LIST): {
+                Value &how_many = stack[--stack_top];
+                Value &list = stack[stack_top - 1];
+                if (static_cast<Value::IntType>(list.get_list()->size()) < how_many.get_int()) {
+                    ctx->logger.runtime_error("Trying to pop from empty list", get_current_line());
+                    return ExecutionState::FINISHED;
+                }
+                unshare_list(list.get_list());
+                for (Value::IntType i = 0; i < how_many.get_int(); i++) {
+                    if (not list.get_list()->is_packed()) {
+                        if (list.get_list()->back().get_tag() == Value::Tag::LIST) {
+                            destroy_list(list.get_list()->back().get_list());
+                        } else if (list.get_list()->back().get_tag() == Value::Tag::STRING) {
+                            cache.release(*list.get_list()->back().get_string());
+                        }
+                    }
+                    list.get_list()->pop_back();
+                }
+                DISPATCH();
+            }
+            TARGET(ASSIGN_LIST): {
+                Value &assigned = stack[--stack_top];
+                Value &index = stack[--stack_top];
+                stack[stack_top - 1] = assign_element(stack[stack_top - 1].get_list(), index.get_int(), assigned);
+                DISPATCH();
+            }
+            TARGET(INDEX_LIST): {
+                Value &index = stack[--stack_top];
+                stack[stack_top - 1] = access_element(stack[stack_top - 1].get_list(), index.get_int());
+                DISPATCH();
+            }
+            TARGET(MAKE_REF_TO_INDEX): {
+                Value &index = stack[--stack_top];
+                Value &list = stack[stack_top - 1];
+                unshare_list(list.get_list());
+                list.get_list()->unpack(); // A reference has to point to a Value
+                list.get_list()->pin();
+                if ((*list.get_list())[index.get_int()].get_tag() == Value::Tag::LIST) {
+                    stack[stack_top - 1] = Value::make_list_ref((*list.get_list())[index.get_int()].get_list());
+                } else {
+                    stack[stack_top - 1] = Value{&(*list.get_list())[index.get_int()]};
+                }
+                DISPATCH();
+            }
+            TARGET(CHECK_LIST_INDEX): {
+                Value &index = stack[stack_top - 1];
+                Value &list = stack[stack_top - 2];
+                if (index.get_int() > static_cast<int>(list.get_list()->size())) {
+                    ctx->logger.runtime_error("List index out of range", get_current_line());
+                    return ExecutionState::FINISHED;
+                }
+                DISPATCH();
+            }
+            TARGET(GET_FIELD): {
+                stack[stack_top - 1] = access_element(stack[stack_top - 1].get_list(), operand);
+                DISPATCH();
+            }
+            TARGET(SET_FIELD): {
+                Value &assigned = stack[--stack_top];
+                stack[stack_top - 1] = assign_element(stack[stack_top - 1].get_list(), operand, assigned);
+                DISPATCH();
+            }
+            TARGET(ACCESS_LOCAL_LIST): {
+                push(Value::make_list_ref(frames[frame_top - 1].stack[operand].get_list()));
+                DISPATCH();
+            }
+            TARGET(ACCESS_GLOBAL_LIST): {
+                push(Value::make_list_ref(modules[frames[frame_top - 1].module_index].stack[operand].get_list()));
+                DISPATCH();
+            }
+            TARGET(ASSIGN_LOCAL_LIST): {
+                Value &assigned = frames[frame_top - 1].stack[operand];
+                if (assigned.get_list() != nullptr) {
+                    destroy_list(assigned.get_list());
+                }
+                if (assigned.get_tag() == Value::Tag::REF) {
+                    *assigned.get_ref() = stack[stack_top - 1];
+                } else {
+                    assigned = stack[stack_top - 1];
+                }
+                stack[stack_top - 1] = Value::make_list_ref(stack[stack_top - 1].get_list());
+                DISPATCH();
+            }
+            TARGET(ASSIGN_GLOBAL_LIST): {
+                Value &assigned = modules[frames[frame_top - 1].module_index].stack[operand];
+                if (assigned.get_list() != nullptr) {
+                    destroy_list(assigned.get_list());
+                }
+                if (assigned.get_tag() == Value::Tag::REF) {
+                    *assigned.get_ref() = stack[stack_top - 1];
+                } else {
+                    assigned = stack[stack_top - 1];
+                }
+                stack[stack_top - 1] = Value::make_list_ref(stack[stack_top - 1].get_list());
+                DISPATCH();
+            }
+            TARGET(POP_LIST): {
+                if (stack[stack_top - 1].get_tag() == Value::Tag::LIST) {
+                    destroy_list(stack[--stack_top].get_list());
+                } else if (stack[stack_top - 1].get_tag() == Value::Tag::LIST_REF ||
+                           stack[stack_top - 1].get_tag() == Value::Tag::NULL_) {
+                    stack_top--;
+                }
+                DISPATCH();
+            }
+            /* Miscellaneous */
+            TARGET(ACCESS_FROM_TOP): {
+                push(stack[stack_top - operand]);
+                DISPATCH();
+            }
+            TARGET(ASSIGN_FROM_TOP): {
+                Value *assigned = &stack[stack_top - operand];
+                if (assigned->get_tag() == Value::Tag::REF) {
+                    assigned = assigned->get_ref();
+                }
+                if (assigned->get_tag() == Value::Tag::STRING) {
+                    cache.release(*assigned->get_string());
+                    *assigned = Value{&cache.retain(*stack[stack_top - 1].get_string())};
+                } else {
+                    *assigned = stack[stack_top - 1];
+                }
+                DISPATCH();
+            }
+            TARGET(ASSIGN_FROM_TOP_SCALAR): {
+                stack[stack_top - operand] = stack[stack_top - 1];
+                DISPATCH();
+            }
+            TARGET(EQUAL_SL): {
+                Value val2 = stack[--stack_top];
+                Value val1 = stack[stack_top - 1];
+                bool result = val1 == val2;
+                if (val1.get_tag() == Value::Tag::STRING) {
+                    cache.release(*val2.get_string());
+                    cache.release(*val1.get_string());
+                }
+                if (val1.get_tag() == Value::Tag::LIST) {
+                    destroy_list(val1.get_list());
+                }
+                if (val2.get_tag() == Value::Tag::LIST) {
+                    destroy_list(val2.get_list());
+                }
+                stack[stack_top - 1] = Value{result};
+                DISPATCH();
+            }
+            TARGET(EQUAL_STRING): {
+                Value::StringType val2 = stack[--stack_top].get_string();
+                Value::StringType val1 = stack[stack_top - 1].get_string();
+                stack[stack_top - 1] = Value{*val1 == *val2};
+                cache.release(*val2);
+                cache.release(*val1);
+                DISPATCH();
+            }
+            /* Move instructions */
+            TARGET(MOVE_LOCAL): {
+                Value &moved = frames[frame_top - 1].stack[operand];
+                push(Value{moved.get_list()});
+                moved = Value{Value::NullType{}};
+                DISPATCH();
+            }
+            TARGET(MOVE_GLOBAL): {
+                Value &moved = modules[frames[frame_top - 1].module_index].stack[operand];
+                stack[stack_top++] = moved;
+                moved = Value{Value::NullType{}};
+                DISPATCH();
+            }
+            TARGET(MOVE_INDEX): {
+                Value::IntType index = stack[--stack_top].get_int();
+                Value::ListType &list = *stack[stack_top - 1].get_list();
+                unshare_list(&list);
+                stack[stack_top - 1] = list[index];
+                list[index] = Value{Value::NullType{}};
+                DISPATCH();
+            }
+            /* Swap instructions */
+            TARGET(SWAP): {
+                Value first = stack[stack_top - operand];
+                Value second = stack[stack_top - operand - 1];
+                stack[stack_top - operand - 1] = first;
+                stack[stack_top - operand] = second;
+                DISPATCH();
+            }
+            /* Superinstructions */
+            TARGET(INC_LOCAL): {
+                Value &incremented = frames[frame_top - 1].stack[operand];
+                incremented = Value{incremented.get_int() + 1};
+                DISPATCH();
+            }
+            TARGET(POP_N): {
+                stack_top -= operand;
+                DISPATCH();
+            }
+            TARGET(LOCAL_LT_CONST_JUMP_BACK): {
+                const Value &constant = constants[(ip++)->operand];
+                Chunk::InstructionSizeType offset = (ip++)->operand;
+                if (frames[frame_top - 1].stack[operand].get_int() < constant.get_int()) {
+                    ip -= offset;
+                }
+                DISPATCH();
+            }
+#if !THREADED_DISPATCH
         }
+#endif
     }
-    return ExecutionState::RUNNING;
+
+    unreachable();
+
+#undef DISPATCH
+#undef TARGET
+#undef TRACE_EXECUTION
 }
 
+#if THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
+
 const HashedString &VirtualMachine::store_string(std::string str) {
-    return cache.insert(std::move(str));
+    return cache.make(std::move(str));
+}
+
+const HashedString &VirtualMachine::intern_string(std::string_view str) {
+    return cache.intern(str);
+}
+
+const HashedString &VirtualMachine::int_to_string(Value::IntType value) {
+    return cache.from_int(value);
 }
 
 void VirtualMachine::remove_string(const HashedString *str) {
-    cache.remove(*str);
+    cache.release(*str);
+}
+
+Value::ListType *VirtualMachine::store_list() {
+    return make_new_list();
 }
 
 #undef arith_binary_op
-#undef comp_binary_op
\ No newline at end of file
+#undef comp_binary_op
+#undef typed_comp_binary_op
+#undef check_call_depth
+#undef check_stack_space
\ No newline at end of file
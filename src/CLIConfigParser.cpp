@@ -32,6 +32,7 @@ const CLIConfigParser::Options CLIConfigParser::language_feature_options{
 
 const CLIConfigParser::Options CLIConfigParser::optimization_options{
     OPTIMIZATION_FLAG(CONSTANT_FOLDING, "Simplify expressions containing constant values (such as '5 + 6') into their computed values ('11')", "on"),
+    OPTIMIZATION_FLAG(FUSE_INSTRUCTIONS, "Replace common sequences of byte code instructions with single instructions that do the same work", "on"),
 };
 
 const CLIConfigParser::Options CLIConfigParser::runtime_options{
@@ -41,6 +42,18 @@ const CLIConfigParser::Options CLIConfigParser::runtime_options{
     {TRACE_EXEC, {"stack", "frame", "module", "insn", "module_init"}, "Print information during execution (supported: stack, frame, module, insn, module_init)",
         OptionType::QuantityTag::MULTI_VALUE,
         OptionType::ValueTypeTag::STRING_VALUE, RUNTIME_OPTION},
+    {MAX_STACK_SIZE, {}, "Maximum number of values on the VM stack (default: 1048576)",
+        OptionType::QuantityTag::SINGLE_VALUE,
+        OptionType::ValueTypeTag::STRING_VALUE, RUNTIME_OPTION},
+    {MAX_CALL_DEPTH, {}, "Maximum number of nested function calls (default: 65536)",
+        OptionType::QuantityTag::SINGLE_VALUE,
+        OptionType::ValueTypeTag::STRING_VALUE, RUNTIME_OPTION},
+    {SMALL_INT_STRINGS, {}, "Number of non-negative integers whose string forms are created up front (default: 1024, at most 1048576)",
+        OptionType::QuantityTag::SINGLE_VALUE,
+        OptionType::ValueTypeTag::STRING_VALUE, RUNTIME_OPTION},
+    {LIST_POOL_STATS, {}, "Print how much of the storage for lists was reused from the VM's pool once execution finishes",
+        OptionType::QuantityTag::SINGLE_VALUE,
+        OptionType::ValueTypeTag::BOOLEAN_VALUE, RUNTIME_OPTION},
 };
 // clang-format on
 
@@ -153,8 +166,8 @@ void CLIConfigParser::parse_options() {
                 store_options(result, language_feature_options, compile_config);
             }
             if (enabled_options & OPTIMIZATION_ENABLED) {
-                validate_args(result, runtime_options);
-                store_options(result, runtime_options, compile_config);
+                validate_args(result, optimization_options);
+                store_options(result, optimization_options, compile_config);
             }
             if (enabled_options & RUNTIME_ENABLED) {
                 validate_args(result, runtime_options);
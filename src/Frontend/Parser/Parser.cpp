@@ -147,6 +147,7 @@ void Parser::setup_rules() noexcept {
     add_rule(TokenType::FOR,           {nullptr, nullptr, ParsePrecedence::of::NONE});
     add_rule(TokenType::IF,            {nullptr, nullptr, ParsePrecedence::of::NONE});
     add_rule(TokenType::IMPORT,        {nullptr, nullptr, ParsePrecedence::of::NONE});
+    add_rule(TokenType::IN,            {nullptr, nullptr, ParsePrecedence::of::NONE});
     add_rule(TokenType::INT,           {&Parser::variable, nullptr, ParsePrecedence::of::NONE});
     add_rule(TokenType::MOVE,          {&Parser::move, nullptr, ParsePrecedence::of::PRIMARY});
     add_rule(TokenType::NULL_,         {nullptr, nullptr, ParsePrecedence::of::NONE});
@@ -1072,7 +1073,38 @@ StmtNode Parser::expression_statement() {
     return StmtNode{allocate_node(ExpressionStmt, std::move(expr))};
 }
 
+StmtNode Parser::for_range_statement() {
+    Token keyword = current_token;
+    consume("Expected loop variable after 'for' keyword", TokenType::IDENTIFIER);
+    Token name = current_token;
+    consume("Expected 'in' after loop variable", TokenType::IN);
+
+    ExprNode range = expression();
+    if (range->type_tag() != NodeType::BinaryExpr ||
+        (range->synthesized_attrs.token.type != TokenType::DOT_DOT &&
+            range->synthesized_attrs.token.type != TokenType::DOT_DOT_EQUAL)) {
+        throw_parse_error("Expected a range ('a..b' or 'a..=b') after 'in'", keyword);
+    }
+    auto &binary = static_cast<BinaryExpr &>(*range);
+    bool inclusive = binary.synthesized_attrs.token.type == TokenType::DOT_DOT_EQUAL;
+
+    while (peek().type == TokenType::END_OF_LINE) {
+        advance();
+    }
+
+    ScopedManager loop_manager{in_loop, true};
+    consume("Expected '{' after for-loop header", TokenType::LEFT_BRACE);
+    StmtNode body = block_statement();
+
+    return StmtNode{allocate_node(ForRangeStmt, std::move(keyword), std::move(name), std::move(binary.left),
+        std::move(binary.right), inclusive, std::move(body))};
+}
+
 StmtNode Parser::for_statement() {
+    if (peek().type == TokenType::IDENTIFIER) {
+        return for_range_statement();
+    }
+
     Token keyword = current_token;
     consume("Expected '(' after 'for' keyword", TokenType::LEFT_PAREN);
     ScopedManager scope_depth_manager{scope_depth, scope_depth + 1};
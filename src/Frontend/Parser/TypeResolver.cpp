@@ -1473,6 +1473,32 @@ StmtVisitorType TypeResolver::visit(ExpressionStmt &stmt) {
     resolve(stmt.expr.get());
 }
 
+StmtVisitorType TypeResolver::visit(ForRangeStmt &stmt) {
+    stmt.begin->inherited_attrs.parent = &stmt;
+    stmt.end->inherited_attrs.parent = &stmt;
+
+    // The bounds are resolved before the loop variable is declared, so they cannot refer to it
+    ExprVisitorType begin = resolve(stmt.begin.get());
+    ExprVisitorType end = resolve(stmt.end.get());
+    if (begin.info->primitive != Type::INT || end.info->primitive != Type::INT) {
+        error({"Ranges can only be created for integral types"}, stmt.keyword);
+        note({"Trying to use '", stringify(begin.info), "' and '", stringify(end.info), "' as range interval"});
+        throw TypeException{"Ranges can only be created for integral types"};
+    }
+
+    ScopedScopeManager manager{*this};
+    ScopedManager loop_manager{in_loop, true};
+
+    // The loop variable cannot be assigned to, as the FOR_RANGE instruction increments it directly. It is followed on
+    // the stack by the end of the range, which has no name
+    stmt.type = TypeNode{allocate_node(PrimitiveType, Type::INT, true, false)};
+    stmt.stack_slot = values.empty() ? 0 : values.back().stack_slot + 1;
+    values.push_back({stmt.name.lexeme, stmt.type.get(), scope_depth, nullptr, stmt.stack_slot});
+    values.push_back({"", stmt.type.get(), scope_depth, nullptr, stmt.stack_slot + 1});
+
+    resolve(stmt.body.get());
+}
+
 StmtVisitorType TypeResolver::visit(ForStmt &stmt) {
     if (not ctx->config->contains(I_AM_THE_CODE_FORMATTER_DONT_COMPLAIN_ABOUT_FOR_LOOP)) {
         ctx->logger.warning(current_module, {"Ignoring for-stmt"}, stmt.keyword);
@@ -1713,8 +1739,8 @@ StmtVisitorType TypeResolver::visit(VarStmt &stmt) {
     }
 
     if (not in_class || in_function) {
-        values.push_back({stmt.name.lexeme, type, scope_depth, initializer.class_,
-            (values.empty() ? 0 : values.back().stack_slot + 1)});
+        stmt.stack_slot = values.empty() ? 0 : values.back().stack_slot + 1;
+        values.push_back({stmt.name.lexeme, type, scope_depth, initializer.class_, stmt.stack_slot});
     }
 }
 
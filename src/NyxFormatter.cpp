@@ -352,6 +352,21 @@ StmtVisitorType NyxFormatter::visit(ExpressionStmt &stmt) {
     format(stmt.expr.get());
 }
 
+StmtVisitorType NyxFormatter::visit(ForRangeStmt &stmt) {
+    out << "for " << stmt.name.lexeme << " in ";
+    format(stmt.begin.get());
+    out << (stmt.inclusive ? "..=" : "..");
+    format(stmt.end.get());
+    if (ctx->config->contains(BRACE_NEXT_LINE) &&
+        config_contains(ctx->config->get<std::vector<std::string>>(BRACE_NEXT_LINE), "for")) {
+        out << '\n';
+        print_indent(indent);
+    } else {
+        out << " ";
+    }
+    format(stmt.body.get());
+}
+
 StmtVisitorType NyxFormatter::visit(ForStmt &stmt) {
     out << "for (";
     if (stmt.initializer != nullptr) {
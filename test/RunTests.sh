@@ -1,10 +1,30 @@
 #!/usr/bin/env bash
 
 NYX=$(find ../ -name nyx | head -n 1)
+status=0
 
 for i in $(find ./ -type f); do
   if ! [[ ${i} =~ RunTests.sh ]]; then
     echo "Running ${i}"
     ${NYX} --main ${i}
+
+    # Tests can check the generated code with ' * disassembly-has: INSN' and ' * disassembly-lacks: INSN' lines
+    if grep -q '^ \* disassembly-' ${i}; then
+      disassembly=$(${NYX} --main ${i} --disassemble-code=true)
+      for insn in $(sed -n 's/^ \* disassembly-has: //p' ${i}); do
+        if ! grep -qw "${insn}" <<< "${disassembly}"; then
+          echo "${i}: expected ${insn} in disassembly"
+          status=1
+        fi
+      done
+      for insn in $(sed -n 's/^ \* disassembly-lacks: //p' ${i}); do
+        if grep -qw "${insn}" <<< "${disassembly}"; then
+          echo "${i}: did not expect ${insn} in disassembly"
+          status=1
+        fi
+      done
+    fi
   fi
-done
\ No newline at end of file
+done
+
+exit ${status}